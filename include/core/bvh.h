@@ -0,0 +1,364 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "core/maths.h"
+#include <vector>
+#include <string.h> //memcpy
+#include <assert.h>
+
+namespace bkk
+{
+  namespace core
+  {
+    //Dynamic bounding volume hierarchy of axis aligned boxes. Leaves are inserted where they increase
+    //the surface of the tree the least and the tree is kept balanced with rotations. Leaves store an
+    //enlarged box, so objects moving inside it don't modify the tree
+    class bvh_t
+    {
+    public:
+      static const uint32_t INVALID_NODE = 0xFFFFFFFFu;
+
+      //margin is the fraction of its size a leaf box is enlarged in each direction
+      bvh_t(f32 margin = 0.1f);
+
+      //Returns the leaf node of the box. Leaf ids are stable until the leaf is removed
+      uint32_t insert(const maths::aabb_t& aabb, uint32_t userData);
+      void remove(uint32_t leaf);
+
+      //Reinserts the leaf if the new box is not inside its enlarged box. Returns true if the tree has been modified
+      bool update(uint32_t leaf, const maths::aabb_t& aabb);
+
+      //Changes the box of the leaf without modifying the tree. refit() has to be called before the next query
+      void setLeafAabb(uint32_t leaf, const maths::aabb_t& aabb);
+
+      //Shrinks the boxes of all the nodes to fit the latest boxes given for the leaves
+      void refit();
+
+      void clear();
+
+      uint32_t getUserData(uint32_t leaf) const { return node_[leaf].userData; }
+      uint32_t getHeight() const { return root_ == INVALID_NODE ? 0u : (uint32_t)node_[root_].height; }
+
+      //Calls callback(userData) for every leaf whose box is inside or intersecting the frustum.
+      //Nodes completely inside a plane don't test that plane again for their children
+      template <typename CALLBACK>
+      void queryFrustum(const maths::vec4* frustumPlanes, const CALLBACK& callback) const;
+
+      //Same traversal as queryFrustum, but boxes of the leaves are not tested. Calls callback(userData, inside) for every leaf
+      //whose parent is inside or intersecting the frustum. If inside is false the leaf box still has to be tested, so leaves
+      //can be tested in batches (see culling::frustumCull)
+      template <typename CALLBACK>
+      void queryFrustumLeaves(const maths::vec4* frustumPlanes, const CALLBACK& callback) const;
+
+      //Culls several frustums (6 planes each, up to MAX_FRUSTUMS) in a single traversal. Calls callback(userData, frustumMask)
+      //once for every leaf visible from any of the frustums, with bit i of frustumMask set if the leaf is visible from frustum i.
+      //Planes of a frustum that contain a node completely are not tested again for its children
+      static const uint32_t MAX_FRUSTUMS = 32u;
+
+      template <typename CALLBACK>
+      void queryFrustums(const maths::vec4* frustumPlanes, uint32_t frustumCount, const CALLBACK& callback) const;
+
+      //Same as queryFrustumLeaves for several frustums. Calls callback(userData, frustumMask, insideMask), where insideMask
+      //has bit i set if the leaf is inside frustum i. Leaves in frustumMask but not in insideMask still have to be tested
+      template <typename CALLBACK>
+      void queryFrustumsLeaves(const maths::vec4* frustumPlanes, uint32_t frustumCount, const CALLBACK& callback) const;
+
+      //Calls callback(userData) for every leaf whose box overlaps the box or the sphere
+      template <typename CALLBACK>
+      void queryAabb(const maths::aabb_t& aabb, const CALLBACK& callback) const;
+
+      template <typename CALLBACK>
+      void querySphere(const maths::vec3& center, f32 radius, const CALLBACK& callback) const;
+
+      //Finds the closest leaf box hit by the ray. direction doesn't need to be normalized, distance is given in units of direction
+      bool rayCast(const maths::vec3& origin, const maths::vec3& direction, f32 maxDistance, uint32_t* userData, f32* distance) const;
+
+    private:
+
+      struct node_t
+      {
+        maths::aabb_t aabb;       //Enlarged box for leaves
+        maths::aabb_t leafAabb;   //Box given for the leaf
+        uint32_t parent;          //Next free node if the node is not used
+        uint32_t child[2];
+        int32_t height;           //0 for leaves, -1 for free nodes
+        uint32_t userData;
+
+        bool isLeaf() const { return child[0] == INVALID_NODE; }
+      };
+
+      template <bool TEST_LEAVES, typename CALLBACK>
+      void frustumTraversal(const maths::vec4* frustumPlanes, const CALLBACK& callback) const;
+
+      template <bool TEST_LEAVES, typename CALLBACK>
+      void frustumsTraversal(const maths::vec4* frustumPlanes, uint32_t frustumCount, const CALLBACK& callback) const;
+
+      uint32_t allocateNode();
+      void freeNode(uint32_t node);
+      void insertLeaf(uint32_t leaf);
+      void removeLeaf(uint32_t leaf);
+      uint32_t balance(uint32_t node);
+      void updateNode(uint32_t node);
+      maths::aabb_t enlarge(const maths::aabb_t& aabb) const;
+
+      static maths::aabb_t merge(const maths::aabb_t& a, const maths::aabb_t& b);
+      static f32 perimeter(const maths::aabb_t& aabb);
+      static bool contains(const maths::aabb_t& a, const maths::aabb_t& b);
+      static bool overlaps(const maths::aabb_t& a, const maths::aabb_t& b);
+
+      std::vector<node_t> node_;
+      uint32_t root_;
+      uint32_t freeList_;
+      f32 margin_;
+      std::vector<uint32_t> refitStack_;  //Scratch memory used by refit
+      std::vector<uint32_t> refitOrder_;
+
+      //Size of the traversal stack of the queries. The tree is height balanced, so this is more than
+      //enough for any number of leaves that fits in uint32_t
+      static const uint32_t STACK_SIZE = 128u;
+    };
+
+    template <typename CALLBACK>
+    void bvh_t::queryFrustum(const maths::vec4* frustumPlanes, const CALLBACK& callback) const
+    {
+      frustumTraversal<true>(frustumPlanes, [&](uint32_t userData, bool) { callback(userData); });
+    }
+
+    template <typename CALLBACK>
+    void bvh_t::queryFrustumLeaves(const maths::vec4* frustumPlanes, const CALLBACK& callback) const
+    {
+      frustumTraversal<false>(frustumPlanes, callback);
+    }
+
+    template <bool TEST_LEAVES, typename CALLBACK>
+    void bvh_t::frustumTraversal(const maths::vec4* frustumPlanes, const CALLBACK& callback) const
+    {
+      if (root_ == INVALID_NODE)
+        return;
+
+      //Stack entries are node index and mask of the planes that still need to be tested
+      uint32_t stack[2 * STACK_SIZE];
+      uint32_t stackSize = 0u;
+      stack[stackSize++] = root_;
+      stack[stackSize++] = 0x3Fu;
+      while (stackSize > 0u)
+      {
+        uint32_t planeMask = stack[--stackSize];
+        const node_t& node = node_[stack[--stackSize]];
+        if (!TEST_LEAVES && node.isLeaf())
+        {
+          callback(node.userData, planeMask == 0u);
+          continue;
+        }
+
+        const maths::aabb_t& aabb = node.isLeaf() ? node.leafAabb : node.aabb;
+        maths::vec3 center = (aabb.min + aabb.max) * 0.5f;
+        maths::vec3 extent = (aabb.max - aabb.min) * 0.5f;
+        bool outside = false;
+        for (uint32_t p(0); p < 6 && !outside; ++p)
+        {
+          if ((planeMask & (1u << p)) == 0)
+            continue;
+
+          const maths::vec4& plane = frustumPlanes[p];
+          f32 distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+          f32 radius = fabsf(plane.x) * extent.x + fabsf(plane.y) * extent.y + fabsf(plane.z) * extent.z;
+          if (distance + radius < 0.0f)
+            outside = true;
+          else if (distance - radius >= 0.0f)
+            planeMask &= ~(1u << p);
+        }
+
+        if (outside)
+          continue;
+
+        if (node.isLeaf())
+        {
+          callback(node.userData, true);
+        }
+        else
+        {
+          assert(stackSize + 4u <= 2 * STACK_SIZE);
+          stack[stackSize++] = node.child[0];
+          stack[stackSize++] = planeMask;
+          stack[stackSize++] = node.child[1];
+          stack[stackSize++] = planeMask;
+        }
+      }
+    }
+
+    template <typename CALLBACK>
+    void bvh_t::queryFrustums(const maths::vec4* frustumPlanes, uint32_t frustumCount, const CALLBACK& callback) const
+    {
+      frustumsTraversal<true>(frustumPlanes, frustumCount, [&](uint32_t userData, uint32_t frustumMask, uint32_t) { callback(userData, frustumMask); });
+    }
+
+    template <typename CALLBACK>
+    void bvh_t::queryFrustumsLeaves(const maths::vec4* frustumPlanes, uint32_t frustumCount, const CALLBACK& callback) const
+    {
+      frustumsTraversal<false>(frustumPlanes, frustumCount, callback);
+    }
+
+    template <bool TEST_LEAVES, typename CALLBACK>
+    void bvh_t::frustumsTraversal(const maths::vec4* frustumPlanes, uint32_t frustumCount, const CALLBACK& callback) const
+    {
+      assert(frustumCount <= MAX_FRUSTUMS);
+      if (root_ == INVALID_NODE || frustumCount == 0u)
+        return;
+
+      //Stack entries are node index, mask of the frustums the node may be visible from and, for each frustum,
+      //mask of the planes that still need to be tested
+      uint32_t stack[2 * STACK_SIZE];
+      uint8_t planeMaskStack[STACK_SIZE][MAX_FRUSTUMS];
+      uint32_t stackSize = 0u;
+      stack[2 * stackSize] = root_;
+      stack[2 * stackSize + 1] = frustumCount == 32u ? 0xFFFFFFFFu : (1u << frustumCount) - 1u;
+      memset(planeMaskStack[stackSize], 0x3F, frustumCount);
+      stackSize++;
+
+      uint8_t planeMask[MAX_FRUSTUMS];
+      while (stackSize > 0u)
+      {
+        --stackSize;
+        const node_t& node = node_[stack[2 * stackSize]];
+        uint32_t frustumMask = stack[2 * stackSize + 1];
+        memcpy(planeMask, planeMaskStack[stackSize], frustumCount);
+        if (!TEST_LEAVES && node.isLeaf())
+        {
+          uint32_t insideMask = 0u;
+          for (uint32_t f(0); f < frustumCount; ++f)
+          {
+            if (planeMask[f] == 0u)
+              insideMask |= 1u << f;
+          }
+
+          callback(node.userData, frustumMask, insideMask & frustumMask);
+          continue;
+        }
+
+        const maths::aabb_t& aabb = node.isLeaf() ? node.leafAabb : node.aabb;
+        maths::vec3 center = (aabb.min + aabb.max) * 0.5f;
+        maths::vec3 extent = (aabb.max - aabb.min) * 0.5f;
+        for (uint32_t f(0); f < frustumCount; ++f)
+        {
+          if ((frustumMask & (1u << f)) == 0u || planeMask[f] == 0u)
+            continue;
+
+          const maths::vec4* plane = frustumPlanes + 6u * f;
+          for (uint32_t p(0); p < 6; ++p)
+          {
+            if ((planeMask[f] & (1u << p)) == 0)
+              continue;
+
+            f32 distance = plane[p].x * center.x + plane[p].y * center.y + plane[p].z * center.z + plane[p].w;
+            f32 radius = fabsf(plane[p].x) * extent.x + fabsf(plane[p].y) * extent.y + fabsf(plane[p].z) * extent.z;
+            if (distance + radius < 0.0f)
+            {
+              frustumMask &= ~(1u << f);
+              break;
+            }
+            else if (distance - radius >= 0.0f)
+            {
+              planeMask[f] &= ~(1u << p);
+            }
+          }
+        }
+
+        if (frustumMask == 0u)
+          continue;
+
+        if (node.isLeaf())
+        {
+          callback(node.userData, frustumMask, frustumMask);
+        }
+        else
+        {
+          assert(stackSize + 2u <= STACK_SIZE);
+          for (uint32_t i(0); i < 2; ++i)
+          {
+            stack[2 * stackSize] = node.child[i];
+            stack[2 * stackSize + 1] = frustumMask;
+            memcpy(planeMaskStack[stackSize], planeMask, frustumCount);
+            stackSize++;
+          }
+        }
+      }
+    }
+
+    template <typename CALLBACK>
+    void bvh_t::queryAabb(const maths::aabb_t& aabb, const CALLBACK& callback) const
+    {
+      if (root_ == INVALID_NODE)
+        return;
+
+      uint32_t stack[STACK_SIZE];
+      uint32_t stackSize = 0u;
+      stack[stackSize++] = root_;
+      while (stackSize > 0u)
+      {
+        const node_t& node = node_[stack[--stackSize]];
+        if (node.isLeaf())
+        {
+          if (overlaps(node.leafAabb, aabb))
+            callback(node.userData);
+        }
+        else if (overlaps(node.aabb, aabb))
+        {
+          assert(stackSize + 2u <= STACK_SIZE);
+          stack[stackSize++] = node.child[0];
+          stack[stackSize++] = node.child[1];
+        }
+      }
+    }
+
+    template <typename CALLBACK>
+    void bvh_t::querySphere(const maths::vec3& center, f32 radius, const CALLBACK& callback) const
+    {
+      if (root_ == INVALID_NODE)
+        return;
+
+      f32 radius2 = radius * radius;
+      uint32_t stack[STACK_SIZE];
+      uint32_t stackSize = 0u;
+      stack[stackSize++] = root_;
+      while (stackSize > 0u)
+      {
+        const node_t& node = node_[stack[--stackSize]];
+
+        //Squared distance from the center of the sphere to the box
+        const maths::aabb_t& aabb = node.isLeaf() ? node.leafAabb : node.aabb;
+        f32 distance2 = 0.0f;
+        for (uint32_t i(0); i < 3; ++i)
+        {
+          f32 d = maths::maxValue(maths::maxValue(aabb.min[i] - center[i], center[i] - aabb.max[i]), 0.0f);
+          distance2 += d * d;
+        }
+
+        if (distance2 > radius2)
+          continue;
+
+        if (node.isLeaf())
+        {
+          callback(node.userData);
+        }
+        else
+        {
+          assert(stackSize + 2u <= STACK_SIZE);
+          stack[stackSize++] = node.child[0];
+          stack[stackSize++] = node.child[1];
+        }
+      }
+    }
+
+  }//core
+}//bkk
+
+#endif  //  BVH_H
@@ -0,0 +1,72 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#ifndef CULLING_H
+#define CULLING_H
+
+#include "core/maths.h"
+#include <float.h> //FLT_MAX
+#include <vector>
+
+namespace bkk
+{
+  namespace core
+  {
+    namespace culling
+    {
+      //Axis aligned boxes stored as structure of arrays. Each box is given by its center and half extent.
+      //Use EMPTY_EXTENT as extent for boxes that should never be visible
+      static const f32 EMPTY_EXTENT = -FLT_MAX;
+
+      struct aabb_soa_t
+      {
+        const f32* centerX;
+        const f32* centerY;
+        const f32* centerZ;
+        const f32* extentX;
+        const f32* extentY;
+        const f32* extentZ;
+      };
+
+      //Converts an aabb given by its min and max corners to center and half extent
+      void aabbToCenterExtent(const maths::aabb_t& aabb, maths::vec3* center, maths::vec3* extent);
+
+      //Tests boxes [begin,end) against the six frustum planes (see maths::frustumPlanesFromMatrix). Several boxes are
+      //tested at once using SIMD instructions if available. Indices of the visible boxes are written to visibleIndex,
+      //which needs room for (end - begin) elements. Returns the number of visible boxes
+      uint32_t frustumCull(const maths::vec4* frustumPlanes, const aabb_soa_t& boxes, uint32_t begin, uint32_t end, uint32_t* visibleIndex);
+
+      //Hierarchical depth buffer. Each texel has the farthest depth of the region it covers, so a box whose
+      //closest point is further than the depth of the texels it projects to is hidden
+      static const uint32_t DEPTH_PYRAMID_MAX_SIZE = 512u;  //Maximum size of the finest level
+
+      struct depth_pyramid_t
+      {
+        uint32_t levelCount = 0u;
+        std::vector<uint32_t> levelOffset;  //Offset of each level in depth
+        std::vector<uint32_t> levelWidth;
+        std::vector<uint32_t> levelHeight;
+        std::vector<f32> depth;             //All the levels, finest first
+
+        maths::vec2 scale;                  //Size of the depth buffer in texels of the finest level
+        maths::mat4 viewProjection;         //Transformation used to render the depth buffer
+      };
+
+      //Builds the pyramid from a depth buffer rendered with viewProjection. Depth is the normalized device coordinates z
+      //(bigger is further). The depth buffer is reduced until it fits in DEPTH_PYRAMID_MAX_SIZE before storing the first level
+      void depthPyramidBuild(const f32* depth, uint32_t width, uint32_t height, const maths::mat4& viewProjection, depth_pyramid_t* pyramid);
+
+      //Tests boxes index[0..count) against the depth pyramid. Indices of the boxes that may be visible are written to visibleIndex,
+      //which can be the same array as index. Boxes crossing the near plane are always visible. Returns the number of visible boxes
+      uint32_t occlusionCull(const depth_pyramid_t& pyramid, const aabb_soa_t& boxes, const uint32_t* index, uint32_t count, uint32_t* visibleIndex);
+
+    }//culling
+  }//core
+}//bkk
+
+#endif  //  CULLING_H
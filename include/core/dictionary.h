@@ -8,71 +8,200 @@
 
 #pragma once
 
-#include "vector"
+#include <vector>
+#include <functional>
+
+#include "core/handle.h"
 
 namespace bkk
 {
   namespace core
   {
-    template <typename KEY_TYPE, typename VALUE_TYPE>
+    //Hash function used by dictionary_t. Specialize it for key types not supported by std::hash
+    template <typename KEY_TYPE>
+    struct dictionary_hash_t
+    {
+      uint32_t operator()(const KEY_TYPE& key) const
+      {
+        uint64_t hash = (uint64_t)std::hash<KEY_TYPE>()(key);
+        return (uint32_t)(hash ^ (hash >> 32));
+      }
+    };
+
+    template <size_t N1, size_t N2>
+    struct dictionary_hash_t< generic_handle_t<N1, N2> >
+    {
+      uint32_t operator()(const generic_handle_t<N1, N2>& key) const
+      {
+        //Bitfields narrower than int are promoted to signed int, so shifting them could overflow
+        uint32_t index = (uint32_t)key.index;
+        uint32_t generation = (uint32_t)key.generation;
+        return index ^ (generation << 24u) ^ (generation >> 8u);
+      }
+    };
+
+    //Hash map with open addressing (linear probing). Keys and values are kept in packed arrays
+    //and the hash table only stores the hash and the index of each entry, so probing never touches
+    //keys unless the hashes match
+    template <typename KEY_TYPE, typename VALUE_TYPE, typename HASH = dictionary_hash_t<KEY_TYPE> >
     class dictionary_t
     {
     public:
 
+      dictionary_t() :slotMask_(0u), slotShift_(32u) {}
+
       void add(const KEY_TYPE& key, const VALUE_TYPE& value)
       {
-        for (uint32_t i = 0; i < (uint32_t)keys_.size(); ++i)
+        uint32_t hash = hashKey(key);
+        uint32_t slot;
+        if (findSlot(key, hash, &slot))
         {
-          if (key == keys_[i])
-          {
-            values_[i] = value;
-            return;
-          }
+          values_[slot_[slot].index] = value;
+          return;
         }
 
+        //Keep load factor under 50%
+        if (((uint32_t)keys_.size() + 1u) * 2u > (uint32_t)slot_.size())
+        {
+          rehash(slot_.empty() ? 16u : (uint32_t)slot_.size() * 2u);
+          findSlot(key, hash, &slot);
+        }
+
+        slot_[slot].hash = hash;
+        slot_[slot].index = (uint32_t)keys_.size();
         keys_.push_back(key);
         values_.push_back(value);
       }
 
       bool remove(const KEY_TYPE& key)
       {
-        int32_t index = -1;
-        for (uint32_t i = 0; i < (uint32_t)keys_.size(); ++i)
+        uint32_t slot;
+        if (!findSlot(key, hashKey(key), &slot))
+          return false;
+
+        uint32_t index = slot_[slot].index;
+        eraseSlot(slot);
+
+        //Move last entry to the gap and update the slot pointing to it
+        uint32_t last = (uint32_t)keys_.size() - 1u;
+        if (index < last)
         {
-          if (key == keys_[i])
-          {
-              uint32_t count = (uint32_t)keys_.size();
-              if (i < count - 1)
-              {
-                keys_[i] = keys_[count - 1];
-                values_[i] = values_[count - 1];
-              }
-
-              keys_.pop_back();
-              values_.pop_back();
-              return true;
-            }
+          findSlot(keys_[last], hashKey(keys_[last]), &slot);
+          slot_[slot].index = index;
+          keys_[index] = keys_[last];
+          values_[index] = values_[last];
         }
 
-        return false;
+        keys_.pop_back();
+        values_.pop_back();
+        return true;
       }
 
       VALUE_TYPE* get(const KEY_TYPE& key)
       {
-        for (uint32_t i = 0; i < (uint32_t)keys_.size(); ++i)
-        {
-          if (key == keys_[i])
-            return &values_[i];
-        }
+        uint32_t slot;
+        if (findSlot(key, hashKey(key), &slot))
+          return &values_[slot_[slot].index];
 
         return nullptr;
       }
-      
+
       std::vector<VALUE_TYPE>& data() { return values_; }
 
     private:
+
+      static const uint32_t EMPTY_SLOT = 0xFFFFFFFFu;
+
+      struct slot_t
+      {
+        uint32_t hash;
+        uint32_t index;   //Index in keys_ and values_, or EMPTY_SLOT
+      };
+
+      static uint32_t hashKey(const KEY_TYPE& key)
+      {
+        //Fibonacci hashing. The high bits of the product depend on all the bits of the key, so slots are taken
+        //from them (see idealSlot) and consecutive keys (e.g handle indices) are spread over the table
+        return HASH()(key) * 2654435769u;
+      }
+
+      uint32_t idealSlot(uint32_t hash) const
+      {
+        return slotShift_ < 32u ? hash >> slotShift_ : 0u;
+      }
+
+      //Returns true if key is found. Otherwise slot is the empty slot where key should go
+      bool findSlot(const KEY_TYPE& key, uint32_t hash, uint32_t* slot) const
+      {
+        if (slot_.empty())
+          return false;
+
+        uint32_t i = idealSlot(hash);
+        while (slot_[i].index != EMPTY_SLOT)
+        {
+          if (slot_[i].hash == hash && keys_[slot_[i].index] == key)
+          {
+            *slot = i;
+            return true;
+          }
+
+          i = (i + 1u) & slotMask_;
+        }
+
+        *slot = i;
+        return false;
+      }
+
+      //Backward shift deletion. Entries following the erased slot are moved back if their
+      //ideal position allows it, so lookups never need tombstones
+      void eraseSlot(uint32_t slot)
+      {
+        uint32_t i = slot;
+        uint32_t j = slot;
+        while (true)
+        {
+          j = (j + 1u) & slotMask_;
+          if (slot_[j].index == EMPTY_SLOT)
+            break;
+
+          uint32_t ideal = idealSlot(slot_[j].hash);
+          bool canMove = (i <= j) ? (ideal <= i || ideal > j) : (ideal <= i && ideal > j);
+          if (canMove)
+          {
+            slot_[i] = slot_[j];
+            i = j;
+          }
+        }
+
+        slot_[i].index = EMPTY_SLOT;
+      }
+
+      void rehash(uint32_t slotCount)
+      {
+        slot_t emptySlot = { 0u, EMPTY_SLOT };
+        slot_.assign(slotCount, emptySlot);
+        slotMask_ = slotCount - 1u;
+        slotShift_ = 32u;
+        for (uint32_t i = slotCount; i > 1u; i >>= 1u)
+          slotShift_--;
+
+        for (uint32_t i = 0; i < (uint32_t)keys_.size(); ++i)
+        {
+          uint32_t hash = hashKey(keys_[i]);
+          uint32_t slot = idealSlot(hash);
+          while (slot_[slot].index != EMPTY_SLOT)
+            slot = (slot + 1u) & slotMask_;
+
+          slot_[slot].hash = hash;
+          slot_[slot].index = i;
+        }
+      }
+
       std::vector<KEY_TYPE> keys_;
       std::vector<VALUE_TYPE> values_;
+      std::vector<slot_t> slot_;  //Hash table. Size is always a power of two
+      uint32_t slotMask_;
+      uint32_t slotShift_;  //32 - log2(slot count)
     };
 
   }//core
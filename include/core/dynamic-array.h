@@ -10,11 +10,16 @@
 #define DYNAMIC_ARRAY_H
 
 #include <stdint.h>
+#include <string.h>
+#include <utility>
+#include <type_traits>
 
 namespace bkk
 {  
   namespace core
   {
+    //Resizable array. Trivially copyable types are copied with memcpy when the array grows,
+    //other types are moved element by element
     template <typename T>
     class dynamic_array_t
     {
@@ -22,7 +27,9 @@ namespace bkk
       dynamic_array_t()
         :size_(0u),
         capacity_(0u),
-        data_(nullptr)
+        data_(nullptr),
+        scratchCapacity_(0u),
+        scratch_(nullptr)
       {
       }
 
@@ -39,28 +46,55 @@ namespace bkk
         operator=(v);
       }
 
+      dynamic_array_t(dynamic_array_t&& v)
+        :dynamic_array_t()
+      {
+        operator=(std::move(v));
+      }
+
       ~dynamic_array_t()
       {
-        if (data_)
-          delete[] data_;
+        clear();
       }
 
       dynamic_array_t& operator=(const dynamic_array_t<T>& v)
       {
-        clear();
-        resize(v.size_);
-        memcpy(data_, v.data_, capacity_ * sizeof(T));
+        if (this != &v)
+        {
+          size_ = 0u;
+          growArray(v.size_);
+          copyElements(data_, v.data_, v.size_);
+          size_ = v.size_;
+        }
+        return *this;
+      }
+
+      dynamic_array_t& operator=(dynamic_array_t<T>&& v)
+      {
+        if (this != &v)
+        {
+          clear();
+          std::swap(size_, v.size_);
+          std::swap(capacity_, v.capacity_);
+          std::swap(data_, v.data_);
+        }
         return *this;
       }
 
       void clear()
       {
-        size_ = capacity_ = 0;
+        size_ = capacity_ = scratchCapacity_ = 0;
         if (data_)
         {
           delete[] data_;
           data_ = nullptr;
         }
+
+        if (scratch_)
+        {
+          delete[] scratch_;
+          scratch_ = nullptr;
+        }
       }
 
       uint32_t size() const
@@ -89,6 +123,11 @@ namespace bkk
         size_ = newSize;
       }
 
+      void reserve(uint32_t capacity)
+      {
+        growArray(capacity);
+      }
+
       T* data()
       {
         return data_;
@@ -114,100 +153,191 @@ namespace bkk
         data_[size_++] = v;
       }
 
+      void push_back(T&& v)
+      {
+        if (size_ == capacity_)
+        {
+          growArray(size_ + 1);
+        }
+
+        data_[size_++] = std::move(v);
+      }
+
+      //Stable bottom-up merge sort using operator<. The scratch buffer is kept between calls,
+      //so sorting an array that doesn't grow doesn't allocate memory
       void sort()
       {
-        mergeSort(data_, 0, size_ - 1);
+        if (size_ < 2u)
+          return;
+
+        growScratch(size_);
+
+        T* src = data_;
+        T* dst = scratch_;
+        for (uint32_t width = 1u; width < size_; width *= 2u)
+        {
+          for (uint32_t low = 0u; low < size_; low += 2u * width)
+          {
+            uint32_t mid = minValue(low + width, size_);
+            uint32_t high = minValue(low + 2u * width, size_);
+            merge(src, dst, low, mid, high);
+          }
+          std::swap(src, dst);
+        }
+
+        if (src != data_)
+          moveElements(data_, src, size_);
+      }
+
+      //Stable LSD radix sort on an unsigned integer key, key(element), 8 bits per pass.
+      //Passes where all the elements have the same digit are skipped
+      template <typename KEY_FUNC>
+      void radixSort(const KEY_FUNC& key)
+      {
+        typedef typename std::decay<decltype(key(data_[0]))>::type key_t;
+        static_assert(std::is_integral<key_t>::value && std::is_unsigned<key_t>::value, "Radix sort needs unsigned integer keys");
+
+        if (size_ < 2u)
+          return;
+
+        growScratch(size_);
+
+        T* src = data_;
+        T* dst = scratch_;
+        for (uint32_t shift = 0u; shift < sizeof(key_t) * 8u; shift += 8u)
+        {
+          uint32_t offset[256] = {};
+          for (uint32_t i = 0u; i < size_; ++i)
+            offset[(key(src[i]) >> shift) & 0xFF]++;
+
+          if (offset[(key(src[0]) >> shift) & 0xFF] == size_)
+            continue;
+
+          uint32_t sum = 0u;
+          for (uint32_t i = 0u; i < 256u; ++i)
+          {
+            uint32_t count = offset[i];
+            offset[i] = sum;
+            sum += count;
+          }
+
+          for (uint32_t i = 0u; i < size_; ++i)
+            dst[offset[(key(src[i]) >> shift) & 0xFF]++] = std::move(src[i]);
+
+          std::swap(src, dst);
+        }
+
+        if (src != data_)
+          moveElements(data_, src, size_);
+      }
+
+      //Radix sort of arrays of unsigned integers
+      void radixSort()
+      {
+        radixSort([](const T& v) { return v; });
       }
 
       void swap(uint32_t a, uint32_t b)
       {
-        T temp = data_[a];
-        data_[a] = data_[b];
-        data_[b] = temp;
+        std::swap(data_[a], data_[b]);
       }
 
     private:
 
+      static const bool TRIVIALLY_COPYABLE = std::is_trivially_copyable<T>::value;
+
+      static uint32_t minValue(uint32_t a, uint32_t b)
+      {
+        return a < b ? a : b;
+      }
+
+      static void copyElements(T* dst, const T* src, uint32_t count)
+      {
+        if (TRIVIALLY_COPYABLE)
+        {
+          if (count > 0u)
+            memcpy((void*)dst, (const void*)src, sizeof(T)*count);
+        }
+        else
+        {
+          for (uint32_t i = 0u; i < count; ++i)
+            dst[i] = src[i];
+        }
+      }
+
+      static void moveElements(T* dst, T* src, uint32_t count)
+      {
+        if (TRIVIALLY_COPYABLE)
+        {
+          if (count > 0u)
+            memcpy((void*)dst, (const void*)src, sizeof(T)*count);
+        }
+        else
+        {
+          for (uint32_t i = 0u; i < count; ++i)
+            dst[i] = std::move(src[i]);
+        }
+      }
+
       void growArray(uint32_t newSize)
       {
         if (newSize > capacity_)
         {
           T* oldData = data_;
 
+          //New memory is value-initialized (zero for trivial types)
           uint32_t growSize = newSize + newSize / 2;
-          data_ = new T[growSize];
+          data_ = new T[growSize]();
 
           if (oldData)
           {
-            memcpy(data_, oldData, sizeof(T)*size_);
+            moveElements(data_, oldData, size_);
             delete[] oldData;
           }
 
-          //Initialize new memory to zero
-          memset(data_ + capacity_, 0, sizeof(T)*(growSize - capacity_));
-          
           capacity_ = growSize;
         }
       }
 
-      void merge(T *a, uint32_t low, uint32_t high, uint32_t mid)
+      void growScratch(uint32_t size)
       {
-        dynamic_array_t<T> temp(high - low + 1);
-        uint32_t i = low;
-        uint32_t j = mid + 1;
-        uint32_t k = 0;
-        while (i <= mid && j <= high)
-        {
-          if (a[i] < a[j])
-          {
-            temp[k] = a[i];
-            k++;
-            i++;
-          }
-          else
-          {
-            temp[k] = a[j];
-            k++;
-            j++;
-          }
-        }
-
-        while (i <= mid)
+        if (size > scratchCapacity_)
         {
-          temp[k] = a[i];
-          k++;
-          i++;
-        }
+          if (scratch_)
+            delete[] scratch_;
 
-        while (j <= high)
-        {
-          temp[k] = a[j];
-          k++;
-          j++;
-        }
-
-        for (i = low; i <= high; i++)
-        {
-          a[i] = temp[i - low];
+          scratch_ = new T[capacity_];
+          scratchCapacity_ = capacity_;
         }
       }
 
-      void mergeSort(T *a, uint32_t low, uint32_t high)
+      //Merges the sorted ranges [low,mid) and [mid,high) of src into dst
+      static void merge(T* src, T* dst, uint32_t low, uint32_t mid, uint32_t high)
       {
-        uint32_t mid;
-        if (low < high)
+        uint32_t i = low;
+        uint32_t j = mid;
+        uint32_t k = low;
+        while (i < mid && j < high)
         {
-          mid = (low + high) / 2;
-          mergeSort(a, low, mid);
-          mergeSort(a, mid + 1, high);
-          merge(a, low, high, mid);
+          if (src[j] < src[i])
+            dst[k++] = std::move(src[j++]);
+          else
+            dst[k++] = std::move(src[i++]);
         }
+
+        while (i < mid)
+          dst[k++] = std::move(src[i++]);
+
+        while (j < high)
+          dst[k++] = std::move(src[j++]);
       }
 
       uint32_t size_;
       uint32_t capacity_;
       T* data_;
 
+      uint32_t scratchCapacity_;
+      T* scratch_;  //Temporary storage used by sort and radixSort
     };
   }//core
 }//bkk
@@ -10,14 +10,40 @@
 #define HANDLE_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+//Width of the handles used by the engine. Default is 32 bits of index and 32 bits of generation (64-bit handles).
+//Define BKK_HANDLE_INDEX_BITS and BKK_HANDLE_GENERATION_BITS to use narrower handles (e.g 24/8 for 32-bit handles).
+//The generation counter of a slot wraps after 2^BKK_HANDLE_GENERATION_BITS reuses, and then a stale handle is valid again
+//for the new object in the slot, so keep at least 16 bits of generation if elements are created and destroyed often
+#ifndef BKK_HANDLE_INDEX_BITS
+#define BKK_HANDLE_INDEX_BITS 32u
+#endif
+
+#ifndef BKK_HANDLE_GENERATION_BITS
+#define BKK_HANDLE_GENERATION_BITS 32u
+#endif
 
 namespace bkk
 {
   namespace core
   {
+    //Handle made of an index and a generation counter. N1 and N2 are the number of bits used for each of them.
+    //The largest index is reserved for null handles, so containers can hold up to MAX_INDEX elements
     template <size_t N1, size_t N2>
     struct generic_handle_t
     {
+      static_assert(N1 > 0u && N1 <= 32u && N2 > 0u && N2 <= 32u, "Invalid handle width");
+
+      static const uint32_t MAX_INDEX = 0xFFFFFFFFu >> (32u - N1);
+      static const uint32_t MAX_GENERATION = 0xFFFFFFFFu >> (32u - N2);
+
+      static generic_handle_t null()
+      {
+        generic_handle_t handle = { MAX_INDEX, MAX_GENERATION };
+        return handle;
+      }
+
       uint32_t index : N1;
       uint32_t generation : N2;
     };
@@ -34,9 +60,9 @@ namespace bkk
       return (h0.index != h1.index) || (h0.generation != h1.generation);
     }
 
-    typedef generic_handle_t<16u, 16u> bkk_handle_t;
-    static const bkk_handle_t BKK_NULL_HANDLE = { 65535u,65535u };
+    typedef generic_handle_t<BKK_HANDLE_INDEX_BITS, BKK_HANDLE_GENERATION_BITS> bkk_handle_t;
+    static const bkk_handle_t BKK_NULL_HANDLE = { bkk_handle_t::MAX_INDEX, bkk_handle_t::MAX_GENERATION };
   }
 }
 
-#endif HANDLE_H
\ No newline at end of file
+#endif // HANDLE_H
\ No newline at end of file
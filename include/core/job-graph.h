@@ -0,0 +1,52 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#ifndef JOB_GRAPH_H
+#define JOB_GRAPH_H
+
+#include "core/thread-pool.h"
+
+#include <vector>
+
+namespace bkk
+{
+  namespace core
+  {
+    //Set of persistent tasks and their dependencies that is executed as a whole (e.g once per frame).
+    //Jobs are declared once and the graph can be kicked any number of times without allocating memory.
+    //Jobs are owned by the caller and must outlive the graph
+    class job_graph_t
+    {
+    public:
+      typedef thread_pool_t::task_t job_t;
+
+      job_graph_t();
+      ~job_graph_t();
+
+      void addJob(job_t* job);
+      void addDependency(job_t* job, job_t* dependsOn);
+      void clear();
+
+      uint32_t getJobCount() { return (uint32_t)job_.size(); }
+
+      //Enqueue all the jobs in the thread pool
+      void kick(thread_pool_t* pool);
+
+      //Wait for all the jobs in the graph to finish. Calling thread executes jobs while waiting
+      void wait(thread_pool_t* pool);
+
+      void run(thread_pool_t* pool);
+
+    private:
+      std::vector<job_t*> job_;
+      thread_pool_t::task_group_t group_;
+    };
+
+  }//core
+}//bkk
+#endif  //  JOB_GRAPH_H
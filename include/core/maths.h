@@ -14,6 +14,17 @@
 #include <stdint.h>
 #include <stdlib.h> //RAND_MAX
 
+//SIMD implementation of the f32 4x4 matrix functions is selected at compile time.
+//Define BKK_MATHS_NO_SIMD to use the generic scalar code
+#if !defined(BKK_MATHS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define BKK_MATHS_SSE
+#include <emmintrin.h>
+#if defined(__AVX__)
+#define BKK_MATHS_AVX
+#include <immintrin.h>
+#endif
+#endif
+
 
 #define PI       3.14159265358979323846
 #define PI_2     1.57079632679489661923 
@@ -401,6 +412,7 @@ namespace bkk
 
       typedef AABB<f32> aabb_t;
 
+      //Axis aligned box containing the transformed box (Arvo's method)
       template<typename T>
       AABB<T> aabbTransform(const AABB<T>& aabb, const Matrix<T,4,4>& transform);
 
@@ -1438,9 +1450,23 @@ namespace bkk
       template <typename T>
       AABB<T> aabbTransform(const AABB<T>& aabb, const Matrix<T,4,4>& transform)
       {
-        Vector<T, 4> min = vec4(aabb.min, 1.0f) * transform;
-        Vector<T, 4> max = vec4(aabb.max, 1.0f) * transform;
-        return AABB<T>{ min.xyz(), max.xyz() };
+        //Start with the translation and add, for each axis, the smallest and largest
+        //contribution of the rotated and scaled box extents
+        AABB<T> result = { Vector<T, 3>(transform(3, 0), transform(3, 1), transform(3, 2)),
+                           Vector<T, 3>(transform(3, 0), transform(3, 1), transform(3, 2)) };
+
+        for (u8 i(0); i < 3; ++i)
+        {
+          for (u8 j(0); j < 3; ++j)
+          {
+            T a = transform(i, j) * aabb.min[i];
+            T b = transform(i, j) * aabb.max[i];
+            result.min[j] += minValue(a, b);
+            result.max[j] += maxValue(a, b);
+          }
+        }
+
+        return result;
       }
 
       template <typename T>
@@ -1466,6 +1492,161 @@ namespace bkk
         return true;
       }
 
+
+#ifdef BKK_MATHS_SSE
+      /**************************************/
+      /* SIMD f32 4x4 matrix specializations */
+      /**************************************/
+
+      //Non-template overloads are preferred over the generic templates for f32 arguments.
+      //Matrices are row major, so each row of data is loaded in one register
+
+      inline mat4 operator*(const mat4& m0, const mat4& m1)
+      {
+        mat4 result;
+#ifdef BKK_MATHS_AVX
+        //Two rows of the result at a time
+        __m256 row0 = _mm256_broadcast_ps((const __m128*)&m1.data[0]);
+        __m256 row1 = _mm256_broadcast_ps((const __m128*)&m1.data[4]);
+        __m256 row2 = _mm256_broadcast_ps((const __m128*)&m1.data[8]);
+        __m256 row3 = _mm256_broadcast_ps((const __m128*)&m1.data[12]);
+        for (u32 i(0); i < 16; i += 8)
+        {
+          __m256 a = _mm256_loadu_ps(&m0.data[i]);
+          __m256 r = _mm256_mul_ps(_mm256_shuffle_ps(a, a, 0x00), row0);
+          r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(a, a, 0x55), row1));
+          r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(a, a, 0xAA), row2));
+          r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_shuffle_ps(a, a, 0xFF), row3));
+          _mm256_storeu_ps(&result.data[i], r);
+        }
+#else
+        __m128 row0 = _mm_loadu_ps(&m1.data[0]);
+        __m128 row1 = _mm_loadu_ps(&m1.data[4]);
+        __m128 row2 = _mm_loadu_ps(&m1.data[8]);
+        __m128 row3 = _mm_loadu_ps(&m1.data[12]);
+        for (u32 i(0); i < 16; i += 4)
+        {
+          __m128 a = _mm_loadu_ps(&m0.data[i]);
+          __m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, 0x00), row0);
+          r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, 0x55), row1));
+          r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xAA), row2));
+          r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, 0xFF), row3));
+          _mm_storeu_ps(&result.data[i], r);
+        }
+#endif
+        return result;
+      }
+
+      inline vec4 operator*(const vec4& v, const mat4& m)
+      {
+        __m128 r = _mm_mul_ps(_mm_set1_ps(v.x), _mm_loadu_ps(&m.data[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.y), _mm_loadu_ps(&m.data[4])));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.z), _mm_loadu_ps(&m.data[8])));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.w), _mm_loadu_ps(&m.data[12])));
+
+        vec4 result;
+        _mm_storeu_ps(result.data, r);
+        return result;
+      }
+
+      template <>
+      inline void Matrix<f32, 4, 4>::transpose()
+      {
+        __m128 row0 = _mm_loadu_ps(&data[0]);
+        __m128 row1 = _mm_loadu_ps(&data[4]);
+        __m128 row2 = _mm_loadu_ps(&data[8]);
+        __m128 row3 = _mm_loadu_ps(&data[12]);
+        _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+        _mm_storeu_ps(&data[0], row0);
+        _mm_storeu_ps(&data[4], row1);
+        _mm_storeu_ps(&data[8], row2);
+        _mm_storeu_ps(&data[12], row3);
+      }
+
+      //Helpers for invertMatrix. 2x2 matrices are stored in one register as (m00, m01, m10, m11)
+      #define BKK_SHUFFLE(v0, v1, x, y, z, w) _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(w, z, y, x))
+      #define BKK_SWIZZLE(v, x, y, z, w) BKK_SHUFFLE(v, v, x, y, z, w)
+
+      namespace detail
+      {
+        //A * B
+        inline __m128 mat2Mul(__m128 a, __m128 b)
+        {
+          return _mm_add_ps(_mm_mul_ps(a, BKK_SWIZZLE(b, 0, 3, 0, 3)),
+                            _mm_mul_ps(BKK_SWIZZLE(a, 1, 0, 3, 2), BKK_SWIZZLE(b, 2, 1, 2, 1)));
+        }
+
+        //adjugate(A) * B
+        inline __m128 mat2AdjMul(__m128 a, __m128 b)
+        {
+          return _mm_sub_ps(_mm_mul_ps(BKK_SWIZZLE(a, 3, 3, 0, 0), b),
+                            _mm_mul_ps(BKK_SWIZZLE(a, 1, 1, 2, 2), BKK_SWIZZLE(b, 2, 3, 0, 1)));
+        }
+
+        //A * adjugate(B)
+        inline __m128 mat2MulAdj(__m128 a, __m128 b)
+        {
+          return _mm_sub_ps(_mm_mul_ps(a, BKK_SWIZZLE(b, 3, 0, 3, 0)),
+                            _mm_mul_ps(BKK_SWIZZLE(a, 1, 0, 3, 2), BKK_SWIZZLE(b, 2, 1, 2, 1)));
+        }
+      }//detail
+
+      //Inverse using the 2x2 block decomposition of the matrix
+      inline bool invertMatrix(const mat4& m, mat4* result)
+      {
+        __m128 row0 = _mm_loadu_ps(&m.data[0]);
+        __m128 row1 = _mm_loadu_ps(&m.data[4]);
+        __m128 row2 = _mm_loadu_ps(&m.data[8]);
+        __m128 row3 = _mm_loadu_ps(&m.data[12]);
+
+        //Sub matrices
+        __m128 A = _mm_movelh_ps(row0, row1);
+        __m128 B = _mm_movehl_ps(row1, row0);
+        __m128 C = _mm_movelh_ps(row2, row3);
+        __m128 D = _mm_movehl_ps(row3, row2);
+
+        //Determinants of the sub matrices (|A|, |B|, |C|, |D|)
+        __m128 detSub = _mm_sub_ps(_mm_mul_ps(BKK_SHUFFLE(row0, row2, 0, 2, 0, 2), BKK_SHUFFLE(row1, row3, 1, 3, 1, 3)),
+                                   _mm_mul_ps(BKK_SHUFFLE(row0, row2, 1, 3, 1, 3), BKK_SHUFFLE(row1, row3, 0, 2, 0, 2)));
+        __m128 detA = BKK_SWIZZLE(detSub, 0, 0, 0, 0);
+        __m128 detB = BKK_SWIZZLE(detSub, 1, 1, 1, 1);
+        __m128 detC = BKK_SWIZZLE(detSub, 2, 2, 2, 2);
+        __m128 detD = BKK_SWIZZLE(detSub, 3, 3, 3, 3);
+
+        __m128 DC = detail::mat2AdjMul(D, C);
+        __m128 AB = detail::mat2AdjMul(A, B);
+        __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), detail::mat2Mul(B, DC));
+        __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), detail::mat2Mul(C, AB));
+        __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), detail::mat2MulAdj(D, AB));
+        __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), detail::mat2MulAdj(A, DC));
+
+        //Determinant of the matrix
+        __m128 detM = _mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC));
+        __m128 tr = _mm_mul_ps(AB, BKK_SWIZZLE(DC, 0, 2, 1, 3));
+        tr = _mm_add_ps(tr, BKK_SWIZZLE(tr, 2, 3, 0, 1));
+        tr = _mm_add_ps(tr, BKK_SWIZZLE(tr, 1, 0, 3, 2));
+        detM = _mm_sub_ps(detM, tr);
+
+        if (_mm_cvtss_f32(detM) == 0.0f)
+          return false;
+
+        __m128 rDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+        X = _mm_mul_ps(X, rDetM);
+        Y = _mm_mul_ps(Y, rDetM);
+        Z = _mm_mul_ps(Z, rDetM);
+        W = _mm_mul_ps(W, rDetM);
+
+        _mm_storeu_ps(&result->data[0], BKK_SHUFFLE(X, Y, 3, 1, 3, 1));
+        _mm_storeu_ps(&result->data[4], BKK_SHUFFLE(X, Y, 2, 0, 2, 0));
+        _mm_storeu_ps(&result->data[8], BKK_SHUFFLE(Z, W, 3, 1, 3, 1));
+        _mm_storeu_ps(&result->data[12], BKK_SHUFFLE(Z, W, 2, 0, 2, 0));
+        return true;
+      }
+
+      #undef BKK_SWIZZLE
+      #undef BKK_SHUFFLE
+#endif //BKK_MATHS_SSE
+
     }//math
   } //core
 }//bkk
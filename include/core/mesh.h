@@ -59,7 +59,8 @@ namespace bkk
         const skeletal_animation_t* animation;
 
         maths::mat4* boneTransform;      //Final bones transforms for current time in the animation
-        render::gpu_buffer_t buffer;    //Uniform buffer with the final transformation of each bone
+        render::gpu_buffer_t* buffer;    //Storage buffers with the final transformation of each bone, one per frame in flight
+        u32 bufferCount;
       };
 
       struct mesh_t
@@ -125,7 +126,8 @@ namespace bkk
 
       //Animator
       void animatorCreate(const render::context_t& context, const mesh_t& mesh, u32 animationIndex, float speedFactor, skeletal_animator_t* animator);
-      void animatorUpdate(const render::context_t& context, f32 deltaTimeInMs, skeletal_animator_t* animator);
+      void animatorUpdate(const render::context_t& context, f32 deltaTimeInMs, skeletal_animator_t* animator);  //Writes the buffer of the current frame
+      const render::gpu_buffer_t& animatorGetBuffer(const render::context_t& context, const skeletal_animator_t& animator);  //Buffer of the current frame (see render::getFrameIndex)
       void animatorDestroy(const render::context_t& context, skeletal_animator_t* animator);
 
       mesh_t quad(const render::context_t& context, float size);
@@ -0,0 +1,65 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#ifndef OCCLUSION_RASTERIZER_H
+#define OCCLUSION_RASTERIZER_H
+
+#include "core/maths.h"
+#include <vector>
+
+namespace bkk
+{
+  namespace core
+  {
+    class thread_pool_t;
+
+    namespace culling
+    {
+      //Default size of the software depth buffer
+      static const uint32_t OCCLUSION_BUFFER_WIDTH = 256u;
+      static const uint32_t OCCLUSION_BUFFER_HEIGHT = 128u;
+
+      //Triangle mesh rendered into the software depth buffer. Occluders should be low poly versions of the visible meshes
+      //that fit inside them, otherwise they can hide objects that are visible
+      struct occluder_t
+      {
+        const maths::vec3* vertex;
+        uint32_t vertexCount;
+        const uint32_t* index;      //Three indices per triangle
+        uint32_t triangleCount;
+        maths::mat4 transform;      //Model to world transformation
+      };
+
+      //Scratch memory of the rasterizer. Reuse it to avoid allocations every frame
+      struct occlusion_rasterizer_t
+      {
+        struct triangle_t
+        {
+          f32 edge[3][3];   //Edge functions A*x + B*y + C, positive inside the triangle
+          f32 depth[3];     //Depth plane a*x + b*y + c
+          int32_t minX, maxX, minY, maxY;  //Pixels covered by the bounding box. Empty if minX > maxX
+        };
+
+        std::vector<maths::vec4> clipVertex;   //Vertices of all the occluders in clip space
+        std::vector<uint32_t> vertexOffset;    //First vertex of each occluder in clipVertex
+        std::vector<uint32_t> triangleOffset;  //First triangle of each occluder
+        std::vector<triangle_t> triangle;      //Two per triangle, as clipping against the near plane can produce two
+      };
+
+      //Renders the occluders into a width x height depth buffer (width has to be a multiple of 4). Depth is the normalized device
+      //coordinates z (bigger is further, 1.0 where nothing is rendered) at the furthest point of each pixel covered by the triangle,
+      //in the same convention used by depthPyramidBuild. Triangles are set up in parallel and then the buffer is split in horizontal
+      //bands rasterized in parallel (pool can be nullptr). The result does not depend on the number of threads
+      void rasterizeOccluders(const occluder_t* occluders, uint32_t occluderCount, const maths::mat4& viewProjection,
+                              uint32_t width, uint32_t height, thread_pool_t* pool, occlusion_rasterizer_t* rasterizer, f32* depth);
+
+    }//culling
+  }//core
+}//bkk
+
+#endif  //  OCCLUSION_RASTERIZER_H
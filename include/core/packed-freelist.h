@@ -13,55 +13,70 @@
 
 #include <assert.h>
 #include <vector>
+#include <utility>
+#include <tuple>
 
 namespace bkk
 {
   namespace core
   {
 
-    template <typename T> class packed_freelist_iterator_t;
+    template <typename T, typename HANDLE_TYPE> class packed_freelist_iterator_t;
 
-    template <typename T>
+    //Packed array of elements accessed through handles that stay valid when other elements are removed.
+    //HANDLE_TYPE must be a generic_handle_t and limits the number of elements to HANDLE_TYPE::MAX_INDEX
+    template <typename T, typename HANDLE_TYPE = bkk_handle_t>
     class packed_freelist_t
     {
     public:
+      typedef HANDLE_TYPE handle_t;
+
       packed_freelist_t() :headFreeList_(0u), elementCount_(0u) {}
 
-      bkk_handle_t add(const T& data)
+      //Preallocates memory for count elements
+      void reserve(uint32_t count)
       {
-        assert(elementCount_ < 65535u);
-
-        //1. Add the new data to the data_ vector
-        uint16_t size = (uint16_t)data_.size();
-        if (elementCount_ == size)
-        {
-          //Make room for one more data element
-          data_.resize(size + 1);
-          id_.resize(size + 1);
-        }
-        data_[elementCount_] = data;
-
-        //2. Allocate a new ID for the element
-        size_t freeListSize = freeList_.size();
-        if (headFreeList_ == freeListSize)
-        {
-          //Make room for one more id in the freelist
-          freeList_.resize(size + 1);
-          freeList_[size] = { uint16_t(size + 1u), 0u };
-        }
+        data_.reserve(count);
+        id_.reserve(count);
+        freeList_.reserve(count);
+      }
 
-        //Update the free list
-        uint16_t index = headFreeList_;
-        headFreeList_ = freeList_[headFreeList_].index;
-        freeList_[index].index = elementCount_;
+      handle_t add(const T& data)
+      {
+        handle_t id = allocateId();
+        data_.push_back(data);
+        id_.push_back(id);
+        ++elementCount_;
+        return id;
+      }
 
-        bkk_handle_t id = { index, freeList_[index].generation };
-        id_[elementCount_] = id;
+      handle_t add(T&& data)
+      {
+        handle_t id = allocateId();
+        data_.push_back(std::move(data));
+        id_.push_back(id);
         ++elementCount_;
         return id;
       }
 
-      T* get(bkk_handle_t id)
+      //Adds count elements. Handles of the new elements are written to ids (can be nullptr)
+      void addRange(const T* data, uint32_t count, handle_t* ids = nullptr)
+      {
+        //Capacity grows geometrically, so adding elements in small batches doesn't reallocate every time
+        uint32_t capacity = (uint32_t)data_.capacity();
+        uint32_t required = elementCount_ + count;
+        if (required > capacity)
+          reserve(required > 2u * capacity ? required : 2u * capacity);
+
+        for (uint32_t i(0); i < count; ++i)
+        {
+          handle_t id = add(data[i]);
+          if (ids)
+            ids[i] = id;
+        }
+      }
+
+      T* get(handle_t id)
       {
         uint32_t index;
         if (getIndexFromId(id, &index))
@@ -71,7 +86,7 @@ namespace bkk
         return nullptr;
       }
 
-      void swap(bkk_handle_t id0, bkk_handle_t id1)
+      void swap(handle_t id0, handle_t id1)
       {
         uint32_t index0;
         uint32_t index1;
@@ -80,30 +95,29 @@ namespace bkk
           freeList_[id0.index].index = index1;
           freeList_[id1.index].index = index0;
 
-          //Swap data
-          T dataTmp = data_[index0];
-          data_[index0] = data_[index1];
-          data_[index1] = dataTmp;
-
-          //Swap id
-          bkk_handle_t idTmp = id_[index0];
-          id_[index0] = id_[index1];
-          id_[index1] = idTmp;
+          std::swap(data_[index0], data_[index1]);
+          std::swap(id_[index0], id_[index1]);
         }
       }
 
-      bool remove(bkk_handle_t id)
+      bool remove(handle_t id)
       {
         uint32_t index;
         if (getIndexFromId(id, &index))
         {
-          //If the item to remove is not the last item, move the last item to the gap
+          //1. If the item to remove is not the last item, move the last item to the gap
           uint32_t lastItem = elementCount_ - 1;
           if (index < lastItem)
           {
-            swap(id_[lastItem], id_[index]);
+            handle_t lastId = id_[lastItem];
+            data_[index] = std::move(data_[lastItem]);
+            id_[index] = lastId;
+            freeList_[lastId.index].index = index;
           }
 
+          data_.pop_back();
+          id_.pop_back();
+
           //2. Update the free list
           freeList_[id.index].index = headFreeList_;
           freeList_[id.index].generation++;
@@ -116,12 +130,25 @@ namespace bkk
         return false;
       }
 
-      bkk_handle_t getIdFromIndex(uint32_t index) const
+      //Removes count elements. Returns the number of elements actually removed
+      uint32_t removeRange(const handle_t* ids, uint32_t count)
+      {
+        uint32_t removed = 0u;
+        for (uint32_t i(0); i < count; ++i)
+        {
+          if (remove(ids[i]))
+            ++removed;
+        }
+
+        return removed;
+      }
+
+      handle_t getIdFromIndex(uint32_t index) const
       {
         return id_[index];
       }
 
-      bool getIndexFromId(bkk_handle_t id, uint32_t* index) const
+      bool getIndexFromId(handle_t id, uint32_t* index) const
       {
         if (id.index < freeList_.size() && id.generation == freeList_[id.index].generation)
         {
@@ -143,47 +170,67 @@ namespace bkk
         return (uint32_t)data_.size();
       }
 
-      packed_freelist_iterator_t<T> begin()
+      packed_freelist_iterator_t<T, handle_t> begin()
       {
-        return packed_freelist_iterator_t<T>(this, 0);
+        return packed_freelist_iterator_t<T, handle_t>(this, 0);
       }
 
-      packed_freelist_iterator_t<T> end()
+      packed_freelist_iterator_t<T, handle_t> end()
       {
-        return packed_freelist_iterator_t<T>(this, getElementCount() );
+        return packed_freelist_iterator_t<T, handle_t>(this, getElementCount() );
       }
 
     private:
 
-      std::vector<bkk_handle_t> freeList_;  // Free list of IDs (vector with holes)
-      uint16_t headFreeList_;           // Head of the free list (fist free element in freeList_)
+      handle_t allocateId()
+      {
+        assert(elementCount_ < handle_t::MAX_INDEX);
+
+        if (headFreeList_ == freeList_.size())
+        {
+          //No free ids. Make room for one more id in the freelist
+          handle_t freeId = { headFreeList_ + 1u, 0u };
+          freeList_.push_back(freeId);
+        }
+
+        //Update the free list
+        uint32_t index = headFreeList_;
+        headFreeList_ = freeList_[index].index;
+        freeList_[index].index = elementCount_;
+
+        handle_t id = { index, freeList_[index].generation };
+        return id;
+      }
+
+      std::vector<handle_t> freeList_;  // Free list of IDs (vector with holes)
+      uint32_t headFreeList_;           // Head of the free list (fist free element in freeList_)
 
       std::vector<T> data_;             // Packed data
-      std::vector<bkk_handle_t> id_;        // Id of each packed element (Needed to go from index to ID)
-      uint16_t elementCount_;           // Number of packed elements
+      std::vector<handle_t> id_;        // Id of each packed element (Needed to go from index to ID)
+      uint32_t elementCount_;           // Number of packed elements
     };
 
-    template <typename T>
+    template <typename T, typename HANDLE_TYPE = bkk_handle_t>
     class packed_freelist_iterator_t
     {
     public:
       packed_freelist_iterator_t()
       :packedFreelist_(nullptr), index_(0){}
 
-      packed_freelist_iterator_t(packed_freelist_t<T>* list, uint32_t index)
+      packed_freelist_iterator_t(packed_freelist_t<T, HANDLE_TYPE>* list, uint32_t index)
       :packedFreelist_(list), index_(index){}
 
-      bool operator==(const packed_freelist_iterator_t<T>& it)
+      bool operator==(const packed_freelist_iterator_t<T, HANDLE_TYPE>& it)
       {
         return (packedFreelist_ == it.packedFreelist_ &&  index_ == it.index_);
       }
 
-      bool operator!=(const packed_freelist_iterator_t<T>& it)
+      bool operator!=(const packed_freelist_iterator_t<T, HANDLE_TYPE>& it)
       {
         return !(*this == it);
       }
 
-      packed_freelist_iterator_t<T>& operator++()
+      packed_freelist_iterator_t<T, HANDLE_TYPE>& operator++()
       {
         ++index_;
         return *this;
@@ -197,9 +244,164 @@ namespace bkk
       }
 
     private:
-      packed_freelist_t<T>* packedFreelist_;
+      packed_freelist_t<T, HANDLE_TYPE>* packedFreelist_;
       uint32_t index_;
     };
+
+    //Structure of arrays variant of packed_freelist_t. Each of the COLUMNS types is stored in its own packed array
+    //and all of them share the same handle space, so element i of every column belongs to the same entry.
+    //Loops that only need some of the columns don't pull the rest through the cache
+    template <typename HANDLE_TYPE, typename... COLUMNS>
+    class packed_freelist_soa_t
+    {
+    public:
+      typedef HANDLE_TYPE handle_t;
+
+      template <size_t COLUMN>
+      using column_t = typename std::tuple_element<COLUMN, std::tuple<COLUMNS...> >::type;
+
+      static const size_t COLUMN_COUNT = sizeof...(COLUMNS);
+
+      packed_freelist_soa_t() :headFreeList_(0u), elementCount_(0u) {}
+
+      //Preallocates memory for count elements
+      void reserve(uint32_t count)
+      {
+        reserveColumns(count, std::index_sequence_for<COLUMNS...>());
+        id_.reserve(count);
+        freeList_.reserve(count);
+      }
+
+      handle_t add(const COLUMNS&... values)
+      {
+        assert(elementCount_ < handle_t::MAX_INDEX);
+
+        if (headFreeList_ == freeList_.size())
+        {
+          //No free ids. Make room for one more id in the freelist
+          handle_t freeId = { headFreeList_ + 1u, 0u };
+          freeList_.push_back(freeId);
+        }
+
+        //Update the free list
+        uint32_t index = headFreeList_;
+        headFreeList_ = freeList_[index].index;
+        freeList_[index].index = elementCount_;
+
+        handle_t id = { index, freeList_[index].generation };
+        pushBack(std::index_sequence_for<COLUMNS...>(), values...);
+        id_.push_back(id);
+        ++elementCount_;
+        return id;
+      }
+
+      template <size_t COLUMN>
+      column_t<COLUMN>* get(handle_t id)
+      {
+        uint32_t index;
+        if (getIndexFromId(id, &index))
+        {
+          return &std::get<COLUMN>(column_)[index];
+        }
+        return nullptr;
+      }
+
+      bool remove(handle_t id)
+      {
+        uint32_t index;
+        if (getIndexFromId(id, &index))
+        {
+          //1. If the item to remove is not the last item, move the last item to the gap
+          uint32_t lastItem = elementCount_ - 1;
+          if (index < lastItem)
+          {
+            handle_t lastId = id_[lastItem];
+            moveElement(lastItem, index, std::index_sequence_for<COLUMNS...>());
+            id_[index] = lastId;
+            freeList_[lastId.index].index = index;
+          }
+
+          popBack(std::index_sequence_for<COLUMNS...>());
+          id_.pop_back();
+
+          //2. Update the free list
+          freeList_[id.index].index = headFreeList_;
+          freeList_[id.index].generation++;
+          headFreeList_ = id.index;
+
+          --elementCount_;
+          return true;
+        }
+
+        return false;
+      }
+
+      handle_t getIdFromIndex(uint32_t index) const
+      {
+        return id_[index];
+      }
+
+      bool getIndexFromId(handle_t id, uint32_t* index) const
+      {
+        if (id.index < freeList_.size() && id.generation == freeList_[id.index].generation)
+        {
+          *index = freeList_[id.index].index;
+          return true;
+        }
+
+        return false;
+      }
+
+      uint32_t getElementCount() const
+      {
+        return elementCount_;
+      }
+
+      //Packed array of a column. Returns the number of elements
+      template <size_t COLUMN>
+      uint32_t getData(column_t<COLUMN>** data)
+      {
+        *data = std::get<COLUMN>(column_).data();
+        return elementCount_;
+      }
+
+    private:
+
+      template <size_t... I>
+      void reserveColumns(uint32_t count, std::index_sequence<I...>)
+      {
+        int expand[] = { 0, (std::get<I>(column_).reserve(count), 0)... };
+        (void)expand;
+      }
+
+      template <size_t... I>
+      void pushBack(std::index_sequence<I...>, const COLUMNS&... values)
+      {
+        int expand[] = { 0, (std::get<I>(column_).push_back(values), 0)... };
+        (void)expand;
+      }
+
+      template <size_t... I>
+      void moveElement(uint32_t from, uint32_t to, std::index_sequence<I...>)
+      {
+        int expand[] = { 0, (std::get<I>(column_)[to] = std::move(std::get<I>(column_)[from]), 0)... };
+        (void)expand;
+      }
+
+      template <size_t... I>
+      void popBack(std::index_sequence<I...>)
+      {
+        int expand[] = { 0, (std::get<I>(column_).pop_back(), 0)... };
+        (void)expand;
+      }
+
+      std::vector<handle_t> freeList_;              // Free list of IDs (vector with holes)
+      uint32_t headFreeList_;                       // Head of the free list (fist free element in freeList_)
+
+      std::tuple<std::vector<COLUMNS>...> column_;  // Packed data, one array per column
+      std::vector<handle_t> id_;                    // Id of each packed element (Needed to go from index to ID)
+      uint32_t elementCount_;                       // Number of packed elements
+    };
   }//core
 }//bkk
 #endif // PACKED_FREELIST_H
\ No newline at end of file
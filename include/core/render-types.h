@@ -22,6 +22,9 @@ typedef struct _SECURITY_ATTRIBUTES SECURITY_ATTRIBUTES;
 
 #include <vulkan/vulkan_win32.h>
 #include "vector"
+#include <mutex>
+#include <atomic>
+#include "core/tlsf-allocator.h"
 
 namespace bkk
 {
@@ -36,18 +39,47 @@ namespace bkk
         HOST_VISIBLE_COHERENT = HOST_VISIBLE | HOST_COHERENT
       };
 
+      struct gpu_memory_allocator_t;
+
       struct gpu_memory_t
       {
         VkDeviceMemory handle;
         VkDeviceSize offset;
         VkDeviceSize size;
+        void* mapping;                     //Host address of the memory if it is host visible. Host visible memory stays mapped
+        uint32_t allocation;               //Range in the allocator block, or tlsf_allocator_t::INVALID_ALLOCATION for dedicated allocations
+        gpu_memory_allocator_t* allocator; //Allocator the memory came from, or nullptr if there was none
       };
 
+      //Allocates device memory in blocks (per memory type) and sub-allocates ranges of them. Allocations bigger than half
+      //a block get their own device memory (dedicated allocation)
       struct gpu_memory_allocator_t
       {
-        VkDeviceMemory memory;
-        VkDeviceSize size;
-        VkDeviceSize head;
+        struct block_t
+        {
+          VkDeviceMemory memory;
+          uint32_t memoryType;
+          void* mapping;              //Whole block is mapped if it is host visible
+          tlsf_allocator_t allocator;
+        };
+
+        VkDeviceSize blockSize;
+        uint32_t memoryTypes;         //Memory types the allocator can use
+        uint32_t flags;               //gpu_memory_type_e flags required in all the allocations
+        VkDeviceSize bufferImageGranularity;
+        uint32_t dedicatedAllocationCount;
+        std::vector<block_t> block;
+        std::mutex mutex;
+      };
+
+      struct gpu_memory_allocator_stats_t
+      {
+        uint32_t blockCount;
+        uint32_t allocationCount;             //Sub-allocations, not including dedicated allocations
+        uint32_t dedicatedAllocationCount;
+        VkDeviceSize blockMemory;             //Device memory allocated for blocks
+        VkDeviceSize usedMemory;              //Memory of the blocks used by sub-allocations
+        VkDeviceSize largestFreeRange;        //Biggest allocation that fits in the existing blocks
       };
 
       struct queue_t
@@ -85,11 +117,15 @@ namespace bkk
         VkCommandBuffer handle = VK_NULL_HANDLE;
         type_e type;
 
+        //Semaphore arrays are owned by the command buffer and freed by commandBufferDestroy. They only grow, so
+        //setting the semaphores of a command buffer reused every frame doesn't allocate
         uint32_t waitSemaphoreCount;
+        uint32_t waitSemaphoreCapacity;
         VkSemaphore* waitSemaphore;
         VkPipelineStageFlags* waitStages;
 
         uint32_t signalSemaphoreCount;
+        uint32_t signalSemaphoreCapacity;
         VkSemaphore* signalSemaphore;
         VkFence fence;
 
@@ -114,8 +150,14 @@ namespace bkk
 
         VkRenderPass renderPass;
 
-        VkSemaphore imageAcquired;
-        VkSemaphore renderingComplete;
+        //The CPU can record up to frameCount frames ahead of the GPU. Each frame in flight has its own semaphores
+        //and a fence signaled when all the work submitted to the graphics queue in the frame is done
+        uint32_t frameCount;
+        uint32_t currentFrame;
+        bool imageAcquired;                         //currentImage has already been acquired in the current frame
+        std::vector<VkSemaphore> imageAvailable;
+        std::vector<VkSemaphore> renderingComplete;
+        std::vector<VkFence> frameComplete;
       };
 
       struct context_t
@@ -130,6 +172,7 @@ namespace bkk
         surface_t surface;
         swapchain_t swapChain;
         VkDebugReportCallbackEXT debugCallback;
+        gpu_memory_allocator_t* memoryAllocator;  //Used when no allocator is given to gpuMemoryAllocate
 
         //Imported functions
         PFN_vkGetPhysicalDeviceSurfaceSupportKHR vkGetPhysicalDeviceSurfaceSupportKHR = nullptr;
@@ -205,6 +248,36 @@ namespace bkk
         VkDescriptorBufferInfo descriptor;
       };
 
+      //Host visible buffer split in one region per frame in flight. Updates are copied to the region of the current frame
+      //and then copied to their destination buffers by the GPU, so the CPU never writes memory the GPU may be reading
+      struct upload_ring_t
+      {
+        struct upload_t
+        {
+          VkBuffer buffer;
+          VkBufferCopy region;
+        };
+
+        struct range_t
+        {
+          VkDeviceSize begin;
+          VkDeviceSize end;
+        };
+
+        gpu_buffer_t buffer;
+        VkDeviceSize frameSize;
+        uint32_t frameCount;
+        uint32_t frame;                       //Region used in the current frame
+        std::atomic<VkDeviceSize> head;       //Offset of the next write in the region of the current frame
+        std::atomic<uint32_t> uploadCount;    //Uploads written in the current frame
+        uint32_t recordedCount;               //Uploads of the current frame already recorded in a command buffer
+        std::atomic<uint32_t> activeWrites;   //Writes that have taken a slot but are still filling it
+        std::vector<upload_t> upload;
+        std::vector<uint32_t> order;          //Scratch memory used when recording the copies
+        std::vector<range_t> written;
+        std::vector<VkBufferCopy> copy;
+      };
+
       struct descriptor_t
       {
         enum struct type_e
@@ -273,6 +346,7 @@ namespace bkk
         uint32_t descriptorSets;
         uint32_t combinedImageSamplers;
         uint32_t uniformBuffers;
+        uint32_t uniformBuffersDynamic;
         uint32_t storageBuffers;
         uint32_t storageImages;
       };
@@ -414,6 +488,7 @@ namespace bkk
 
       struct combined_image_sampler_count { combined_image_sampler_count(uint32_t count) :data(count) {} uint32_t data; };
       struct uniform_buffer_count { uniform_buffer_count(uint32_t count) :data(count) {} uint32_t data; };
+      struct uniform_buffer_dynamic_count { uniform_buffer_dynamic_count(uint32_t count) :data(count) {} uint32_t data; };
       struct storage_buffer_count { storage_buffer_count(uint32_t count) :data(count) {} uint32_t data; };
       struct storage_image_count { storage_image_count(uint32_t count) :data(count) {} uint32_t data; };
 
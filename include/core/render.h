@@ -28,6 +28,7 @@ namespace bkk
     {
       //Context
       void contextCreate(const char* applicationName, const char* engineName, const window::window_t& window, uint32_t swapChainImageCount, context_t* context);
+      void contextCreate(const char* applicationName, const char* engineName, const window::window_t& window, uint32_t swapChainImageCount, uint32_t framesInFlight, context_t* context);
       void contextDestroy(context_t* context);
       void contextFlush(const context_t& context);
       void swapchainResize(context_t* context, uint32_t width, uint32_t height);
@@ -37,6 +38,14 @@ namespace bkk
       uint32_t getPresentationCommandBuffer(context_t& context, command_buffer_t** commandBuffer);
       void endPresentationCommandBuffer(const context_t& context, uint32_t index);
 
+      //Acquires the swapchain image of the current frame, if presentFrame hasn't done it yet. Returns its index
+      uint32_t acquireNextImage(context_t* context);
+
+      //Index in [0, getFrameCount) of the frame being recorded. Resources written by the CPU every frame need one copy per frame
+      uint32_t getFrameIndex(const context_t& context);
+      uint32_t getFrameCount(const context_t& context);
+
+      //Submits and presents the current frame, then waits until the GPU is done with the frame that used the same frame index
       void presentFrame(context_t* context, VkSemaphore* waitSemaphore = nullptr, uint32_t waitSemaphoreCount = 0u);
 
       //Shaders
@@ -45,15 +54,21 @@ namespace bkk
       bool shaderCreateFromGLSLSource(const context_t& context, shader_t::type_e type, const char* glslSource, shader_t* shader);
       void shaderDestroy(const context_t& context, shader_t* shader);
 
-      //GPU memory
+      //GPU memory. Memory is sub-allocated from the blocks of allocator, or from the allocator of the context if allocator is nullptr.
+      //Memory is always returned to the allocator it came from. If an allocator is given to gpuMemoryDeallocate it has to be that one
       gpu_memory_t gpuMemoryAllocate(const context_t& context, VkDeviceSize size, VkDeviceSize alignment, uint32_t memoryTypes, uint32_t flags, gpu_memory_allocator_t* allocator = nullptr);
       void gpuMemoryDeallocate(const context_t& context, gpu_memory_allocator_t* allocator, gpu_memory_t memory);
       void* gpuMemoryMap(const context_t& context, gpu_memory_t memory);
       void* gpuMemoryMap(const context_t& context, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, gpu_memory_t memory);
       void gpuMemoryUnmap(const context_t& context, gpu_memory_t memory);
-      void gpuAllocatorCreate(const context_t& context, size_t size, uint32_t memoryTypes, uint32_t flags, gpu_memory_allocator_t* allocator);
+      void gpuAllocatorCreate(const context_t& context, size_t blockSize, uint32_t memoryTypes, uint32_t flags, gpu_memory_allocator_t* allocator);
       void gpuAllocatorDestroy(const context_t& context, gpu_memory_allocator_t* allocator);
 
+      //Defragmentation hooks. Stats tell how fragmented the blocks are (largestFreeRange vs free memory), so the application
+      //can recreate its resources to compact them. Blocks without allocations can then be released
+      void gpuAllocatorGetStats(gpu_memory_allocator_t* allocator, gpu_memory_allocator_stats_t* stats);
+      void gpuAllocatorReleaseEmptyBlocks(const context_t& context, gpu_memory_allocator_t* allocator);
+
       //Textures
       void texture2DCreate(const context_t& context, const image::image2D_t* images, uint32_t mipLevels, texture_sampler_t sampler, texture_t* texture);
       void texture2DCreateAndGenerateMipmaps(const context_t& context, const image::image2D_t& image, texture_sampler_t sampler, texture_t* texture);
@@ -80,22 +95,42 @@ namespace bkk
       void gpuBufferCreate(const context_t& context, gpu_buffer_t::usage_e usage, uint32_t memoryType, void* data, size_t size, gpu_memory_allocator_t* allocator, gpu_buffer_t* buffer);
       void gpuBufferCreate(const context_t& context, gpu_buffer_t::usage_e usage, void* data, size_t size, gpu_memory_allocator_t* allocator, gpu_buffer_t* buffer);
       void gpuBufferDestroy(const context_t& context, gpu_memory_allocator_t* allocator, gpu_buffer_t* buffer);
+      //Writes the memory of the buffer directly. With more than one frame in flight the GPU may still be reading it from previous
+      //frames, so it is only safe on buffers written once per frame index (see getFrameIndex) or not used by frames in flight.
+      //Use an upload ring (or renderer_t::uploadBufferData) otherwise
       void gpuBufferUpdate(const context_t& context, void* data, size_t offset, size_t size, gpu_buffer_t* buffer);
       void* gpuBufferMap(const context_t& context, const gpu_buffer_t& buffer);
       void gpuBufferUnmap(const context_t& context, const gpu_buffer_t& buffer);
 
+      //Upload ring. Writes are thread safe. Destination buffers need TRANSFER_DST usage. The application has to make sure the GPU
+      //has executed the copies recorded in a frame before the ring gets back to its region (frameCount frames later)
+      void uploadRingCreate(const context_t& context, size_t frameSize, uint32_t frameCount, uint32_t maxUploadCount, upload_ring_t* ring);
+      void uploadRingDestroy(const context_t& context, upload_ring_t* ring);
+      bool uploadRingWrite(upload_ring_t* ring, const void* data, size_t offset, size_t size, const gpu_buffer_t& buffer); //False if the ring is full
+      bool uploadRingHasPendingCopies(const upload_ring_t& ring);
+      void uploadRingRecordCopies(const command_buffer_t& commandBuffer, upload_ring_t* ring);  //Records the copies written since the last call. Later writes to a range win
+      void uploadRingDiscardCopies(upload_ring_t* ring, const gpu_buffer_t& buffer);  //Drops the copies to buffer not recorded yet. Not thread safe with writes
+      void uploadRingNextFrame(upload_ring_t* ring);
+
       //Descriptors
       void descriptorPoolCreate(const context_t& context, uint32_t descriptorSetsCount,
         combined_image_sampler_count combinedImageSamplers, uniform_buffer_count uniformBuffers,
         storage_buffer_count storageBuffers, storage_image_count storageImages,
         descriptor_pool_t* descriptorPool);
 
+      void descriptorPoolCreate(const context_t& context, uint32_t descriptorSetsCount,
+        combined_image_sampler_count combinedImageSamplers, uniform_buffer_count uniformBuffers,
+        uniform_buffer_dynamic_count uniformBuffersDynamic, storage_buffer_count storageBuffers,
+        storage_image_count storageImages, descriptor_pool_t* descriptorPool);
+
       void descriptorPoolDestroy(const context_t& context, descriptor_pool_t* descriptorPool);
 
       void descriptorSetCreate(const context_t& context, const descriptor_pool_t& descriptorPool, const descriptor_set_layout_t& descriptorSetLayout, descriptor_t* descriptors, descriptor_set_t* descriptorSet);
       void descriptorSetDestroy(const context_t& context, descriptor_set_t* descriptorSet);
       void descriptorSetUpdate(const context_t& context, const descriptor_set_layout_t& descriptorSetLayout, descriptor_set_t* descriptorSet);
       void descriptorSetBind(command_buffer_t commandBuffer, const pipeline_layout_t& pipelineLayout, uint32_t firstSet, descriptor_set_t* descriptorSets, uint32_t descriptorSetCount);
+      void descriptorSetBind(command_buffer_t commandBuffer, const pipeline_layout_t& pipelineLayout, uint32_t firstSet, descriptor_set_t* descriptorSets, uint32_t descriptorSetCount,
+                             const uint32_t* dynamicOffsets, uint32_t dynamicOffsetCount);  //One offset per dynamic buffer in the sets, in binding order
       void descriptorSetLayoutCreate(const context_t& context, descriptor_binding_t* bindings, uint32_t bindingCount, descriptor_set_layout_t* desriptorSetLayout);
       void descriptorSetLayoutDestroy(const context_t& context, descriptor_set_layout_t* desriptorSetLayout);
 
@@ -137,11 +172,18 @@ namespace bkk
       VkCommandPool commandPoolCreate(const context_t& context);
       void commandPoolDestroy(const context_t& context, VkCommandPool commandPool);
 
+      //Resets all the command buffers allocated from the pool. None of them can be pending execution
+      void commandPoolReset(const context_t& context, VkCommandPool commandPool);
+
       void commandBufferCreate(const context_t& context, VkCommandBufferLevel level,
         VkSemaphore* waitSemaphore, VkPipelineStageFlags* waitStages, uint32_t waitSemaphoreCount,
         VkSemaphore* signalSemaphore, uint32_t signalSemaphoreCount, command_buffer_t::type_e type,
         VkCommandPool commandPool, command_buffer_t* commandBuffer);
 
+      //Replaces the semaphores the command buffer waits on and signals when submitted. Arrays are reallocated only if they are too small
+      void commandBufferSetSemaphores(VkSemaphore* waitSemaphore, VkPipelineStageFlags* waitStages, uint32_t waitSemaphoreCount,
+        VkSemaphore* signalSemaphore, uint32_t signalSemaphoreCount, command_buffer_t* commandBuffer);
+
       void commandBufferDestroy(const context_t& context, command_buffer_t* commandBuffer);
       void commandBufferBegin(const context_t& context, const command_buffer_t& commandBuffer);
       void commandBufferRenderPassBegin(const context_t& context, const frame_buffer_t* frameBuffer, VkClearValue* clearValues, uint32_t clearValuesCount, const command_buffer_t& commandBuffer);
@@ -175,6 +217,11 @@ namespace bkk
       void depthStencilBufferCreate(const context_t& context, uint32_t width, uint32_t height, depth_stencil_buffer_t* depthStencilBuffer);
       void depthStencilBufferDestroy(const context_t& context, depth_stencil_buffer_t* depthStencilBuffer);
 
+      //Copies the depth of the buffer to a gpu buffer with TRANSFER_DST usage. The depth buffer is left in its current layout.
+      //Texels are 2 bytes for 16 bit formats and 4 bytes otherwise (the 8 high bits are undefined for VK_FORMAT_D24_UNORM_S8_UINT)
+      void depthStencilBufferCopyDepth(const command_buffer_t& commandBuffer, const depth_stencil_buffer_t& depthStencilBuffer, uint32_t width, uint32_t height, gpu_buffer_t* buffer);
+      uint32_t depthStencilBufferDepthSize(const depth_stencil_buffer_t& depthStencilBuffer);  //Size in bytes of a texel of the copy
+
       //Utility functions    
       void diffuseConvolution(const context_t& context, texture_t environmentMap, uint32_t size, texture_t* irradiance);
       void specularConvolution(const context_t& context, texture_t environmentMap, uint32_t size, uint32_t maxMipmapLevels, texture_t* specularMap);
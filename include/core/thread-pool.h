@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -12,7 +13,9 @@ namespace bkk
   {
     class thread_pool_t
     {
-    public:     
+    public:
+
+      class task_group_t;
 
       class task_t
       {
@@ -22,57 +25,249 @@ namespace bkk
 
         bool hasDependenciesRemaining();
         void dependsOn(task_t* task);
-        
+
+        //Restores the dependencies consumed by the last execution so the task can be added again
+        void resetDependencies();
+
+        //Forgets the tasks this task depends on and the tasks depending on it.
+        //Tasks on the other side of the dependencies have to be cleared as well
+        void clearDependencies();
+
         bool hasCompleted() { return hasCompleted_; }
-        
+
         virtual void begin(); //Called by the threadPool when task is added to the pool
         virtual void end();   //Called by the threadPool when task has finished executing
         virtual void run() = 0;
 
       private:
+        friend class thread_pool_t;
 
         bool addDependency(task_t* dependentTask);
-        void clearOneDependency();
+        bool clearOneDependency();  //Returns true if it was the last dependency remaining
+        bool acquireScheduling();   //Returns true only for the first caller after the task has been added to the pool
 
-        std::vector<task_t*> dependentTask_;  //Tasks that depends on this task        
+        std::vector<task_t*> dependentTask_;  //Tasks that depends on this task
         std::atomic<int>     dependenciesRemaining_;  //Number of task that need to finish for this task to be ready
+        int                  dependencyCount_; //Number of tasks this task depends on
         bool                 hasCompleted_; //Task has executed
+
+        thread_pool_t*       pool_;       //Pool the task has been added to
+        task_group_t*        group_;      //Group the task belongs to (can be nullptr)
+        std::atomic<bool>    submitted_;  //Task has been added to the pool
+        std::atomic<bool>    scheduled_;  //Task has been pushed to a ready queue
+      };
+
+      //Counter of pending tasks a caller can wait on
+      class task_group_t
+      {
+      public:
+        task_group_t();
+
+        bool hasCompleted() { return pendingTasks_ == 0; }
+
+      private:
+        friend class thread_pool_t;
+
+        std::atomic<int> pendingTasks_;  //Number of tasks in the group that have not finished yet
       };
 
       thread_pool_t(unsigned int numThreads);
       ~thread_pool_t();
 
-      void addTask(task_t* task);
+      void addTask(task_t* task, task_group_t* group = nullptr);
       void exit();
+
+      //Block until tasks finish. Calling thread runs pending tasks while waiting
       void waitForCompletion();
+      void waitForCompletion(task_group_t* group);
+
       uint32_t getThreadCount() { return (uint32_t)workerThread_.size(); }
 
+      //Index of the calling thread in the pool. Threads not owned by the pool get getThreadCount()
+      uint32_t getThreadIndex();
+
     private:
 
+      //Fixed size lock-free work-stealing deque (Chase-Lev).
+      //Only the owner thread can push and pop from the bottom, other threads steal from the top
+      class task_deque_t
+      {
+      public:
+        task_deque_t();
+
+        bool push(task_t* task);
+        task_t* pop();
+        task_t* steal();
+
+      private:
+        static const int64_t CAPACITY = 4096;
+
+        std::atomic<int64_t> top_;
+        std::atomic<int64_t> bottom_;
+        std::atomic<task_t*> task_[CAPACITY];
+      };
+
       struct worker_thread_t
       {
-        worker_thread_t(thread_pool_t* pool);
+        worker_thread_t(thread_pool_t* pool, uint32_t index);
         ~worker_thread_t();
 
         static void* run(void* data);
 
         thread_pool_t* pool_;    //Pointer to thread pool
+        uint32_t       index_;   //Index of the worker in the pool
+        task_deque_t   queue_;   //Tasks ready to run owned by this worker
         std::thread    thread_;  //Thread
-        bool           exit_;
+        std::atomic<bool> exit_;
       };
 
-      task_t* getNextTask();
-      void endTask(task_t* task);
+      task_t* getNextTask(worker_thread_t* worker);
+      task_t* findTask(worker_thread_t* worker);
+      void scheduleTask(task_t* task);
+      void runTask(task_t* task);
+      void wait(std::atomic<int>* pendingTasks);
 
       std::vector<worker_thread_t*>  workerThread_;  //worker threads
-      std::vector<task_t*>           taskReady_;     //list of tasks ready to run
-      std::vector<task_t*>           taskNotReady_;  //list of tasks not ready to run (depends on another task that has not been executed yet)
+      std::deque<task_t*>            taskReady_;     //tasks ready to run added from outside the pool or that didn't fit in a worker queue
+      std::mutex                     taskReadyMutex_;
       std::mutex                     mutex_;
       std::condition_variable        conditionVar_;
+      std::atomic<int>               readyTasks_;      //Number of tasks waiting in any of the ready queues
+      std::atomic<int>               sleepingWorkers_; //Number of threads waiting for tasks or tasks completion
       std::atomic<int>               pendingTasks_;
       std::atomic<bool>              exit_;
+
+      static thread_local worker_thread_t* currentWorker_;
     };
 
     uint32_t getCPUCoreCount();
+
+
+    //Range of elements shared by all the tasks of a parallelFor/parallelReduce. Chunks are handed out
+    //on demand and get smaller as the range is consumed (but never below grainSize), so threads
+    //that get cheaper elements just take more chunks
+    class parallel_range_t
+    {
+    public:
+      parallel_range_t(uint32_t begin, uint32_t end, uint32_t grainSize, uint32_t threadCount);
+      bool nextChunk(uint32_t* chunkBegin, uint32_t* chunkEnd);
+
+    private:
+      std::atomic<uint32_t> next_;
+      uint32_t end_;
+      uint32_t grainSize_;
+      uint32_t threadCount_;
+    };
+
+    static const uint32_t PARALLEL_MAX_TASKS = 64u;
+    uint32_t parallelTaskCount(thread_pool_t* pool, uint32_t begin, uint32_t end, uint32_t grainSize);
+
+    template <typename BODY>
+    class parallel_for_task_t : public thread_pool_t::task_t
+    {
+    public:
+      void init(parallel_range_t* range, const BODY* body)
+      {
+        range_ = range;
+        body_ = body;
+      }
+
+      void run()
+      {
+        uint32_t chunkBegin, chunkEnd;
+        while (range_->nextChunk(&chunkBegin, &chunkEnd))
+          (*body_)(chunkBegin, chunkEnd);
+      }
+
+    private:
+      parallel_range_t* range_;
+      const BODY* body_;
+    };
+
+    template <typename T, typename MAP, typename REDUCE>
+    class parallel_reduce_task_t : public thread_pool_t::task_t
+    {
+    public:
+      void init(parallel_range_t* range, const T& identity, const MAP* map, const REDUCE* reduce)
+      {
+        range_ = range;
+        result_ = identity;
+        map_ = map;
+        reduce_ = reduce;
+      }
+
+      void run()
+      {
+        uint32_t chunkBegin, chunkEnd;
+        while (range_->nextChunk(&chunkBegin, &chunkEnd))
+          result_ = (*reduce_)(result_, (*map_)(chunkBegin, chunkEnd));
+      }
+
+      const T& getResult() const { return result_; }
+
+    private:
+      parallel_range_t* range_;
+      T result_;
+      const MAP* map_;
+      const REDUCE* reduce_;
+    };
+
+    //Calls body(chunkBegin, chunkEnd) for chunks of [begin, end) in parallel. The calling thread
+    //takes part in the work and the function returns when the whole range has been processed
+    template <typename BODY>
+    void parallelFor(thread_pool_t* pool, uint32_t begin, uint32_t end, uint32_t grainSize, const BODY& body)
+    {
+      if (begin >= end)
+        return;
+
+      uint32_t taskCount = parallelTaskCount(pool, begin, end, grainSize);
+      parallel_range_t range(begin, end, grainSize, taskCount + 1);
+
+      thread_pool_t::task_group_t group;
+      parallel_for_task_t<BODY> task[PARALLEL_MAX_TASKS];
+      for (uint32_t i(0); i < taskCount; ++i)
+      {
+        task[i].init(&range, &body);
+        pool->addTask(&task[i], &group);
+      }
+
+      uint32_t chunkBegin, chunkEnd;
+      while (range.nextChunk(&chunkBegin, &chunkEnd))
+        body(chunkBegin, chunkEnd);
+
+      pool->waitForCompletion(&group);
+    }
+
+    //Computes map(chunkBegin, chunkEnd) for chunks of [begin, end) in parallel and combines
+    //the partial results with reduce(a, b), which must be associative
+    template <typename T, typename MAP, typename REDUCE>
+    T parallelReduce(thread_pool_t* pool, uint32_t begin, uint32_t end, uint32_t grainSize, const T& identity, const MAP& map, const REDUCE& reduce)
+    {
+      if (begin >= end)
+        return identity;
+
+      uint32_t taskCount = parallelTaskCount(pool, begin, end, grainSize);
+      parallel_range_t range(begin, end, grainSize, taskCount + 1);
+
+      thread_pool_t::task_group_t group;
+      parallel_reduce_task_t<T, MAP, REDUCE> task[PARALLEL_MAX_TASKS];
+      for (uint32_t i(0); i < taskCount; ++i)
+      {
+        task[i].init(&range, identity, &map, &reduce);
+        pool->addTask(&task[i], &group);
+      }
+
+      T result = identity;
+      uint32_t chunkBegin, chunkEnd;
+      while (range.nextChunk(&chunkBegin, &chunkEnd))
+        result = reduce(result, map(chunkBegin, chunkEnd));
+
+      pool->waitForCompletion(&group);
+
+      for (uint32_t i(0); i < taskCount; ++i)
+        result = reduce(result, task[i].getResult());
+
+      return result;
+    }
   }
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#ifndef TLSF_ALLOCATOR_H
+#define TLSF_ALLOCATOR_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace bkk
+{
+  namespace core
+  {
+    //Two-level segregated fit allocator of ranges in [0, size). It only manages offsets, so it can be used to sub-allocate
+    //memory it can't access (e.g GPU memory). Free ranges are kept in lists by size class, found with two bitmaps, and
+    //merged with their free neighbours when released, so allocations and deallocations are O(1)
+    class tlsf_allocator_t
+    {
+    public:
+      static const uint32_t INVALID_ALLOCATION = 0xFFFFFFFFu;
+
+      tlsf_allocator_t();
+
+      void init(uint64_t size);
+
+      //Returns INVALID_ALLOCATION if there is no free range big enough. Alignment has to be a power of two
+      uint32_t allocate(uint64_t size, uint64_t alignment, uint64_t* offset);
+      void deallocate(uint32_t allocation);
+
+      uint64_t getSize() const { return size_; }
+      uint64_t getUsedSize() const { return usedSize_; }
+      uint32_t getAllocationCount() const { return allocationCount_; }
+      uint64_t getLargestFreeRange() const;
+      bool isEmpty() const { return allocationCount_ == 0u; }
+
+    private:
+
+      //Sizes in [2^i, 2^(i+1)) are split in SECOND_LEVEL_COUNT lists. Sizes under SECOND_LEVEL_COUNT go to first level 0
+      static const uint32_t SECOND_LEVEL_LOG2 = 3u;
+      static const uint32_t SECOND_LEVEL_COUNT = 1u << SECOND_LEVEL_LOG2;
+      static const uint32_t FIRST_LEVEL_COUNT = 64u - SECOND_LEVEL_LOG2 + 1u;
+
+      struct range_t
+      {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t prevPhysical;  //Ranges before and after in [0, size)
+        uint32_t nextPhysical;
+        uint32_t prevFree;      //Free list of the size class. nextFree is the next unused range if the range is not used
+        uint32_t nextFree;
+        bool free;
+      };
+
+      static void mapping(uint64_t size, uint32_t* firstLevel, uint32_t* secondLevel);
+      uint32_t findFreeRange(uint64_t size) const;
+      void insertFreeRange(uint32_t range);
+      void removeFreeRange(uint32_t range);
+      uint32_t splitRange(uint32_t range, uint64_t size);
+      uint32_t newRange();
+      void releaseRange(uint32_t range);
+
+      std::vector<range_t> range_;
+      uint32_t unusedRange_;
+      uint64_t firstLevelBitmap_;
+      uint32_t secondLevelBitmap_[FIRST_LEVEL_COUNT];
+      uint32_t freeList_[FIRST_LEVEL_COUNT][SECOND_LEVEL_COUNT];
+
+      uint64_t size_;
+      uint64_t usedSize_;
+      uint32_t allocationCount_;
+    };
+
+  }//core
+}//bkk
+
+#endif  //  TLSF_ALLOCATOR_H
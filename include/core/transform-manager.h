@@ -11,8 +11,10 @@
 
 #include "core/maths.h"
 #include "core/packed-freelist.h"
+#include "core/thread-pool.h"
 
 #include <vector>
+#include <mutex>
 
 namespace bkk
 {
@@ -21,27 +23,78 @@ namespace bkk
     class transform_manager_t
     {
     public:
+      transform_manager_t();
+
       bkk_handle_t createTransform(const maths::mat4& transform);
       bool destroyTransform(bkk_handle_t id);
 
+      //Changes made through the returned pointer are not tracked. Use setTransform to modify it.
+      //For transforms set from position, rotation and scale the matrix is composed in update()
       maths::mat4* getTransform(bkk_handle_t id);
       bool setTransform(bkk_handle_t id, const maths::mat4& transform);
 
+      //Sets the local transform as position, rotation and scale. The local matrix is composed lazily in update().
+      //setPosition, setRotation and setScale only work on transforms set this way
+      bool setTransform(bkk_handle_t id, const maths::vec3& position, const maths::vec3& scale, const maths::quat& rotation);
+      bool setPosition(bkk_handle_t id, const maths::vec3& position);
+      bool setRotation(bkk_handle_t id, const maths::quat& rotation);
+      bool setScale(bkk_handle_t id, const maths::vec3& scale);
+
       bool setParent(bkk_handle_t id, bkk_handle_t parentId);
       bkk_handle_t getParent(bkk_handle_t id);
 
       maths::mat4* getWorldMatrix(bkk_handle_t id);
+      bkk_handle_t getIdFromIndex(uint32_t index) { return transform_.getIdFromIndex(index); }
 
-      void update();
+      //Computes world matrices of the transforms that have been modified since last update and their descendants.
+      //Only the subtrees of modified transforms are visited, unless the hierarchy has changed. If a thread pool
+      //is given, the subtrees (or the levels of the hierarchy after a change) are updated in parallel.
+      //Returns the indices of the transforms whose world matrix has changed (use getIdFromIndex to get their ids)
+      const std::vector<uint32_t>& update(thread_pool_t* threadPool = nullptr);
 
     private:
 
-      //Sorts transform by hierarchy level
+      static const uint32_t INVALID_INDEX = 0xFFFFFFFFu;
+
+      //Local transform set as position, rotation and scale
+      struct local_trs_t
+      {
+        maths::vec3 position;
+        maths::quat rotation;
+        maths::vec3 scale;
+        uint32_t transform;     //Index of the transform
+        uint32_t modified;      //The local matrix needs to be composed
+      };
+
+      //Sorts transform by hierarchy level, keeping the children of each transform together
       void sortTransforms();
+      void updateWorldMatrices(uint32_t begin, uint32_t end);
+      void updateSubtree(uint32_t root, std::vector<uint32_t>* stack, std::vector<uint32_t>* changed);
+      void setDirty(uint32_t index);
+      local_trs_t* getTRS(bkk_handle_t id, uint32_t* index);
+      void removeTRS(uint32_t index);
+      void setTRSModified(uint32_t index);
+      void composeLocalMatrices(uint32_t begin, uint32_t end);
 
       packed_freelist_t<maths::mat4> transform_;
       std::vector<bkk_handle_t> parent_;
+      std::vector<uint32_t> parentIndex_;   //Index of the parent transform, or INVALID_INDEX. Computed in sortTransforms
       std::vector<maths::mat4> world_;
+      std::vector<uint32_t> levelStart_;    //Transforms in level i of the hierarchy are in [levelStart_[i], levelStart_[i+1])
+      std::vector<uint32_t> childStart_;    //Children of transform i are in [childStart_[i], childStart_[i+1]). Computed in sortTransforms
+
+      std::vector<uint8_t> dirty_;          //Local transform modified since last update
+      std::vector<uint32_t> dirtyIndex_;    //Indices of the transforms with dirty_ set
+      std::vector<uint32_t> dirtyRoot_;     //Dirty transforms without dirty ancestors
+      std::vector<uint32_t> changedIndex_;  //Transforms whose world matrix was recomputed in last update
+      std::vector<uint32_t> updateStack_;
+      std::mutex changedMutex_;
+
+      //Transforms set with the TRS setters keep position, rotation and scale in trs_. Most transforms are set as matrices
+      //and only pay for the index
+      std::vector<uint32_t> localTRS_;      //Index in trs_ of each transform, or INVALID_INDEX
+      std::vector<local_trs_t> trs_;
+      std::vector<uint32_t> composeIndex_;  //Transforms with modified TRS since last update
 
       bool hierarchy_changed_;
     };
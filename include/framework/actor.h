@@ -10,7 +10,7 @@
 #define ACTOR_H
 
 #include "core/handle.h"
-#include "core/render.h"
+#include <string>
 
 namespace bkk
 { 
@@ -21,35 +21,17 @@ namespace bkk
     typedef core::bkk_handle_t material_handle_t;
     typedef core::bkk_handle_t actor_handle_t;
 
-    class renderer_t;
-
+    //Data of an actor not needed to render it. Mesh, transform, material and instance count are kept by the
+    //renderer in their own arrays (see renderer_t::getAllActorMeshes...) so rendering doesn't touch the names
     class actor_t
     {   
     public:
       actor_t();
+      actor_t(const char* name);
 
-      actor_t(const char* name, 
-              mesh_handle_t mesh, transform_handle_t transform, material_handle_t material,
-              uint32_t instanceCount, renderer_t* renderer);
-      
-      void destroy(renderer_t* renderer);
-
-      mesh_handle_t getMeshHandle() { return mesh_; }
-      transform_handle_t getTransformHandle() { return transform_; }
-      material_handle_t getMaterialHandle() { return material_; }
       const char* getName() { return name_.c_str();  }
-      core::render::gpu_buffer_t getUniformBuffer() { return uniformBuffer_; }
-      core::render::descriptor_set_t getDescriptorSet() { return descriptorSet_; }
-      uint32_t getInstanceCount() { return instanceCount_; }
     private:
       std::string name_;
-      mesh_handle_t mesh_;
-      transform_handle_t transform_;
-      material_handle_t material_;
-      uint32_t instanceCount_;
-
-      core::render::gpu_buffer_t uniformBuffer_;
-      core::render::descriptor_set_t descriptorSet_;
     };
 
   }//framework
@@ -22,7 +22,7 @@ namespace bkk
     class application_t
     {
       public:
-        application_t(const char* title, u32 width, u32 height, u32 imageCount);
+        application_t(const char* title, u32 width, u32 height, u32 imageCount, u32 framesInFlight = 2u);
         ~application_t();
 
         void run();        
@@ -12,6 +12,9 @@
 #include "core/maths.h"
 #include "core/render.h"
 #include "core/handle.h"
+#include "core/culling.h"
+#include "core/occlusion-rasterizer.h"
+#include "framework/frame-buffer.h"
 
 namespace bkk
 {
@@ -30,14 +33,49 @@ namespace bkk
         ORTHOGRAPHIC_PROJECTION = 1
       };
 
+      enum occlusion_culling_e
+      {
+        OCCLUSION_CULLING_NONE = 0,
+        OCCLUSION_CULLING_GPU_DEPTH = 1,  //Depth rendered by the GPU frames in flight ago
+        OCCLUSION_CULLING_SOFTWARE = 2    //Occluders of the renderer rasterized on the CPU (see renderer_t::actorSetOccluder)
+      };
+
       camera_t();
       camera_t(projection_mode_e projectionMode, float fov, float aspect, float nearPlane, float farPlane);
 
       void update(renderer_t* renderer);
-      void cull(renderer_t* renderer, actor_t* actors, uint32_t actorCount);
+      void cull(renderer_t* renderer);
       void destroy(renderer_t* renderer);
 
-      uint32_t getVisibleActors(actor_t** actors);
+      //World space frustum planes (left, right, bottom, top, near, far)
+      void getFrustumPlanes(core::maths::vec4* frustumPlanes);
+
+      //Sets the result of culling the camera. actorIndex are indices in renderer_t::getAllActors, sorted.
+      //Takes ownership of the contents of actorIndex, which gets the previous list so its memory can be reused
+      void setVisibleActors(renderer_t* renderer, std::vector<uint32_t>* actorIndex);
+
+      //Occlusion culling. With OCCLUSION_CULLING_GPU_DEPTH actors are also tested against the depth the camera rendered to the depth
+      //buffer of frameBuffer (BKK_NULL_HANDLE for the back buffer). The renderer copies the depth in presentFrame and reads it once the
+      //GPU is done with that frame, so the depth pyramid is as many frames old as there are frames in flight.
+      //With OCCLUSION_CULLING_SOFTWARE they are tested against the occluders rasterized with the current matrices when the camera is culled
+      void setOcclusionCulling(occlusion_culling_e mode, frame_buffer_handle_t frameBuffer = core::BKK_NULL_HANDLE);
+      occlusion_culling_e getOcclusionCulling() const { return occlusionCulling_; }
+      const core::culling::depth_pyramid_t& getDepthPyramid() const { return depthPyramid_; }
+
+      //Records the copy of the depth buffer for occlusion culling to the readback buffer of frame. updateDepthPyramid builds
+      //the depth pyramid from it when the GPU is done with frame, using the matrices the camera had when it was recorded
+      bool recordDepthReadback(renderer_t* renderer, uint32_t frame, const core::render::command_buffer_t& commandBuffer);
+      void updateDepthPyramid(renderer_t* renderer, uint32_t frame);
+
+      //Rasterizes the occluders and builds the depth pyramid from them if the camera uses software occlusion culling
+      void rasterizeOccluders(renderer_t* renderer);
+
+      //Indices in renderer_t::getAllActors of the actors visible from the camera, sorted. Valid until the actors change
+      uint32_t getVisibleActors(const uint32_t** actorIndex);
+      bool isCulled() { return culled_; }  //False after the camera or the actors of the renderer change, until it is culled again
+
+      //Forces the camera to be culled again. Called when the actors, their bounds or the occluders change
+      void invalidateVisibility() { culled_ = false; }
       core::render::gpu_buffer_t getUniformBuffer() { return uniformBuffer_; }
       core::render::descriptor_set_t getDescriptorSet() { return descriptorSet_; }
 
@@ -71,8 +109,26 @@ namespace bkk
       float nearPlane_;
       float farPlane_;
       
-      uint32_t visibleActorsCount_ = 0u;
-      std::vector<actor_t> visibleActors_;
+      std::vector<uint32_t> visibleIndex_;
+      bool culled_ = false;  //Visible actors are up to date with the camera matrices
+
+      occlusion_culling_e occlusionCulling_ = OCCLUSION_CULLING_NONE;
+      frame_buffer_handle_t occlusionFrameBuffer_ = core::BKK_NULL_HANDLE;
+      core::culling::depth_pyramid_t depthPyramid_;
+
+      //Depth copied in each frame in flight
+      struct depth_readback_t
+      {
+        core::render::gpu_buffer_t buffer = {};
+        uint32_t width = 0u;
+        uint32_t height = 0u;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        core::maths::mat4 viewProjection;
+        bool pending = false;  //Copy recorded and not yet used to build the depth pyramid
+      };
+      std::vector<depth_readback_t> depthReadback_;
+      std::vector<f32> depthData_;  //Readback depth converted to float for formats other than 32 bit float, or software rasterized depth
+      core::culling::occlusion_rasterizer_t occlusionRasterizer_;
     };
 
     class orbiting_camera_controller_t
@@ -21,7 +21,10 @@ namespace bkk
   namespace framework
   {
     class renderer_t;
-    class actor_t;
+    class camera_t;
+    typedef core::bkk_handle_t actor_handle_t;
+    typedef core::bkk_handle_t mesh_handle_t;
+    typedef core::bkk_handle_t transform_handle_t;
 
     struct layout_transition_t
     {
@@ -56,16 +59,20 @@ namespace bkk
       public:
         command_buffer_t();
 
-        command_buffer_t(renderer_t* renderer, const char* name = nullptr, VkSemaphore signalSemaphore = VK_NULL_HANDLE, VkCommandPool pool = VK_NULL_HANDLE);
+        //Vulkan objects are taken from the renderer when recording and recycled frameCount frames later, so
+        //command buffers have to be submitted and released in the frame they are recorded
+        command_buffer_t(renderer_t* renderer, const char* name = nullptr, VkSemaphore signalSemaphore = VK_NULL_HANDLE);
         ~command_buffer_t();
         
-        void init(renderer_t* renderer, const char* name = nullptr, VkSemaphore signalSemaphore = VK_NULL_HANDLE, VkCommandPool pool = VK_NULL_HANDLE);
+        void init(renderer_t* renderer, const char* name = nullptr, VkSemaphore signalSemaphore = VK_NULL_HANDLE);
         void setDependencies(command_buffer_t* prevCommandBuffers, uint32_t count);
         void setFrameBuffer(frame_buffer_handle_t frameBuffer);
 
         void clearRenderTargets(const core::maths::vec4& color);
         
-        void render(actor_t* actors, uint32_t actorCount, const char* passName );
+        //actorIndex are indices in renderer_t::getAllActors, as returned by renderer_t::getVisibleActors
+        void render(const uint32_t* actorIndex, uint32_t actorCount, const char* passName );
+        void render(const actor_handle_t* actors, uint32_t actorCount, const char* passName);
         void blit(render_target_handle_t renderTarget, material_handle_t materialHandle = core::BKK_NULL_HANDLE, const char* pass = nullptr);
         void blit(const bkk::core::render::texture_t& texture, material_handle_t materialHandle = core::BKK_NULL_HANDLE, const char* pass = nullptr);
 
@@ -80,8 +87,7 @@ namespace bkk
         void release();
 
         void submitAndRelease();
-        
-        void cleanup();
+
         VkSemaphore getSemaphore();
 
       private:
@@ -93,19 +99,28 @@ namespace bkk
         void beginCommandBuffer();
         void endCommandBuffer();
         void createCommandBuffer(type_e type);
+        //Actor arrays of the renderer, read once per render call
+        struct actor_columns_t
+        {
+          mesh_handle_t* mesh;
+          transform_handle_t* transform;
+          material_handle_t* material;
+          uint32_t* instanceCount;
+        };
+
+        void getActorColumns(actor_columns_t* columns);
+        void renderActor(const actor_columns_t& columns, uint32_t actorIndex, camera_t* camera, const char* passName, material_t** boundMaterial);
 
         renderer_t* renderer_;
         std::string name_;
 
         std::vector<command_buffer_t> dependencies_;
-        core::render::command_buffer_t commandBuffer_;
+        core::render::command_buffer_t* commandBuffer_;  //Owned by the command buffer pools of the renderer
         VkSemaphore semaphore_;
-        VkCommandPool commandPool_;
 
         frame_buffer_handle_t frameBuffer_;
         core::maths::vec4 clearColor_;
         bool clear_;
-        bool released_;
         VkSemaphore signalSemaphore_;
     };
 
@@ -114,7 +129,7 @@ namespace bkk
       const char* name,
       frame_buffer_handle_t framebuffer,
       const core::maths::vec4* clearColor,
-      actor_t* actors, uint32_t actorCount,
+      const uint32_t* actorIndex, uint32_t actorCount,
       const char* passName,
       VkSemaphore signalSemaphore,
       command_buffer_t* prevCommandBuffers, uint32_t count,
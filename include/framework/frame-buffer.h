@@ -32,6 +32,7 @@ namespace bkk
         uint32_t getWidth() const { return width_; }
         uint32_t getHeight() const { return height_; }
         uint32_t getTargetCount() const { return targetCount_; }
+        render_target_handle_t getTarget(uint32_t index) const { return renderTargets_[index]; }
         core::render::render_pass_t getRenderPass() { return renderPass_; }
         core::render::render_pass_t getRenderPassNoClear() { return renderPassNoClear_; }
         core::render::frame_buffer_t getFrameBuffer() { return frameBuffer_; }
@@ -10,10 +10,17 @@
 #define RENDERER_H
 
 #include <stdint.h>
+#include <mutex>
+#include <deque>
 #include "core/render-types.h"
 #include "core/packed-freelist.h"
 #include "core/transform-manager.h"
 #include "core/thread-pool.h"
+#include "core/job-graph.h"
+#include "core/culling.h"
+#include "core/bvh.h"
+#include "core/occlusion-rasterizer.h"
+#include "core/dictionary.h"
 
 #include "core/mesh.h"
 
@@ -45,7 +52,8 @@ namespace bkk
         renderer_t();
         ~renderer_t();
         
-        void initialize(const char* title, uint32_t imageCount, const core::window::window_t& window);
+        //framesInFlight is the number of frames the CPU can record ahead of the GPU
+        void initialize(const char* title, uint32_t imageCount, const core::window::window_t& window, uint32_t framesInFlight = 2u);
         core::render::context_t& getContext();
 
         shader_handle_t shaderCreate(const char* file);
@@ -77,13 +85,43 @@ namespace bkk
         actor_handle_t actorCreate(const char* name, mesh_handle_t mesh, material_handle_t material, core::maths::mat4 transform = core::maths::mat4(), uint32_t instanceCount = 1);
         void actorDestroy(actor_handle_t handle);
         actor_t* getActor(actor_handle_t handle);
+        bool getActorIndex(actor_handle_t handle, uint32_t* index);  //Index of the actor in getAllActors and the other actor arrays
         material_t* getActorMaterial(actor_handle_t handle);
         void actorSetParent(actor_handle_t actor, actor_handle_t parent);        
         void actorSetTransform(actor_handle_t handle, const core::maths::mat4& newTransform);
         core::maths::mat4* actorGetTransform(actor_handle_t handle);
         actor_handle_t getRootActor() { return rootActor_; }
-        uint32_t getAllActors(actor_t** actors) { return actors_.getData(actors); }
-        actor_t* findActor(const char* name);
+        uint32_t getAllActors(actor_t** actors) { return actors_.getData<ACTOR_COLUMN_OBJECT>(actors); }
+        uint32_t getAllActorMeshes(mesh_handle_t** meshes) { return actors_.getData<ACTOR_COLUMN_MESH>(meshes); }
+        uint32_t getAllActorTransforms(transform_handle_t** transforms) { return actors_.getData<ACTOR_COLUMN_TRANSFORM>(transforms); }
+        uint32_t getAllActorMaterials(material_handle_t** materials) { return actors_.getData<ACTOR_COLUMN_MATERIAL>(materials); }
+        uint32_t getAllActorInstanceCounts(uint32_t** instanceCounts) { return actors_.getData<ACTOR_COLUMN_INSTANCE_COUNT>(instanceCounts); }
+
+        //World space bounding box (center and half extent) and bounding sphere radius of all the actors, in the same
+        //order as getAllActors. Bounds are updated in update() for the actors whose transform has changed
+        uint32_t getAllActorBounds(core::culling::aabb_soa_t* bounds);
+        uint32_t getAllActorBoundingRadius(f32** radius) { return actors_.getData<ACTOR_COLUMN_RADIUS>(radius); }
+
+        //Queries on the bounding volume hierarchy of the actors. Actors without mesh are not included
+        void actorFrustumCull(const core::maths::vec4* frustumPlanes, std::vector<uint32_t>* actorIndex);  //Indices in getAllActors, sorted
+
+        //Culls several frustums (6 planes each, up to bvh_t::MAX_FRUSTUMS) in a single traversal. actorIndex gets the actors visible
+        //from any of the frustums, sorted, and frustumMask the frustums each of them is visible from (bit i for frustum i)
+        void actorFrustumCull(const core::maths::vec4* frustumPlanes, uint32_t frustumCount, std::vector<uint32_t>* actorIndex, std::vector<uint32_t>* frustumMask);
+        actor_handle_t actorRayCast(const core::maths::vec3& origin, const core::maths::vec3& direction, f32 maxDistance = FLT_MAX, f32* distance = nullptr);
+        //Removes the actors completely hidden behind the depth in the pyramid (see camera_t::setOcclusionCulling)
+        void actorOcclusionCull(const core::culling::depth_pyramid_t& depthPyramid, std::vector<uint32_t>* actorIndex);
+
+        //Low poly mesh of the actor, in model space, rendered by cameras with software occlusion culling. It has to fit inside
+        //the actor's mesh. The geometry is copied and follows the transform of the actor
+        void actorSetOccluder(actor_handle_t handle, const core::maths::vec3* vertex, uint32_t vertexCount, const uint32_t* index, uint32_t triangleCount);
+        void actorRemoveOccluder(actor_handle_t handle);
+        void rasterizeOccluders(const core::maths::mat4& viewProjection, uint32_t width, uint32_t height,
+                                core::culling::occlusion_rasterizer_t* rasterizer, f32* depth);
+
+        uint32_t actorQueryAabb(const core::maths::aabb_t& aabb, std::vector<actor_handle_t>* actors);
+        uint32_t actorQuerySphere(const core::maths::vec3& center, f32 radius, std::vector<actor_handle_t>* actors);
+        actor_handle_t findActor(const char* name);
         
         void setTransform(transform_handle_t handle, const core::maths::mat4& newTransform);
         core::maths::mat4* getTransform(transform_handle_t handle);
@@ -93,12 +131,22 @@ namespace bkk
         camera_t* getCamera(camera_handle_t handle);
         camera_t* getActiveCamera();
         bool setupCamera(camera_handle_t camera);
-        int getVisibleActors(camera_handle_t camera, actor_t** actors);
+
+        //Culls the cameras in a single pass over the actors. Cameras modified after update() (shadow cameras, cube map faces...)
+        //should be culled together with this before calling setupCamera, which then doesn't need to cull them again
+        void cullCameras(const camera_handle_t* cameras, uint32_t cameraCount);
+        //Indices in getAllActors of the actors visible from the camera, sorted
+        uint32_t getVisibleActors(camera_handle_t camera, const uint32_t** actorIndex);
 
         frame_buffer_handle_t getBackBuffer();
         VkSemaphore getRenderCompleteSemaphore();
         core::render::descriptor_set_layout_t getGlobalsDescriptorSetLayout();
         core::render::descriptor_set_layout_t getObjectDescriptorSetLayout();
+
+        //Per-object uniforms of all the actors are in a single buffer, bound with a dynamic offset. Actors created
+        //after the last update don't have uniforms yet
+        core::render::descriptor_set_t* getObjectDescriptorSet() { return &objectDescriptorSet_; }
+        bool getObjectUniformOffset(transform_handle_t transform, uint32_t* offset);
         core::render::descriptor_pool_t getDescriptorPool();
 
         void presentFrame();
@@ -108,21 +156,75 @@ namespace bkk
         core::render::texture_t getDefaultTexture() { return defaultTexture_;  }
         core::render::texture_t getDefaultNormalTexture() { return defaultNormalTexture_; }
         
-        void releaseCommandBuffer(const command_buffer_t* cmdBuffer);
+        //Command buffers and semaphores for the calling thread. They are allocated from the pools of the current frame
+        //and recycled, without destroying them, once the frames in flight are done with it. The pool owns the command buffer
+        core::render::command_buffer_t* acquireCommandBuffer(core::render::command_buffer_t::type_e type,
+          VkSemaphore* waitSemaphore, VkPipelineStageFlags* waitStages, uint32_t waitSemaphoreCount,
+          VkSemaphore* signalSemaphore, uint32_t signalSemaphoreCount);
+        VkSemaphore acquireSemaphore();
+
+        //Flushes the uploads and submits the command buffer. Submissions have to be done from a single thread
+        void submitCommandBuffer(const core::render::command_buffer_t& commandBuffer);
+
+        //Destroys the descriptor set once the frames in flight that may use it are done
+        void releaseDescriptorSet(const core::render::descriptor_set_t& descriptorSet);
+        void releaseBuffer(const core::render::gpu_buffer_t& buffer);
+
+        //Writes data to the upload ring. The GPU copies it to buffer (which needs TRANSFER_DST usage) before executing the
+        //command buffers submitted after the next flushUploads. Thread safe
+        void uploadBufferData(const void* data, size_t offset, size_t size, core::render::gpu_buffer_t* buffer);
+
+        //Submits the copies of the data uploaded since the last flush. Called before submitting command buffers
+        void flushUploads();
 
         core::thread_pool_t* getThreadPool() { return threadPool_; }
-        VkCommandPool getCommandPool(uint32_t i){ return commandPool_[i]; }
-        uint32_t getCommandPoolCount() { return (uint32_t)commandPool_.size(); }
 
         void prepareShaders(const char* passName, frame_buffer_handle_t fb);
 
       private:
+        class frame_job_t;
+
         void createTextureBlitResources();
         void buildPresentationCommandBuffers();
+        void buildFrameGraph();
+        void destroyFrameGraph();
+        void updateTransforms();
+        void updateActorBounds(actor_handle_t actor, const core::maths::mat4& worldMatrix);
+        void updateActorBvh(actor_handle_t actor, bool refit);
+        uint32_t frustumCullCandidates(const core::maths::vec4* frustumPlanes, const std::vector<uint32_t>& candidate);
+        void updateMaterials();
+        void cullAllCameras();
+        void invalidateCameraVisibility();
+        void recordOcclusionDepthReadback();
+        void updateOcclusionDepth();
+        void beginUploadFrame();
+        void submitUploads();
+        void growUploadRing();
+        void reserveObjectUniforms();
         
         core::render::context_t context_;
 
-        core::packed_freelist_t<actor_t> actors_;
+        //Actors are stored by columns so loops over all the actors (culling, transform updates)
+        //only touch the handles they need and not the names and GPU objects
+        enum actor_column_e
+        {
+          ACTOR_COLUMN_OBJECT = 0,
+          ACTOR_COLUMN_MESH,
+          ACTOR_COLUMN_TRANSFORM,
+          ACTOR_COLUMN_MATERIAL,
+          ACTOR_COLUMN_CENTER_X,
+          ACTOR_COLUMN_CENTER_Y,
+          ACTOR_COLUMN_CENTER_Z,
+          ACTOR_COLUMN_EXTENT_X,
+          ACTOR_COLUMN_EXTENT_Y,
+          ACTOR_COLUMN_EXTENT_Z,
+          ACTOR_COLUMN_RADIUS,
+          ACTOR_COLUMN_BVH_LEAF,
+          ACTOR_COLUMN_INSTANCE_COUNT
+        };
+
+        core::packed_freelist_soa_t<actor_handle_t, actor_t, mesh_handle_t, transform_handle_t, material_handle_t,
+                                    f32, f32, f32, f32, f32, f32, f32, uint32_t, uint32_t> actors_;
         core::packed_freelist_t<camera_t> cameras_;
         core::packed_freelist_t<core::mesh::mesh_t> meshes_;        
         core::packed_freelist_t<material_t> materials_;
@@ -139,7 +241,45 @@ namespace bkk
         core::render::descriptor_set_layout_t objectDescriptorSetLayout_;
         core::render::descriptor_pool_t globalDescriptorPool_;
 
+        //Uniforms of each actor, indexed by the index of its transform handle. objectData_ is a copy in
+        //CPU memory so each contiguous run of uniforms that change in a frame is uploaded with a single copy
+        core::render::gpu_buffer_t objectUniformBuffer_;
+        core::render::descriptor_set_t objectDescriptorSet_;
+        std::vector<uint8_t> objectData_;
+        std::vector<uint8_t> objectUploaded_;  //Slots whose uniforms have been uploaded since the actor using them was created
+        std::vector<uint32_t> objectChanged_;  //Slots changed in the current frame, kept to avoid allocations every frame
+        uint32_t objectUniformStride_;
+        uint32_t objectCapacity_;
+
         core::transform_manager_t transformManager_;
+        std::vector<actor_handle_t> transformActor_;  //Actor owning each transform, indexed by transform handle index
+        core::bvh_t actorBvh_;                        //Leaves store the transform handle index of the actor
+
+        struct occluder_geometry_t
+        {
+          actor_handle_t actor;
+          std::vector<core::maths::vec3> vertex;
+          std::vector<uint32_t> index;
+        };
+        core::dictionary_t<actor_handle_t, occluder_geometry_t> occluders_;
+        std::vector<core::culling::occluder_t> occluderList_;
+
+        //Scratch memory used by the culling functions, kept to avoid allocations every frame
+        struct cull_leaf_t
+        {
+          uint32_t actor;
+          uint32_t frustumMask;  //Frustums the actor may be visible from
+          uint32_t insideMask;   //Frustums the actor is known to be inside of
+        };
+        std::vector<cull_leaf_t> cullVisible_;
+        std::vector<uint32_t> cullCandidate_;
+        std::vector<uint32_t> cullCandidateSlot_;
+        std::vector<f32> cullCandidateBounds_;
+        std::vector<uint32_t> cullCandidateVisible_;  //Positions in the list of candidates of the visible ones
+        std::vector<uint32_t> cullActorIndex_;
+        std::vector<uint32_t> cullFrustumMask_;
+        std::vector<uint32_t> cullCameraIndex_[core::bvh_t::MAX_FRUSTUMS];
+        std::vector<uint32_t> occlusionBlockVisible_;
 
         //Presentation pass resources
         bkk::core::mesh::mesh_t fullScreenQuad_;
@@ -156,11 +296,60 @@ namespace bkk
         bkk::core::render::texture_t defaultNormalTexture_;
         VkSemaphore renderComplete_;
 
-        //Command buffers to be released on the next frame
-        std::vector<command_buffer_t> releasedCommandBuffers_;
+        //Per frame updates of uniform buffers. The ring has a region for each frame in flight and the command
+        //buffers that copy from a region are waited on before the ring gets back to it
+        core::render::upload_ring_t uploadRing_;
+        std::vector< std::vector<core::render::command_buffer_t> > uploadCommandBuffers_;  //Per region of the ring
+        uint32_t uploadCommandBufferCount_;  //Upload command buffers submitted in the current frame
+
+        //Uploads that didn't fit in the ring. They are written to it after growing it in the next flush
+        struct pending_upload_t
+        {
+          core::render::gpu_buffer_t buffer;
+          size_t offset;
+          std::vector<uint8_t> data;
+        };
+        std::vector<pending_upload_t> pendingUploads_;
+        std::mutex pendingUploadsMutex_;
+
+        //Descriptor sets released in each frame in flight. They are destroyed when the GPU is done with the frame
+        std::vector< std::vector<core::render::descriptor_set_t> > releasedDescriptorSets_;
+        std::vector< std::vector<core::render::gpu_buffer_t> > releasedBuffers_;
+
+        //Compute command buffers may write buffers the graphics work of the previous frame is still reading. After a frame
+        //with compute work the graphics queue signals computeWaitSemaphore_, and the first compute submission of the next
+        //frame waits on it. Compute command buffers are waited on, with their fences, before their pool is reset
+        bool computeSubmitted_;
+        VkSemaphore computeWaitSemaphore_;
+        std::vector<VkSemaphore> computeWaitSemaphores_;
+        std::vector<VkPipelineStageFlags> computeWaitStages_;
+
+        //Command buffers and semaphores used by a thread in a frame. The pool is reset when the frame is reused
+        //and everything in it is handed out again
+        struct command_buffer_pool_t
+        {
+          VkCommandPool commandPool;
+          std::deque<core::render::command_buffer_t> commandBuffer;  //Handed out command buffers don't move when more are added
+          uint32_t usedCommandBuffers;
+          std::vector<VkSemaphore> semaphore;
+          uint32_t usedSemaphores;
+        };
+        std::vector< std::vector<command_buffer_pool_t> > commandBufferPool_;  //Per frame in flight and thread (threads of the pool plus one for any other thread)
+
+        //A binary semaphore has to be waited on before it can be signaled again, so the ones nobody waited on in a frame
+        //are waited on by the presentation
+        std::vector<VkSemaphore> signaledSemaphores_;
+        std::vector<VkSemaphore> waitedSemaphores_;
+        std::vector<VkSemaphore> presentationWaitSemaphores_;
 
-        std::vector<VkCommandPool> commandPool_;
         bkk::core::thread_pool_t* threadPool_;
+
+        //Jobs executed every frame by update()
+        core::job_graph_t frameGraph_;
+        frame_job_t* transformUpdateJob_;
+        frame_job_t* materialUpdateJob_;
+        frame_job_t* cullJob_;
+        bool frameGraphChanged_;
     };
 
   }//framework
@@ -282,8 +282,8 @@ public:
     camera_handle_t camera = cameraController_.getCameraHandle();
     renderer.setupCamera(camera);
 
-    actor_t* visibleActors = nullptr;
-    int count = renderer.getVisibleActors(camera, &visibleActors);
+    const uint32_t* visibleActors = nullptr;
+    uint32_t count = renderer.getVisibleActors(camera, &visibleActors);
 
     //Geometry pass
     command_buffer_t renderSceneCmd(&renderer, "Geometry pass");
@@ -293,11 +293,10 @@ public:
     renderSceneCmd.submitAndRelease();
    
     //Render lights
-    actor_t lights[] = { *renderer.getActor(lights_[0]), *renderer.getActor(lights_[1]) };
     command_buffer_t lightPassCmd(&renderer, "Light pass");
     lightPassCmd.setFrameBuffer(resultFBO_);
     lightPassCmd.clearRenderTargets(vec4(0.0f, 0.0f, 0.0f, 1.0f));    
-    lightPassCmd.render(lights, 2u, "LightPass");
+    lightPassCmd.render(lights_, 2u, "LightPass");
     lightPassCmd.submitAndRelease();
 
     //Gamma correction
@@ -335,7 +334,7 @@ public:
     ImGui::LabelText("", "Model");
     ImGui::ColorEdit3("Model Albedo", modelAlbedo_.data);
     ImGui::SliderFloat("Model Roughness", &modelRoughness_, 0.0f, 1.0f);
-    material_t* modelMaterial = getRenderer().getMaterial(getRenderer().findActor("model")->getMaterialHandle());
+    material_t* modelMaterial = getRenderer().getActorMaterial(getRenderer().findActor("model"));
     modelMaterial->setProperty("globals.albedo", modelAlbedo_);
     modelMaterial->setProperty("globals.roughness", modelRoughness_);
 
@@ -344,7 +343,7 @@ public:
     ImGui::LabelText("", "Floor");
     ImGui::ColorEdit3("Floor Albedo", floorAlbedo_.data);
     ImGui::SliderFloat("Floor Roughness", &floorRoughness_, 0.0f, 1.0f);
-    material_t* floorMaterial = getRenderer().getMaterial(getRenderer().findActor("floor")->getMaterialHandle());
+    material_t* floorMaterial = getRenderer().getActorMaterial(getRenderer().findActor("floor"));
     floorMaterial->setProperty("globals.albedo", floorAlbedo_);
     floorMaterial->setProperty("globals.roughness", floorRoughness_);
 
@@ -248,7 +248,7 @@ class deferred_shading_sample_t : public framework::application_t
 public:
   
   deferred_shading_sample_t()
-  :application_t("Deferred shading", 1200u, 800u, 3u),
+  :application_t("Deferred shading", 1200u, 800u, 3u, 1u),
    currentPresentationDescriptorSet_(0u),
    camera_( vec3(0.0f, 2.5f, 8.5f), vec2(0.0f,0.0f), 0.5f, 0.01f),
    bAnimateLights_( true )
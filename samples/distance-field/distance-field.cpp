@@ -551,8 +551,8 @@ int main()
   //Create a window
   window::create("Distance Field", gImageSize.x, gImageSize.y, &gWindow);
 
-  //Initialize gContext
-  render::contextCreate("Distance Field", "", gWindow, 3, &gContext);
+  //Initialize gContext. The camera is written in place to the uniform buffer, so frames are not overlapped
+  render::contextCreate("Distance Field", "", gWindow, 3, 1u, &gContext);
   
   gFSQuad = mesh::fullScreenQuad(gContext);
   gCamera.setPosition( vec3(0.0f, 0.0f, 5.0f) );
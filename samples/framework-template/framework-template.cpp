@@ -65,8 +65,8 @@ public:
     camera_handle_t camera = cameraController_.getCameraHandle();
     renderer.setupCamera(camera);
 
-    actor_t* visibleActors = nullptr;
-    int count = renderer.getVisibleActors(camera, &visibleActors);
+    const uint32_t* visibleActors = nullptr;
+    uint32_t count = renderer.getVisibleActors(camera, &visibleActors);
 
     command_buffer_t renderSceneCmd(&renderer, "Render", renderer.getRenderCompleteSemaphore());
     renderSceneCmd.clearRenderTargets(vec4(0.0f, 0.0f, 0.0f, 1.0f));
@@ -133,13 +133,14 @@ public:
     //Create buffer
     render::gpu_buffer_t lightBuffer = {};
     render::context_t& context = getRenderContext();
-    render::gpuBufferCreate(context, render::gpu_buffer_t::STORAGE_BUFFER,
+    render::gpuBufferCreate(context, (render::gpu_buffer_t::usage_e)(render::gpu_buffer_t::STORAGE_BUFFER | render::gpu_buffer_t::TRANSFER_DST),
       nullptr, sizeof(light_t)*lightCount + sizeof(maths::vec4), nullptr,
       &lightBuffer );
     
-    render::gpuBufferUpdate(context, &lightCount, 0u, sizeof(int), &lightBuffer);
-    render::gpuBufferUpdate(context, &lightIntensity_, sizeof(int), sizeof(float), &lightBuffer);
-    render::gpuBufferUpdate(context, lights.data(), sizeof(maths::vec4), lightCount * sizeof(light_t), &lightBuffer);
+    renderer_t& renderer = getRenderer();
+    renderer.uploadBufferData(&lightCount, 0u, sizeof(int), &lightBuffer);
+    renderer.uploadBufferData(&lightIntensity_, sizeof(int), sizeof(float), &lightBuffer);
+    renderer.uploadBufferData(lights.data(), sizeof(maths::vec4), lightCount * sizeof(light_t), &lightBuffer);
 
     return lightBuffer;
   }
@@ -178,13 +179,13 @@ public:
 
     //Update global properties
     renderer.getMaterial(blendMaterial_)->setProperty("globals.exposure", exposure_);
-    render::gpuBufferUpdate(getRenderContext(), &lightIntensity_, sizeof(int), sizeof(float), &lightBuffer_);
+    renderer.uploadBufferData(&lightIntensity_, sizeof(int), sizeof(float), &lightBuffer_);
     
     //Render scene
     camera_handle_t camera = cameraController_.getCameraHandle();
     renderer.setupCamera(camera);
-    actor_t* visibleActors = nullptr;
-    int count = renderer.getVisibleActors(camera, &visibleActors);
+    const uint32_t* visibleActors = nullptr;
+    uint32_t count = renderer.getVisibleActors(camera, &visibleActors);
 
     command_buffer_t renderSceneCmd(&renderer, "Render Scene");
     renderSceneCmd.setFrameBuffer(sceneFBO_);
@@ -612,7 +612,7 @@ class global_illumination_sample_t : public framework::application_t
 public:
   
   global_illumination_sample_t( const char* url)
-  :application_t("Global Illumination", 1200u, 800u, 3)
+  :application_t("Global Illumination", 1200u, 800u, 3, 1u)
   {
     render::context_t& context = getRenderContext();
     uvec2 size = getWindowSize();
@@ -0,0 +1,153 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#include <stdio.h>
+#include <vector>
+
+#include "core/maths.h"
+#include "core/timer.h"
+
+using namespace bkk::core;
+using namespace bkk::core::maths;
+
+//Compares the f32 mat4 functions selected by maths.h (SSE/AVX unless BKK_MATHS_NO_SIMD is defined) with the generic
+//scalar templates, which are the code used when BKK_MATHS_NO_SIMD is defined, and measures both
+
+static const uint32_t MATRIX_COUNT = 4096u;
+static const uint32_t ITERATIONS = 200u;
+static const f32 TOLERANCE = 1e-4f;
+
+static mat4 randomMatrix()
+{
+  //Diagonally dominant, so it is always invertible
+  mat4 m;
+  for (uint32_t i(0); i < 16; ++i)
+    m.data[i] = random(-1.0f, 1.0f);
+
+  for (uint32_t i(0); i < 4; ++i)
+    m.data[i * 5] += 4.0f;
+
+  return m;
+}
+
+static f32 maxDifference(const f32* a, const f32* b, uint32_t count)
+{
+  f32 result = 0.0f;
+  for (uint32_t i(0); i < count; ++i)
+  {
+    f32 difference = fabsf(a[i] - b[i]) / maxValue(1.0f, fabsf(b[i]));
+    result = maxValue(result, difference);
+  }
+  return result;
+}
+
+static bool report(const char* name, f32 error, float simdTime, float scalarTime)
+{
+  bool passed = error <= TOLERANCE;
+  fprintf(stdout, "%-16s max error: %e %s  selected: %8.2f ms  scalar: %8.2f ms  speedup: %.2fx\n",
+    name, error, passed ? "(ok)    " : "(FAILED)", simdTime, scalarTime, scalarTime / simdTime);
+
+  return passed;
+}
+
+int main()
+{
+#if defined(BKK_MATHS_AVX)
+  fprintf(stdout, "Selected implementation: AVX\n");
+#elif defined(BKK_MATHS_SSE)
+  fprintf(stdout, "Selected implementation: SSE\n");
+#else
+  fprintf(stdout, "Selected implementation: scalar (BKK_MATHS_NO_SIMD)\n");
+#endif
+
+  std::vector<mat4> a(MATRIX_COUNT);
+  std::vector<mat4> b(MATRIX_COUNT);
+  std::vector<vec4> v(MATRIX_COUNT);
+  for (uint32_t i(0); i < MATRIX_COUNT; ++i)
+  {
+    a[i] = randomMatrix();
+    b[i] = randomMatrix();
+    v[i] = vec4(random(-1.0f, 1.0f), random(-1.0f, 1.0f), random(-1.0f, 1.0f), 1.0f);
+  }
+
+  std::vector<mat4> selected(MATRIX_COUNT);
+  std::vector<mat4> scalar(MATRIX_COUNT);
+  std::vector<vec4> selectedVector(MATRIX_COUNT);
+  std::vector<vec4> scalarVector(MATRIX_COUNT);
+  bool passed = true;
+
+  //Matrix multiply
+  timer::time_point_t start = timer::getCurrent();
+  for (uint32_t j(0); j < ITERATIONS; ++j)
+    for (uint32_t i(0); i < MATRIX_COUNT; ++i)
+      selected[i] = a[i] * b[(i + j) % MATRIX_COUNT];
+  float selectedTime = timer::getDifference(start, timer::getCurrent());
+
+  start = timer::getCurrent();
+  for (uint32_t j(0); j < ITERATIONS; ++j)
+    for (uint32_t i(0); i < MATRIX_COUNT; ++i)
+      scalar[i] = operator*<f32>(a[i], b[(i + j) % MATRIX_COUNT]);
+  float scalarTime = timer::getDifference(start, timer::getCurrent());
+  passed &= report("mat4 * mat4", maxDifference(selected[0].data, scalar[0].data, MATRIX_COUNT * 16), selectedTime, scalarTime);
+
+  //Vector by matrix
+  start = timer::getCurrent();
+  for (uint32_t j(0); j < ITERATIONS; ++j)
+    for (uint32_t i(0); i < MATRIX_COUNT; ++i)
+      selectedVector[i] = v[i] * a[(i + j) % MATRIX_COUNT];
+  selectedTime = timer::getDifference(start, timer::getCurrent());
+
+  start = timer::getCurrent();
+  for (uint32_t j(0); j < ITERATIONS; ++j)
+    for (uint32_t i(0); i < MATRIX_COUNT; ++i)
+      scalarVector[i] = operator*<f32>(v[i], a[(i + j) % MATRIX_COUNT]);
+  scalarTime = timer::getDifference(start, timer::getCurrent());
+  passed &= report("vec4 * mat4", maxDifference(selectedVector[0].data, scalarVector[0].data, MATRIX_COUNT * 4), selectedTime, scalarTime);
+
+  //Inverse
+  start = timer::getCurrent();
+  for (uint32_t j(0); j < ITERATIONS; ++j)
+    for (uint32_t i(0); i < MATRIX_COUNT; ++i)
+      invertMatrix(a[(i + j) % MATRIX_COUNT], &selected[i]);
+  selectedTime = timer::getDifference(start, timer::getCurrent());
+
+  start = timer::getCurrent();
+  for (uint32_t j(0); j < ITERATIONS; ++j)
+    for (uint32_t i(0); i < MATRIX_COUNT; ++i)
+      invertMatrix<f32>(a[(i + j) % MATRIX_COUNT], &scalar[i]);
+  scalarTime = timer::getDifference(start, timer::getCurrent());
+  passed &= report("inverse", maxDifference(selected[0].data, scalar[0].data, MATRIX_COUNT * 16), selectedTime, scalarTime);
+
+  //Transpose. The f32 specialization replaces the generic member function, so it is compared with an element copy
+  start = timer::getCurrent();
+  for (uint32_t j(0); j < ITERATIONS; ++j)
+  {
+    for (uint32_t i(0); i < MATRIX_COUNT; ++i)
+    {
+      selected[i] = a[(i + j) % MATRIX_COUNT];
+      selected[i].transpose();
+    }
+  }
+  selectedTime = timer::getDifference(start, timer::getCurrent());
+
+  start = timer::getCurrent();
+  for (uint32_t j(0); j < ITERATIONS; ++j)
+  {
+    for (uint32_t i(0); i < MATRIX_COUNT; ++i)
+    {
+      const mat4& m = a[(i + j) % MATRIX_COUNT];
+      for (uint32_t row(0); row < 4; ++row)
+        for (uint32_t column(0); column < 4; ++column)
+          scalar[i].data[column * 4 + row] = m.data[row * 4 + column];
+    }
+  }
+  scalarTime = timer::getDifference(start, timer::getCurrent());
+  passed &= report("transpose", maxDifference(selected[0].data, scalar[0].data, MATRIX_COUNT * 16), selectedTime, scalarTime);
+
+  return passed ? 0 : 1;
+}
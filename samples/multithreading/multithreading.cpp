@@ -34,6 +34,9 @@ public:
     camera_handle_t camera = renderer.cameraAdd(camera_t(camera_t::PERSPECTIVE_PROJECTION, 1.2f, imageSize.x / (float)imageSize.y, 0.01f, 100.0f));
     cameraController_.setCameraHandle(camera, &renderer);
 
+    //Most of the actors in the frustum are hidden behind the walls. Cull them using last frame's depth buffer
+    renderer.getCamera(camera)->setOcclusionCulling(camera_t::OCCLUSION_CULLING_GPU_DEPTH);
+
     //Create camera used to render the shadow map
     camera_t shadowCamera = camera_t(camera_t::PERSPECTIVE_PROJECTION, 1.2f, 1.0f, 0.1f, 5.0f);
     shadowCamera.setViewToWorldMatrix(maths::createTransform(vec3(0.0f, 2.0f, 0.0f), VEC3_ONE, QUAT_UNIT));
@@ -50,7 +53,7 @@ public:
     globals_.worldToLightClipSpace_ = shadowCamera.getViewProjectionMatrix();
     globals_.shadowMapSize_ = shadowMapSize;
 
-    render::gpuBufferCreate(renderer.getContext(), render::gpu_buffer_t::UNIFORM_BUFFER,
+    render::gpuBufferCreate(renderer.getContext(), (render::gpu_buffer_t::usage_e)(render::gpu_buffer_t::UNIFORM_BUFFER | render::gpu_buffer_t::TRANSFER_DST),
       &globals_, sizeof(globals_), nullptr, &globalsBuffer_);
 
     loadScene("../resources/sponza/sponza.obj");
@@ -151,17 +154,18 @@ public:
   {
     renderer_t& renderer = getRenderer();
 
-    beginFrame();
-
-    //Compute shadow camera transformation based on light direction
+    //Compute shadow camera transformation based on light direction. It is set before beginFrame so
+    //the renderer culls the shadow and viewing cameras together in a single pass
     vec3 lightDirection = normalize(globals_.light_.xyz());
     maths::mat4 viewToWorldMatrix = maths::createTransform(maths::vec3(0.0f, 0.0f, 2.0f), maths::VEC3_ONE, maths::QUAT_UNIT) *
       maths::createTransform(maths::VEC3_ZERO, maths::VEC3_ONE, maths::quat(VEC3_FORWARD, lightDirection));
+    renderer.getCamera(shadowCamera_)->setViewToWorldMatrix(viewToWorldMatrix);
+
+    beginFrame();
 
     //Setup and render scene from shadow camera to the shadow map
-    renderer.getCamera(shadowCamera_)->setViewToWorldMatrix(viewToWorldMatrix);    
     renderer.setupCamera(shadowCamera_);
-    actor_t* visibleActors = nullptr;
+    const uint32_t* visibleActors = nullptr;
     uint32_t actorCount = renderer.getVisibleActors(shadowCamera_, &visibleActors);
 
     layout_transition_t layoutTransition(shadowMap_, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
@@ -209,7 +213,7 @@ public:
     ImGui::End();
     
     globals_.worldToLightClipSpace_ = getRenderer().getCamera(shadowCamera_)->getViewProjectionMatrix();
-    render::gpuBufferUpdate(getRenderer().getContext(), &globals_, 0u, sizeof(globals_), &globalsBuffer_);
+    getRenderer().uploadBufferData(&globals_, 0u, sizeof(globals_), &globalsBuffer_);
   }
 
 private:
@@ -232,7 +232,7 @@ class particles_sample_t : public framework::application_t
 public:
 
   particles_sample_t()
-  :application_t("Particles", 1200u, 800u, 3u),
+  :application_t("Particles", 1200u, 800u, 3u, 1u),
    camera_(vec3(0.0f,20.0f,0.0f), 50.0f, vec2(0.0f, 0.0f), 0.01f),
    emissionRate_(10000)
   {
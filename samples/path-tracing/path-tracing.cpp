@@ -54,7 +54,7 @@ class path_tracing_sample_t : public framework::application_t
 public:
   
   path_tracing_sample_t( u32 width, u32 height )
-  :application_t("Path tracing", width, height, 3u ),
+  :application_t("Path tracing", width, height, 3u, 1u),
   imageSize_(width, height)
   {
     createResources();
@@ -372,7 +372,7 @@ static const char* gPresentationFragmentShaderSource = R"(
 struct pbr_renderer_t : public framework::application_t
 {
   pbr_renderer_t()
-    :application_t("PBR Renderer", 1200u, 800u, 3u),
+    :application_t("PBR Renderer", 1200u, 800u, 3u, 1u),
     camera_(vec3(0.0f, 9.0f, 5.0f), vec2(0.6f, 0.0f), 0.5f, 0.01f)
   {
     render::context_t& context = getRenderContext();
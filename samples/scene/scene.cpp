@@ -437,7 +437,7 @@ class scene_sample_t : public framework::application_t
 public:
   
   scene_sample_t( const char* url )
-  :application_t("Scene", 1200u, 800u, 3u)
+  :application_t("Scene", 1200u, 800u, 3u, 1u)
   {
     render::context_t& context = getRenderContext();
     uvec2 size = getWindowSize();
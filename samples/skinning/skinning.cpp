@@ -97,14 +97,19 @@ public:
     projectionTx_ = perspectiveProjectionMatrix(1.5f, getWindow().width / (float)getWindow().height, 1.0f, 1000.0f);
     modelTx_ = createTransform(vec3(0.0, -17.0, 0.0), VEC3_ONE, QUAT_UNIT);
 
-    //Create uniform buffer
+    //Create uniform buffers. Each frame in flight writes its own, as the GPU may still be reading the ones of previous frames
     mat4 matrices[2];
     matrices[0] = modelTx_ * camera_.getViewMatrix();
     matrices[1] = matrices[0] * projectionTx_;
-    render::gpuBufferCreate(context, render::gpu_buffer_t::UNIFORM_BUFFER,
-                            render::gpu_memory_type_e::HOST_VISIBLE_COHERENT,
-                            (void*)&matrices, sizeof(matrices) ,
-                            nullptr, &globalUnifomBuffer_);
+    u32 frameCount = render::getFrameCount(context);
+    globalUnifomBuffer_.resize(frameCount);
+    for (u32 i(0); i < frameCount; ++i)
+    {
+      render::gpuBufferCreate(context, render::gpu_buffer_t::UNIFORM_BUFFER,
+                              render::gpu_memory_type_e::HOST_VISIBLE_COHERENT,
+                              (void*)&matrices, sizeof(matrices),
+                              nullptr, &globalUnifomBuffer_[i]);
+    }
 
     //Create geometry and animator    
     mesh::createFromFile(context, "../resources/mannequin/mannequin.fbx", mesh::EXPORT_ALL, nullptr, 0u, &mesh_);
@@ -132,16 +137,20 @@ public:
     render::descriptorSetLayoutCreate(context, bindings, 3u, &descriptorSetLayout_);
     render::pipelineLayoutCreate(context, &descriptorSetLayout_, 1u, nullptr, 0u, &pipelineLayout_);
 
-    //Create descriptor set
-    render::descriptorPoolCreate(context, 1u,
-      render::combined_image_sampler_count(1u),
-      render::uniform_buffer_count(1u),
-      render::storage_buffer_count(1u),
+    //Create one descriptor set per frame in flight
+    render::descriptorPoolCreate(context, frameCount,
+      render::combined_image_sampler_count(frameCount),
+      render::uniform_buffer_count(frameCount),
+      render::storage_buffer_count(frameCount),
       render::storage_image_count(0u),
       &descriptorPool_);
 
-    render::descriptor_t descriptors[3] = { render::getDescriptor(globalUnifomBuffer_), render::getDescriptor(animator_.buffer), render::getDescriptor( texture_) };
-    render::descriptorSetCreate(context, descriptorPool_, descriptorSetLayout_, descriptors, &descriptorSet_);
+    descriptorSet_.resize(frameCount);
+    for (u32 i(0); i < frameCount; ++i)
+    {
+      render::descriptor_t descriptors[3] = { render::getDescriptor(globalUnifomBuffer_[i]), render::getDescriptor(animator_.buffer[i]), render::getDescriptor(texture_) };
+      render::descriptorSetCreate(context, descriptorPool_, descriptorSetLayout_, descriptors, &descriptorSet_[i]);
+    }
 
     //Create pipeline
     render::shaderCreateFromGLSLSource(context, render::shader_t::VERTEX_SHADER, gVertexShaderSource, &vertexShader_);
@@ -159,8 +168,6 @@ public:
     pipelineDesc.vertexShader = vertexShader_;
     pipelineDesc.fragmentShader = fragmentShader_;
     render::graphicsPipelineCreate(context, context.swapChain.renderPass, 0u, mesh_.vertexFormat, pipelineLayout_, pipelineDesc, &pipeline_);
-
-    buildCommandBuffers();
   }
 
   void onQuit()
@@ -176,9 +183,12 @@ public:
     render::pipelineLayoutDestroy(context, &pipelineLayout_);
     render::graphicsPipelineDestroy(context, &pipeline_);
     render::descriptorSetLayoutDestroy(context, &descriptorSetLayout_);
-    render::descriptorSetDestroy(context, &descriptorSet_);    
+    for (u32 i(0); i < descriptorSet_.size(); ++i)
+    {
+      render::descriptorSetDestroy(context, &descriptorSet_[i]);
+      render::gpuBufferDestroy(context, nullptr, &globalUnifomBuffer_[i]);
+    }
     render::descriptorPoolDestroy(context, &descriptorPool_);
-    render::gpuBufferDestroy(context, nullptr, &globalUnifomBuffer_);
     render::textureDestroy(context, &texture_);
   }
   
@@ -190,18 +200,19 @@ public:
     mat4 matrices[2];
     matrices[0] = modelTx_ * camera_.getViewMatrix();
     matrices[1] = matrices[0] * projectionTx_;
-    render::gpuBufferUpdate(context, (void*)&matrices, 0, sizeof(matrices), &globalUnifomBuffer_);
+    u32 frame = render::getFrameIndex(context);
+    render::gpuBufferUpdate(context, (void*)&matrices, 0, sizeof(matrices), &globalUnifomBuffer_[frame]);
     
     //Update animator
     mesh::animatorUpdate(context, getTimeDelta(), &animator_);
 
     //Render frame
+    buildCommandBuffer(frame);
     render::presentFrame(&context);
   }
   
   void onResize(u32 width, u32 height) 
   {
-    buildCommandBuffers();
     projectionTx_ = perspectiveProjectionMatrix(1.5f, width / (float)height, 1.0f, 1000.0f);
   }
 
@@ -238,7 +249,7 @@ public:
     }
   }
 
-  void buildCommandBuffers()
+  void buildCommandBuffer(u32 frame)
   {
     render::context_t& context = getRenderContext();
     
@@ -246,21 +257,21 @@ public:
     clearValues[0].color = { { 0.2f, 0.3f, 0.4f, 1.0f } };
 
     clearValues[1].depthStencil = { 1.0f,0 };
-    const render::command_buffer_t* commandBuffers;
-    uint32_t count = render::getPresentationCommandBuffers(context, &commandBuffers);
-    for (uint32_t i(0); i<count; ++i)
-    {
-      render::beginPresentationCommandBuffer(context, i, clearValues);
-      render::graphicsPipelineBind(commandBuffers[i], pipeline_);
-      render::descriptorSetBind(commandBuffers[i], pipelineLayout_, 0, &descriptorSet_, 1u);
-      mesh::draw(commandBuffers[i], mesh_);
-      render::endPresentationCommandBuffer(context, i);
-    }
+
+    //Command buffer of the presented image binds the descriptor set of the frame, so it is recorded every frame
+    render::acquireNextImage(&context);
+    render::command_buffer_t* commandBuffer;
+    uint32_t image = render::getPresentationCommandBuffer(context, &commandBuffer);
+    render::beginPresentationCommandBuffer(context, image, clearValues);
+    render::graphicsPipelineBind(*commandBuffer, pipeline_);
+    render::descriptorSetBind(*commandBuffer, pipelineLayout_, 0, &descriptorSet_[frame], 1u);
+    mesh::draw(*commandBuffer, mesh_);
+    render::endPresentationCommandBuffer(context, image);
   }
 
 private:
   
-  render::gpu_buffer_t globalUnifomBuffer_;
+  std::vector<render::gpu_buffer_t> globalUnifomBuffer_;  //Per frame in flight
 
   mesh::mesh_t mesh_;
   mesh::skeletal_animator_t animator_;  
@@ -270,7 +281,7 @@ private:
   render::descriptor_set_layout_t descriptorSetLayout_;
 
   render::descriptor_pool_t descriptorPool_;  
-  render::descriptor_set_t descriptorSet_;
+  std::vector<render::descriptor_set_t> descriptorSet_;   //Per frame in flight
 
   render::graphics_pipeline_t pipeline_;
   render::shader_t vertexShader_;
@@ -297,7 +297,7 @@ static const char* gPresentationFragmentShaderSource = R"(
 struct TXAA_sample_t : public framework::application_t
 {
   TXAA_sample_t()
-    :application_t("Temporal Anti-Aliasing", 1200u, 800u, 3u),
+    :application_t("Temporal Anti-Aliasing", 1200u, 800u, 3u, 1u),
     camera_(vec3(0.0f, 2.5f, 8.5f), vec2(0.0f, 0.0f), 0.5f, 0.01f),
     bTemporalAA_(true),
     currentFrame_(0)
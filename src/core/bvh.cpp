@@ -0,0 +1,461 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#include "core/bvh.h"
+#include <float.h> //FLT_MAX
+#include <utility>
+
+using namespace bkk::core;
+using namespace bkk::core::maths;
+
+const uint32_t bvh_t::INVALID_NODE;
+const uint32_t bvh_t::MAX_FRUSTUMS;
+const uint32_t bvh_t::STACK_SIZE;
+
+bvh_t::bvh_t(f32 margin)
+:root_(INVALID_NODE),
+ freeList_(INVALID_NODE),
+ margin_(margin)
+{
+}
+
+uint32_t bvh_t::insert(const aabb_t& aabb, uint32_t userData)
+{
+  uint32_t leaf = allocateNode();
+  node_[leaf].aabb = enlarge(aabb);
+  node_[leaf].leafAabb = aabb;
+  node_[leaf].userData = userData;
+  node_[leaf].height = 0;
+  insertLeaf(leaf);
+
+  return leaf;
+}
+
+void bvh_t::remove(uint32_t leaf)
+{
+  assert(leaf < node_.size() && node_[leaf].isLeaf());
+  removeLeaf(leaf);
+  freeNode(leaf);
+}
+
+bool bvh_t::update(uint32_t leaf, const aabb_t& aabb)
+{
+  assert(leaf < node_.size() && node_[leaf].isLeaf());
+
+  node_[leaf].leafAabb = aabb;
+  if (contains(node_[leaf].aabb, aabb))
+    return false;
+
+  removeLeaf(leaf);
+  node_[leaf].aabb = enlarge(aabb);
+  insertLeaf(leaf);
+  return true;
+}
+
+void bvh_t::setLeafAabb(uint32_t leaf, const aabb_t& aabb)
+{
+  assert(leaf < node_.size() && node_[leaf].isLeaf());
+  node_[leaf].leafAabb = aabb;
+}
+
+void bvh_t::refit()
+{
+  if (root_ == INVALID_NODE)
+    return;
+
+  //Post-order traversal, children are refitted before their parent
+  std::vector<uint32_t>& stack = refitStack_;
+  std::vector<uint32_t>& order = refitOrder_;
+  stack.clear();
+  order.clear();
+  stack.push_back(root_);
+  while (!stack.empty())
+  {
+    uint32_t node = stack.back();
+    stack.pop_back();
+    order.push_back(node);
+    if (!node_[node].isLeaf())
+    {
+      stack.push_back(node_[node].child[0]);
+      stack.push_back(node_[node].child[1]);
+    }
+  }
+
+  for (uint32_t i((uint32_t)order.size()); i > 0; --i)
+  {
+    node_t& node = node_[order[i - 1]];
+    if (node.isLeaf())
+      node.aabb = enlarge(node.leafAabb);
+    else
+      node.aabb = merge(node_[node.child[0]].aabb, node_[node.child[1]].aabb);
+  }
+}
+
+void bvh_t::clear()
+{
+  node_.clear();
+  root_ = INVALID_NODE;
+  freeList_ = INVALID_NODE;
+}
+
+bool bvh_t::rayCast(const vec3& origin, const vec3& direction, f32 maxDistance, uint32_t* userData, f32* distance) const
+{
+  if (root_ == INVALID_NODE)
+    return false;
+
+  vec3 invDirection( direction.x != 0.0f ? 1.0f / direction.x : FLT_MAX,
+                     direction.y != 0.0f ? 1.0f / direction.y : FLT_MAX,
+                     direction.z != 0.0f ? 1.0f / direction.z : FLT_MAX );
+
+  //Slab test. Returns distance to the box or a negative value if the ray doesn't hit it before closest
+  auto hitDistance = [&](const aabb_t& aabb, f32 closest)
+  {
+    f32 tMin = 0.0f;
+    f32 tMax = closest;
+    for (uint32_t i(0); i < 3; ++i)
+    {
+      f32 t0 = (aabb.min[i] - origin[i]) * invDirection[i];
+      f32 t1 = (aabb.max[i] - origin[i]) * invDirection[i];
+      tMin = maxValue(tMin, minValue(t0, t1));
+      tMax = minValue(tMax, maxValue(t0, t1));
+    }
+
+    return tMin <= tMax ? tMin : -1.0f;
+  };
+
+  bool hit = false;
+  f32 closest = maxDistance;
+  uint32_t stack[STACK_SIZE];
+  uint32_t stackSize = 0u;
+  stack[stackSize++] = root_;
+  while (stackSize > 0u)
+  {
+    const node_t& node = node_[stack[--stackSize]];
+    if (node.isLeaf())
+    {
+      f32 t = hitDistance(node.leafAabb, closest);
+      if (t >= 0.0f)
+      {
+        hit = true;
+        closest = t;
+        *userData = node.userData;
+      }
+    }
+    else
+    {
+      //Visit closest child first so farther boxes are discarded sooner
+      f32 t0 = hitDistance(node_[node.child[0]].aabb, closest);
+      f32 t1 = hitDistance(node_[node.child[1]].aabb, closest);
+      uint32_t first = 0u;
+      if (t1 >= 0.0f && (t0 < 0.0f || t1 < t0))
+      {
+        first = 1u;
+        std::swap(t0, t1);
+      }
+
+      assert(stackSize + 2u <= STACK_SIZE);
+      if (t1 >= 0.0f)
+        stack[stackSize++] = node.child[1u - first];
+      if (t0 >= 0.0f)
+        stack[stackSize++] = node.child[first];
+    }
+  }
+
+  if (hit)
+    *distance = closest;
+
+  return hit;
+}
+
+uint32_t bvh_t::allocateNode()
+{
+  uint32_t node;
+  if (freeList_ != INVALID_NODE)
+  {
+    node = freeList_;
+    freeList_ = node_[node].parent;
+  }
+  else
+  {
+    node = (uint32_t)node_.size();
+    node_.push_back(node_t());
+  }
+
+  node_[node].parent = INVALID_NODE;
+  node_[node].child[0] = node_[node].child[1] = INVALID_NODE;
+  node_[node].height = 0;
+  node_[node].userData = 0u;
+  return node;
+}
+
+void bvh_t::freeNode(uint32_t node)
+{
+  node_[node].parent = freeList_;
+  node_[node].height = -1;
+  freeList_ = node;
+}
+
+void bvh_t::insertLeaf(uint32_t leaf)
+{
+  if (root_ == INVALID_NODE)
+  {
+    root_ = leaf;
+    node_[leaf].parent = INVALID_NODE;
+    return;
+  }
+
+  //1. Find best sibling. Descend while the cost of creating a new parent here is larger than pushing the leaf down
+  aabb_t leafAabb = node_[leaf].aabb;
+  uint32_t index = root_;
+  while (!node_[index].isLeaf())
+  {
+    const node_t& node = node_[index];
+    f32 area = perimeter(node.aabb);
+    f32 combinedArea = perimeter(merge(node.aabb, leafAabb));
+
+    //Cost of creating a new parent for this node and the new leaf
+    f32 cost = 2.0f * combinedArea;
+
+    //Minimum cost of pushing the leaf further down the tree
+    f32 inheritanceCost = 2.0f * (combinedArea - area);
+
+    f32 childCost[2];
+    for (uint32_t i(0); i < 2; ++i)
+    {
+      const node_t& child = node_[node.child[i]];
+      childCost[i] = perimeter(merge(leafAabb, child.aabb)) + inheritanceCost;
+      if (!child.isLeaf())
+        childCost[i] -= perimeter(child.aabb);
+    }
+
+    if (cost < childCost[0] && cost < childCost[1])
+      break;
+
+    index = childCost[0] < childCost[1] ? node.child[0] : node.child[1];
+  }
+
+  //2. Create a new parent for the sibling and the leaf
+  uint32_t sibling = index;
+  uint32_t oldParent = node_[sibling].parent;
+  uint32_t newParent = allocateNode();
+  node_[newParent].parent = oldParent;
+  node_[newParent].aabb = merge(leafAabb, node_[sibling].aabb);
+  node_[newParent].height = node_[sibling].height + 1;
+  node_[newParent].child[0] = sibling;
+  node_[newParent].child[1] = leaf;
+  node_[sibling].parent = newParent;
+  node_[leaf].parent = newParent;
+
+  if (oldParent != INVALID_NODE)
+  {
+    if (node_[oldParent].child[0] == sibling)
+      node_[oldParent].child[0] = newParent;
+    else
+      node_[oldParent].child[1] = newParent;
+  }
+  else
+  {
+    root_ = newParent;
+  }
+
+  //3. Walk back up the tree fixing heights and boxes
+  updateNode(node_[leaf].parent);
+}
+
+void bvh_t::removeLeaf(uint32_t leaf)
+{
+  if (leaf == root_)
+  {
+    root_ = INVALID_NODE;
+    return;
+  }
+
+  uint32_t parent = node_[leaf].parent;
+  uint32_t grandParent = node_[parent].parent;
+  uint32_t sibling = node_[parent].child[0] == leaf ? node_[parent].child[1] : node_[parent].child[0];
+
+  if (grandParent != INVALID_NODE)
+  {
+    //Replace parent with sibling
+    if (node_[grandParent].child[0] == parent)
+      node_[grandParent].child[0] = sibling;
+    else
+      node_[grandParent].child[1] = sibling;
+
+    node_[sibling].parent = grandParent;
+    freeNode(parent);
+    updateNode(grandParent);
+  }
+  else
+  {
+    root_ = sibling;
+    node_[sibling].parent = INVALID_NODE;
+    freeNode(parent);
+  }
+
+  node_[leaf].parent = INVALID_NODE;
+}
+
+void bvh_t::updateNode(uint32_t index)
+{
+  while (index != INVALID_NODE)
+  {
+    index = balance(index);
+
+    node_t& node = node_[index];
+    const node_t& child0 = node_[node.child[0]];
+    const node_t& child1 = node_[node.child[1]];
+    node.height = 1 + maxValue(child0.height, child1.height);
+    node.aabb = merge(child0.aabb, child1.aabb);
+
+    index = node.parent;
+  }
+}
+
+//Performs a left or right rotation if node A is imbalanced. Returns the new root of the subtree
+uint32_t bvh_t::balance(uint32_t iA)
+{
+  node_t* A = &node_[iA];
+  if (A->isLeaf() || A->height < 2)
+    return iA;
+
+  uint32_t iB = A->child[0];
+  uint32_t iC = A->child[1];
+  node_t* B = &node_[iB];
+  node_t* C = &node_[iC];
+  int32_t balance = C->height - B->height;
+
+  //Rotate C up
+  if (balance > 1)
+  {
+    uint32_t iF = C->child[0];
+    uint32_t iG = C->child[1];
+    node_t* F = &node_[iF];
+    node_t* G = &node_[iG];
+
+    C->child[0] = iA;
+    C->parent = A->parent;
+    A->parent = iC;
+
+    if (C->parent != INVALID_NODE)
+    {
+      if (node_[C->parent].child[0] == iA)
+        node_[C->parent].child[0] = iC;
+      else
+        node_[C->parent].child[1] = iC;
+    }
+    else
+    {
+      root_ = iC;
+    }
+
+    if (F->height > G->height)
+    {
+      C->child[1] = iF;
+      A->child[1] = iG;
+      G->parent = iA;
+      A->aabb = merge(B->aabb, G->aabb);
+      C->aabb = merge(A->aabb, F->aabb);
+      A->height = 1 + maxValue(B->height, G->height);
+      C->height = 1 + maxValue(A->height, F->height);
+    }
+    else
+    {
+      C->child[1] = iG;
+      A->child[1] = iF;
+      F->parent = iA;
+      A->aabb = merge(B->aabb, F->aabb);
+      C->aabb = merge(A->aabb, G->aabb);
+      A->height = 1 + maxValue(B->height, F->height);
+      C->height = 1 + maxValue(A->height, G->height);
+    }
+
+    return iC;
+  }
+
+  //Rotate B up
+  if (balance < -1)
+  {
+    uint32_t iD = B->child[0];
+    uint32_t iE = B->child[1];
+    node_t* D = &node_[iD];
+    node_t* E = &node_[iE];
+
+    B->child[0] = iA;
+    B->parent = A->parent;
+    A->parent = iB;
+
+    if (B->parent != INVALID_NODE)
+    {
+      if (node_[B->parent].child[0] == iA)
+        node_[B->parent].child[0] = iB;
+      else
+        node_[B->parent].child[1] = iB;
+    }
+    else
+    {
+      root_ = iB;
+    }
+
+    if (D->height > E->height)
+    {
+      B->child[1] = iD;
+      A->child[0] = iE;
+      E->parent = iA;
+      A->aabb = merge(C->aabb, E->aabb);
+      B->aabb = merge(A->aabb, D->aabb);
+      A->height = 1 + maxValue(C->height, E->height);
+      B->height = 1 + maxValue(A->height, D->height);
+    }
+    else
+    {
+      B->child[1] = iE;
+      A->child[0] = iD;
+      D->parent = iA;
+      A->aabb = merge(C->aabb, D->aabb);
+      B->aabb = merge(A->aabb, E->aabb);
+      A->height = 1 + maxValue(C->height, D->height);
+      B->height = 1 + maxValue(A->height, E->height);
+    }
+
+    return iB;
+  }
+
+  return iA;
+}
+
+aabb_t bvh_t::enlarge(const aabb_t& aabb) const
+{
+  vec3 margin = (aabb.max - aabb.min) * margin_;
+  return aabb_t{ aabb.min - margin, aabb.max + margin };
+}
+
+aabb_t bvh_t::merge(const aabb_t& a, const aabb_t& b)
+{
+  return aabb_t{ vec3(minValue(a.min.x, b.min.x), minValue(a.min.y, b.min.y), minValue(a.min.z, b.min.z)),
+                 vec3(maxValue(a.max.x, b.max.x), maxValue(a.max.y, b.max.y), maxValue(a.max.z, b.max.z)) };
+}
+
+f32 bvh_t::perimeter(const aabb_t& aabb)
+{
+  vec3 size = aabb.max - aabb.min;
+  return 2.0f * (size.x + size.y + size.z);
+}
+
+bool bvh_t::contains(const aabb_t& a, const aabb_t& b)
+{
+  return a.min.x <= b.min.x && a.min.y <= b.min.y && a.min.z <= b.min.z &&
+         a.max.x >= b.max.x && a.max.y >= b.max.y && a.max.z >= b.max.z;
+}
+
+bool bvh_t::overlaps(const aabb_t& a, const aabb_t& b)
+{
+  return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+         a.min.y <= b.max.y && a.max.y >= b.min.y &&
+         a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
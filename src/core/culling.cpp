@@ -0,0 +1,285 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#include "core/culling.h"
+#include <string.h> //memcpy
+
+using namespace bkk::core;
+using namespace bkk::core::maths;
+
+//A box is outside a plane if its center is further than its projected extent on the wrong side of the plane:
+//  dot(normal, center) + d < -dot(abs(normal), extent)
+static bool boxInFrustum(const vec4* frustumPlanes, const culling::aabb_soa_t& boxes, uint32_t i)
+{
+  for (uint32_t p(0); p < 6; ++p)
+  {
+    const vec4& plane = frustumPlanes[p];
+    f32 distance = plane.x * boxes.centerX[i] + plane.y * boxes.centerY[i] + plane.z * boxes.centerZ[i] + plane.w;
+    f32 radius = fabsf(plane.x) * boxes.extentX[i] + fabsf(plane.y) * boxes.extentY[i] + fabsf(plane.z) * boxes.extentZ[i];
+    if (distance + radius < 0.0f)
+      return false;
+  }
+
+  return true;
+}
+
+void culling::aabbToCenterExtent(const aabb_t& aabb, vec3* center, vec3* extent)
+{
+  *center = (aabb.min + aabb.max) * 0.5f;
+  *extent = (aabb.max - aabb.min) * 0.5f;
+}
+
+uint32_t culling::frustumCull(const vec4* frustumPlanes, const aabb_soa_t& boxes, uint32_t begin, uint32_t end, uint32_t* visibleIndex)
+{
+  uint32_t visibleCount = 0u;
+  uint32_t i = begin;
+
+#ifdef BKK_MATHS_AVX
+  //Eight boxes at a time
+  __m256 planeAVX[6][4];
+  for (uint32_t p(0); p < 6; ++p)
+  {
+    planeAVX[p][0] = _mm256_set1_ps(frustumPlanes[p].x);
+    planeAVX[p][1] = _mm256_set1_ps(frustumPlanes[p].y);
+    planeAVX[p][2] = _mm256_set1_ps(frustumPlanes[p].z);
+    planeAVX[p][3] = _mm256_set1_ps(frustumPlanes[p].w);
+  }
+
+  const __m256 signMaskAVX = _mm256_set1_ps(-0.0f);
+  for (; i + 8 <= end; i += 8)
+  {
+    __m256 cx = _mm256_loadu_ps(boxes.centerX + i);
+    __m256 cy = _mm256_loadu_ps(boxes.centerY + i);
+    __m256 cz = _mm256_loadu_ps(boxes.centerZ + i);
+    __m256 ex = _mm256_loadu_ps(boxes.extentX + i);
+    __m256 ey = _mm256_loadu_ps(boxes.extentY + i);
+    __m256 ez = _mm256_loadu_ps(boxes.extentZ + i);
+
+    __m256 outside = _mm256_setzero_ps();
+    for (uint32_t p(0); p < 6; ++p)
+    {
+      __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeAVX[p][0], cx), _mm256_mul_ps(planeAVX[p][1], cy)),
+                                      _mm256_add_ps(_mm256_mul_ps(planeAVX[p][2], cz), planeAVX[p][3]));
+      __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMaskAVX, planeAVX[p][0]), ex),
+                                                  _mm256_mul_ps(_mm256_andnot_ps(signMaskAVX, planeAVX[p][1]), ey)),
+                                    _mm256_mul_ps(_mm256_andnot_ps(signMaskAVX, planeAVX[p][2]), ez));
+      outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+
+    uint32_t visibleMask = ~(uint32_t)_mm256_movemask_ps(outside) & 0xFFu;
+    while (visibleMask)
+    {
+      uint32_t bit = 0u;
+      while (!(visibleMask & (1u << bit))) ++bit;
+      visibleIndex[visibleCount++] = i + bit;
+      visibleMask &= visibleMask - 1u;
+    }
+  }
+#endif
+
+#ifdef BKK_MATHS_SSE
+  //Four boxes at a time
+  __m128 plane[6][4];
+  for (uint32_t p(0); p < 6; ++p)
+  {
+    plane[p][0] = _mm_set1_ps(frustumPlanes[p].x);
+    plane[p][1] = _mm_set1_ps(frustumPlanes[p].y);
+    plane[p][2] = _mm_set1_ps(frustumPlanes[p].z);
+    plane[p][3] = _mm_set1_ps(frustumPlanes[p].w);
+  }
+
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  for (; i + 4 <= end; i += 4)
+  {
+    __m128 cx = _mm_loadu_ps(boxes.centerX + i);
+    __m128 cy = _mm_loadu_ps(boxes.centerY + i);
+    __m128 cz = _mm_loadu_ps(boxes.centerZ + i);
+    __m128 ex = _mm_loadu_ps(boxes.extentX + i);
+    __m128 ey = _mm_loadu_ps(boxes.extentY + i);
+    __m128 ez = _mm_loadu_ps(boxes.extentZ + i);
+
+    __m128 outside = _mm_setzero_ps();
+    for (uint32_t p(0); p < 6; ++p)
+    {
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane[p][0], cx), _mm_mul_ps(plane[p][1], cy)),
+                                   _mm_add_ps(_mm_mul_ps(plane[p][2], cz), plane[p][3]));
+      __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, plane[p][0]), ex),
+                                            _mm_mul_ps(_mm_andnot_ps(signMask, plane[p][1]), ey)),
+                                 _mm_mul_ps(_mm_andnot_ps(signMask, plane[p][2]), ez));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+    }
+
+    uint32_t visibleMask = ~(uint32_t)_mm_movemask_ps(outside) & 0xFu;
+    if (visibleMask & 1u) visibleIndex[visibleCount++] = i;
+    if (visibleMask & 2u) visibleIndex[visibleCount++] = i + 1;
+    if (visibleMask & 4u) visibleIndex[visibleCount++] = i + 2;
+    if (visibleMask & 8u) visibleIndex[visibleCount++] = i + 3;
+  }
+#endif
+
+  //Remaining boxes
+  for (; i < end; ++i)
+  {
+    if (boxInFrustum(frustumPlanes, boxes, i))
+      visibleIndex[visibleCount++] = i;
+  }
+
+  return visibleCount;
+}
+
+void culling::depthPyramidBuild(const f32* depth, uint32_t width, uint32_t height, const mat4& viewProjection, depth_pyramid_t* pyramid)
+{
+  //Each texel of the first level covers a block of blockSize x blockSize texels of the depth buffer
+  uint32_t shift = 0u;
+  while (((width - 1u) >> shift) + 1u > DEPTH_PYRAMID_MAX_SIZE || ((height - 1u) >> shift) + 1u > DEPTH_PYRAMID_MAX_SIZE)
+    ++shift;
+
+  uint32_t blockSize = 1u << shift;
+  uint32_t levelWidth = ((width - 1u) >> shift) + 1u;
+  uint32_t levelHeight = ((height - 1u) >> shift) + 1u;
+
+  pyramid->levelCount = 0u;
+  pyramid->levelOffset.clear();
+  pyramid->levelWidth.clear();
+  pyramid->levelHeight.clear();
+
+  uint32_t size = 0u;
+  for (uint32_t w(levelWidth), h(levelHeight); ; w = (w + 1u) / 2u, h = (h + 1u) / 2u)
+  {
+    pyramid->levelOffset.push_back(size);
+    pyramid->levelWidth.push_back(w);
+    pyramid->levelHeight.push_back(h);
+    pyramid->levelCount++;
+    size += w * h;
+    if (w == 1u && h == 1u)
+      break;
+  }
+
+  pyramid->depth.resize(size);
+  pyramid->scale = vec2((f32)width / (f32)blockSize, (f32)height / (f32)blockSize);
+  pyramid->viewProjection = viewProjection;
+
+  //First level
+  f32* level = pyramid->depth.data();
+  for (uint32_t y(0); y < levelHeight; ++y)
+  {
+    uint32_t yEnd = minValue((y + 1u) << shift, height);
+    for (uint32_t x(0); x < levelWidth; ++x)
+    {
+      uint32_t xEnd = minValue((x + 1u) << shift, width);
+      f32 maxDepth = 0.0f;
+      for (uint32_t sy(y << shift); sy < yEnd; ++sy)
+      {
+        const f32* row = depth + sy * width;
+        for (uint32_t sx(x << shift); sx < xEnd; ++sx)
+          maxDepth = maxValue(maxDepth, row[sx]);
+      }
+
+      level[y * levelWidth + x] = maxDepth;
+    }
+  }
+
+  //Coarser levels. Last row and column of levels with odd size are only covered by one texel
+  for (uint32_t l(1); l < pyramid->levelCount; ++l)
+  {
+    const f32* src = pyramid->depth.data() + pyramid->levelOffset[l - 1];
+    uint32_t srcWidth = pyramid->levelWidth[l - 1];
+    uint32_t srcHeight = pyramid->levelHeight[l - 1];
+
+    f32* dst = pyramid->depth.data() + pyramid->levelOffset[l];
+    uint32_t dstWidth = pyramid->levelWidth[l];
+    uint32_t dstHeight = pyramid->levelHeight[l];
+    for (uint32_t y(0); y < dstHeight; ++y)
+    {
+      uint32_t y0 = 2u * y;
+      uint32_t y1 = minValue(y0 + 1u, srcHeight - 1u);
+      for (uint32_t x(0); x < dstWidth; ++x)
+      {
+        uint32_t x0 = 2u * x;
+        uint32_t x1 = minValue(x0 + 1u, srcWidth - 1u);
+        dst[y * dstWidth + x] = maxValue(maxValue(src[y0 * srcWidth + x0], src[y0 * srcWidth + x1]),
+                                         maxValue(src[y1 * srcWidth + x0], src[y1 * srcWidth + x1]));
+      }
+    }
+  }
+}
+
+//Returns true if the box is completely behind the depth stored in the pyramid
+static bool boxOccluded(const culling::depth_pyramid_t& pyramid, const vec3& center, const vec3& extent)
+{
+  //Corners of the box in clip space are center +- the rows of the matrix scaled by the extent
+  const mat4& m = pyramid.viewProjection;
+  vec4 clipCenter = vec4(center.x, center.y, center.z, 1.0f) * m;
+  vec4 axis[3] = { m.row(0) * extent.x, m.row(1) * extent.y, m.row(2) * extent.z };
+
+  vec3 ndcMin(FLT_MAX, FLT_MAX, FLT_MAX);
+  vec3 ndcMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (uint32_t i(0); i < 8; ++i)
+  {
+    vec4 corner = clipCenter + axis[0] * ((i & 1u) ? 1.0f : -1.0f) + axis[1] * ((i & 2u) ? 1.0f : -1.0f) + axis[2] * ((i & 4u) ? 1.0f : -1.0f);
+
+    //Box crosses the near plane
+    if (corner.w <= FLT_EPSILON)
+      return false;
+
+    vec3 ndc = corner.xyz() / corner.w;
+    ndcMin = vec3(minValue(ndcMin.x, ndc.x), minValue(ndcMin.y, ndc.y), minValue(ndcMin.z, ndc.z));
+    ndcMax = vec3(maxValue(ndcMax.x, ndc.x), maxValue(ndcMax.y, ndc.y), maxValue(ndcMax.z, ndc.z));
+  }
+
+  //Box outside the depth buffer. There is no information to occlude it
+  if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+    return false;
+
+  //Rectangle covered by the box in texels of the first level
+  int32_t maxX = (int32_t)pyramid.levelWidth[0] - 1;
+  int32_t maxY = (int32_t)pyramid.levelHeight[0] - 1;
+  int32_t x0 = maxValue(0, minValue(maxX, (int32_t)floorf((ndcMin.x * 0.5f + 0.5f) * pyramid.scale.x)));
+  int32_t x1 = maxValue(0, minValue(maxX, (int32_t)floorf((ndcMax.x * 0.5f + 0.5f) * pyramid.scale.x)));
+  int32_t y0 = maxValue(0, minValue(maxY, (int32_t)floorf((ndcMin.y * 0.5f + 0.5f) * pyramid.scale.y)));
+  int32_t y1 = maxValue(0, minValue(maxY, (int32_t)floorf((ndcMax.y * 0.5f + 0.5f) * pyramid.scale.y)));
+
+  //Use the finest level where the rectangle covers at most 2x2 texels
+  uint32_t level = 0u;
+  while (level + 1u < pyramid.levelCount && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+    ++level;
+
+  const f32* depth = pyramid.depth.data() + pyramid.levelOffset[level];
+  uint32_t width = pyramid.levelWidth[level];
+  f32 maxDepth = 0.0f;
+  for (int32_t y(y0 >> level); y <= (y1 >> level); ++y)
+  {
+    for (int32_t x(x0 >> level); x <= (x1 >> level); ++x)
+      maxDepth = maxValue(maxDepth, depth[y * width + x]);
+  }
+
+  return ndcMin.z > maxDepth;
+}
+
+uint32_t culling::occlusionCull(const depth_pyramid_t& pyramid, const aabb_soa_t& boxes, const uint32_t* index, uint32_t count, uint32_t* visibleIndex)
+{
+  if (pyramid.levelCount == 0u)
+  {
+    if (visibleIndex != index)
+      memcpy(visibleIndex, index, count * sizeof(uint32_t));
+
+    return count;
+  }
+
+  uint32_t visibleCount = 0u;
+  for (uint32_t i(0); i < count; ++i)
+  {
+    uint32_t box = index[i];
+    vec3 center(boxes.centerX[box], boxes.centerY[box], boxes.centerZ[box]);
+    vec3 extent(boxes.extentX[box], boxes.extentY[box], boxes.extentZ[box]);
+    if (!boxOccluded(pyramid, center, extent))
+      visibleIndex[visibleCount++] = box;
+  }
+
+  return visibleCount;
+}
@@ -0,0 +1,72 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#include "core/job-graph.h"
+
+using namespace bkk::core;
+
+job_graph_t::job_graph_t()
+:job_(),
+ group_()
+{
+}
+
+job_graph_t::~job_graph_t()
+{
+  clear();
+}
+
+void job_graph_t::addJob(job_t* job)
+{
+  for (uint32_t i(0); i < job_.size(); ++i)
+  {
+    //Job is already in the graph
+    if (job_[i] == job)
+      return;
+  }
+
+  job_.push_back(job);
+}
+
+void job_graph_t::addDependency(job_t* job, job_t* dependsOn)
+{
+  addJob(job);
+  addJob(dependsOn);
+  job->dependsOn(dependsOn);
+}
+
+void job_graph_t::clear()
+{
+  for (uint32_t i(0); i < job_.size(); ++i)
+    job_[i]->clearDependencies();
+
+  job_.clear();
+}
+
+void job_graph_t::kick(thread_pool_t* pool)
+{
+  //Restore all dependency counters before adding any job, so a job finishing early
+  //can't release a dependent job from the previous execution
+  uint32_t jobCount = (uint32_t)job_.size();
+  for (uint32_t i(0); i < jobCount; ++i)
+    job_[i]->resetDependencies();
+
+  for (uint32_t i(0); i < jobCount; ++i)
+    pool->addTask(job_[i], &group_);
+}
+
+void job_graph_t::wait(thread_pool_t* pool)
+{
+  pool->waitForCompletion(&group_);
+}
+
+void job_graph_t::run(thread_pool_t* pool)
+{
+  kick(pool);
+  wait(pool);
+}
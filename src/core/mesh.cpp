@@ -612,11 +612,16 @@ void mesh::animatorCreate(const render::context_t& context, const mesh_t& mesh,
 
   animator->boneTransform = new maths::mat4[mesh.skeleton->boneCount];
 
-  //Create an uninitialized uniform buffer
-  render::gpuBufferCreate(context, render::gpu_buffer_t::STORAGE_BUFFER,
-    render::gpu_memory_type_e::HOST_VISIBLE_COHERENT,
-    nullptr, sizeof(maths::mat4) * mesh.skeleton->boneCount,
-    nullptr, &animator->buffer);
+  //Create uninitialized storage buffers. Buffers of previous frames may still be read by the GPU, so each frame in flight writes its own
+  animator->bufferCount = render::getFrameCount(context);
+  animator->buffer = new render::gpu_buffer_t[animator->bufferCount];
+  for (u32 i(0); i < animator->bufferCount; ++i)
+  {
+    render::gpuBufferCreate(context, render::gpu_buffer_t::STORAGE_BUFFER,
+      render::gpu_memory_type_e::HOST_VISIBLE_COHERENT,
+      nullptr, sizeof(maths::mat4) * mesh.skeleton->boneCount,
+      nullptr, &animator->buffer[i]);
+  }
 }
 
 
@@ -649,12 +654,11 @@ void mesh::animatorUpdate(const render::context_t& context, f32 deltaTime, skele
   //Compute new local transforms
   for (u32 i(0); i<animator->animation->nodeCount; ++i)
   {
-    //Compute new local transform of the bone
-    mat4 nodeLocalTx = maths::createTransform(maths::lerp(transform0->position, transform1->position, t),
-                                             maths::lerp(transform0->scale, transform1->scale, t),
-                                             maths::slerp(transform0->orientation, transform1->orientation, t));
-
-    animator->skeleton->txManager.setTransform(animator->animation->nodes[i], nodeLocalTx);
+    //Set new local transform of the bone. The matrix is composed in txManager.update()
+    animator->skeleton->txManager.setTransform(animator->animation->nodes[i],
+                                               maths::lerp(transform0->position, transform1->position, t),
+                                               maths::lerp(transform0->scale, transform1->scale, t),
+                                               maths::slerp(transform0->orientation, transform1->orientation, t));
   
     //Increment pointers to read next bone's animation data
     transform0++;
@@ -671,14 +675,23 @@ void mesh::animatorUpdate(const render::context_t& context, f32 deltaTime, skele
     animator->boneTransform[i] = animator->skeleton->bindPose[i] * (*boneGlobalTx) * animator->skeleton->rootBoneInverseTransform;
   }
 
-  //Upload bone transforms to the uniform buffer
-  render::gpuBufferUpdate(context, (void*)animator->boneTransform, 0u, sizeof(maths::mat4)*animator->skeleton->boneCount, &animator->buffer);
+  //Upload bone transforms to the buffer of the current frame
+  render::gpuBufferUpdate(context, (void*)animator->boneTransform, 0u, sizeof(maths::mat4)*animator->skeleton->boneCount, &animator->buffer[render::getFrameIndex(context)]);
+}
+
+const render::gpu_buffer_t& mesh::animatorGetBuffer(const render::context_t& context, const skeletal_animator_t& animator)
+{
+  return animator.buffer[render::getFrameIndex(context)];
 }
 
 void mesh::animatorDestroy(const render::context_t& context, skeletal_animator_t* animator)
 {
   delete[] animator->boneTransform;
-  render::gpuBufferDestroy(context, nullptr, &animator->buffer);
+  for (u32 i(0); i < animator->bufferCount; ++i)
+    render::gpuBufferDestroy(context, nullptr, &animator->buffer[i]);
+
+  delete[] animator->buffer;
+  animator->bufferCount = 0u;
 }
 
 
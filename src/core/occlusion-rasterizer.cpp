@@ -0,0 +1,276 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#include "core/occlusion-rasterizer.h"
+#include "core/thread-pool.h"
+#include <assert.h>
+
+using namespace bkk::core;
+using namespace bkk::core::maths;
+
+typedef culling::occlusion_rasterizer_t::triangle_t triangle_t;
+
+//Rows of the depth buffer rasterized by each task
+static const uint32_t BAND_HEIGHT = 8u;
+
+template <typename BODY>
+static void forEach(thread_pool_t* pool, uint32_t begin, uint32_t end, uint32_t grainSize, const BODY& body)
+{
+  if (pool)
+    parallelFor(pool, begin, end, grainSize, body);
+  else
+    body(begin, end);
+}
+
+static void emptyTriangle(triangle_t* triangle)
+{
+  triangle->minX = 1;
+  triangle->maxX = 0;
+}
+
+//Computes edge functions, depth plane and bounding box of a triangle given in clip space. All vertices must be in front of the near plane
+static void setupTriangle(const vec4& v0, const vec4& v1, const vec4& v2, uint32_t width, uint32_t height, triangle_t* triangle)
+{
+  //Screen space position and depth
+  vec3 p[3];
+  const vec4* v[3] = { &v0, &v1, &v2 };
+  for (uint32_t i(0); i < 3; ++i)
+  {
+    f32 invW = 1.0f / v[i]->w;
+    p[i] = vec3((v[i]->x * invW * 0.5f + 0.5f) * width, (v[i]->y * invW * 0.5f + 0.5f) * height, v[i]->z * invW);
+  }
+
+  //Make the triangle counter clockwise so edge functions are positive inside
+  f32 area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+  if (fabsf(area) < 1e-6f)
+  {
+    emptyTriangle(triangle);
+    return;
+  }
+
+  if (area < 0.0f)
+  {
+    vec3 tmp = p[1];
+    p[1] = p[2];
+    p[2] = tmp;
+    area = -area;
+  }
+
+  //Pixels whose center is inside the bounding box, clamped to the buffer
+  f32 minX = minValue(p[0].x, minValue(p[1].x, p[2].x));
+  f32 maxX = maxValue(p[0].x, maxValue(p[1].x, p[2].x));
+  f32 minY = minValue(p[0].y, minValue(p[1].y, p[2].y));
+  f32 maxY = maxValue(p[0].y, maxValue(p[1].y, p[2].y));
+  triangle->minX = (int32_t)ceilf(clamp(-1.0f, (f32)width, minX - 0.5f));
+  triangle->maxX = (int32_t)floorf(clamp(-1.0f, (f32)width, maxX - 0.5f));
+  triangle->minY = (int32_t)ceilf(clamp(-1.0f, (f32)height, minY - 0.5f));
+  triangle->maxY = (int32_t)floorf(clamp(-1.0f, (f32)height, maxY - 0.5f));
+  triangle->minX = maxValue(triangle->minX, 0);
+  triangle->maxX = minValue(triangle->maxX, (int32_t)width - 1);
+  triangle->minY = maxValue(triangle->minY, 0);
+  triangle->maxY = minValue(triangle->maxY, (int32_t)height - 1);
+  if (triangle->minY > triangle->maxY)
+    emptyTriangle(triangle);
+
+  //Edge from a to b: (a.y - b.y) * x + (b.x - a.x) * y + (a.x * b.y - a.y * b.x)
+  for (uint32_t i(0); i < 3; ++i)
+  {
+    const vec3& a = p[i];
+    const vec3& b = p[(i + 1) % 3];
+    triangle->edge[i][0] = a.y - b.y;
+    triangle->edge[i][1] = b.x - a.x;
+    triangle->edge[i][2] = a.x * b.y - a.y * b.x;
+  }
+
+  //Depth plane. Offset to the furthest corner of the pixel so the depth buffer is never closer than the triangle
+  f32 invArea = 1.0f / area;
+  f32 a = ((p[1].z - p[0].z) * (p[2].y - p[0].y) - (p[2].z - p[0].z) * (p[1].y - p[0].y)) * invArea;
+  f32 b = ((p[1].x - p[0].x) * (p[2].z - p[0].z) - (p[2].x - p[0].x) * (p[1].z - p[0].z)) * invArea;
+  triangle->depth[0] = a;
+  triangle->depth[1] = b;
+  triangle->depth[2] = p[0].z - a * p[0].x - b * p[0].y + 0.5f * (fabsf(a) + fabsf(b));
+}
+
+//Clips the triangle against the near plane (z = -w) and sets up the resulting triangles (zero, one or two)
+static void clipAndSetupTriangle(const vec4& v0, const vec4& v1, const vec4& v2, uint32_t width, uint32_t height, triangle_t* triangle)
+{
+  emptyTriangle(&triangle[0]);
+  emptyTriangle(&triangle[1]);
+
+  //Trivially reject triangles completely outside one of the side planes
+  const vec4* v[3] = { &v0, &v1, &v2 };
+  if ((v0.x > v0.w && v1.x > v1.w && v2.x > v2.w) || (v0.x < -v0.w && v1.x < -v1.w && v2.x < -v2.w) ||
+      (v0.y > v0.w && v1.y > v1.w && v2.y > v2.w) || (v0.y < -v0.w && v1.y < -v1.w && v2.y < -v2.w))
+  {
+    return;
+  }
+
+  f32 distance[3];
+  uint32_t insideCount = 0u;
+  for (uint32_t i(0); i < 3; ++i)
+  {
+    distance[i] = v[i]->z + v[i]->w;
+    if (distance[i] >= 0.0f)
+      insideCount++;
+  }
+
+  if (insideCount == 0u)
+    return;
+
+  if (insideCount == 3u)
+  {
+    setupTriangle(v0, v1, v2, width, height, &triangle[0]);
+    return;
+  }
+
+  vec4 polygon[4];
+  uint32_t vertexCount = 0u;
+  for (uint32_t i(0); i < 3; ++i)
+  {
+    uint32_t next = (i + 1) % 3;
+    if (distance[i] >= 0.0f)
+      polygon[vertexCount++] = *v[i];
+
+    if ((distance[i] >= 0.0f) != (distance[next] >= 0.0f))
+    {
+      f32 t = distance[i] / (distance[i] - distance[next]);
+      polygon[vertexCount++] = *v[i] + (*v[next] - *v[i]) * t;
+    }
+  }
+
+  setupTriangle(polygon[0], polygon[1], polygon[2], width, height, &triangle[0]);
+  if (vertexCount == 4u)
+    setupTriangle(polygon[0], polygon[2], polygon[3], width, height, &triangle[1]);
+}
+
+static void rasterizeTriangle(const triangle_t& triangle, int32_t beginY, int32_t endY, uint32_t width, f32* depth)
+{
+  int32_t minY = maxValue(triangle.minY, beginY);
+  int32_t maxY = minValue(triangle.maxY, endY - 1);
+
+#ifdef BKK_MATHS_SSE
+  //Four pixels at a time
+  const __m128 pixelOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+  __m128 edgeA[3];
+  for (uint32_t i(0); i < 3; ++i)
+    edgeA[i] = _mm_set1_ps(triangle.edge[i][0]);
+  __m128 depthA = _mm_set1_ps(triangle.depth[0]);
+
+  int32_t minX = triangle.minX & ~3;
+  for (int32_t y(minY); y <= maxY; ++y)
+  {
+    f32 pixelY = (f32)y + 0.5f;
+    __m128 edgeRow[3];
+    for (uint32_t i(0); i < 3; ++i)
+      edgeRow[i] = _mm_set1_ps(triangle.edge[i][1] * pixelY + triangle.edge[i][2]);
+    __m128 depthRow = _mm_set1_ps(triangle.depth[1] * pixelY + triangle.depth[2]);
+
+    f32* row = depth + y * width;
+    for (int32_t x(minX); x <= triangle.maxX; x += 4)
+    {
+      __m128 pixelX = _mm_add_ps(_mm_set1_ps((f32)x), pixelOffset);
+      __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], pixelX), edgeRow[0]), zero),
+                                            _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], pixelX), edgeRow[1]), zero)),
+                                 _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], pixelX), edgeRow[2]), zero));
+      if (_mm_movemask_ps(inside) == 0)
+        continue;
+
+      __m128 current = _mm_loadu_ps(row + x);
+      __m128 triangleDepth = _mm_min_ps(_mm_add_ps(_mm_mul_ps(depthA, pixelX), depthRow), current);
+      _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, triangleDepth), _mm_andnot_ps(inside, current)));
+    }
+  }
+#else
+  for (int32_t y(minY); y <= maxY; ++y)
+  {
+    f32 pixelY = (f32)y + 0.5f;
+    f32 edgeRow[3];
+    for (uint32_t i(0); i < 3; ++i)
+      edgeRow[i] = triangle.edge[i][1] * pixelY + triangle.edge[i][2];
+    f32 depthRow = triangle.depth[1] * pixelY + triangle.depth[2];
+
+    f32* row = depth + y * width;
+    for (int32_t x(triangle.minX); x <= triangle.maxX; ++x)
+    {
+      f32 pixelX = (f32)x + 0.5f;
+      if (triangle.edge[0][0] * pixelX + edgeRow[0] >= 0.0f &&
+          triangle.edge[1][0] * pixelX + edgeRow[1] >= 0.0f &&
+          triangle.edge[2][0] * pixelX + edgeRow[2] >= 0.0f)
+      {
+        row[x] = minValue(row[x], triangle.depth[0] * pixelX + depthRow);
+      }
+    }
+  }
+#endif
+}
+
+void culling::rasterizeOccluders(const occluder_t* occluders, uint32_t occluderCount, const mat4& viewProjection,
+                                 uint32_t width, uint32_t height, thread_pool_t* pool, occlusion_rasterizer_t* rasterizer, f32* depth)
+{
+  assert((width & 3u) == 0u);
+
+  //Offsets of each occluder in the vertex and triangle arrays
+  rasterizer->vertexOffset.resize(occluderCount + 1);
+  rasterizer->triangleOffset.resize(occluderCount + 1);
+  rasterizer->vertexOffset[0] = rasterizer->triangleOffset[0] = 0u;
+  for (uint32_t i(0); i < occluderCount; ++i)
+  {
+    rasterizer->vertexOffset[i + 1] = rasterizer->vertexOffset[i] + occluders[i].vertexCount;
+    rasterizer->triangleOffset[i + 1] = rasterizer->triangleOffset[i] + occluders[i].triangleCount;
+  }
+
+  rasterizer->clipVertex.resize(rasterizer->vertexOffset[occluderCount]);
+  rasterizer->triangle.resize(2u * rasterizer->triangleOffset[occluderCount]);
+
+  //Transform vertices to clip space and set up triangles
+  forEach(pool, 0u, occluderCount, 1u,
+    [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t i(begin); i < end; ++i)
+      {
+        const occluder_t& occluder = occluders[i];
+        mat4 modelViewProjection = occluder.transform * viewProjection;
+        vec4* clipVertex = rasterizer->clipVertex.data() + rasterizer->vertexOffset[i];
+        for (uint32_t v(0); v < occluder.vertexCount; ++v)
+          clipVertex[v] = vec4(occluder.vertex[v].x, occluder.vertex[v].y, occluder.vertex[v].z, 1.0f) * modelViewProjection;
+
+        triangle_t* triangle = rasterizer->triangle.data() + 2u * rasterizer->triangleOffset[i];
+        for (uint32_t t(0); t < occluder.triangleCount; ++t)
+        {
+          const uint32_t* index = occluder.index + 3u * t;
+          clipAndSetupTriangle(clipVertex[index[0]], clipVertex[index[1]], clipVertex[index[2]], width, height, &triangle[2u * t]);
+        }
+      }
+    }
+  );
+
+  //Each band clears its rows and rasterizes all the triangles overlapping it. Triangles are always
+  //rasterized in the same order and depth test keeps the minimum, so the result is deterministic
+  uint32_t bandCount = (height + BAND_HEIGHT - 1u) / BAND_HEIGHT;
+  uint32_t triangleCount = (uint32_t)rasterizer->triangle.size();
+  forEach(pool, 0u, bandCount, 1u,
+    [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t band(begin); band < end; ++band)
+      {
+        uint32_t beginY = band * BAND_HEIGHT;
+        uint32_t endY = minValue((band + 1u) * BAND_HEIGHT, height);
+        for (uint32_t i(beginY * width); i < endY * width; ++i)
+          depth[i] = 1.0f;
+
+        for (uint32_t t(0); t < triangleCount; ++t)
+        {
+          const triangle_t& triangle = rasterizer->triangle[t];
+          if (triangle.minX <= triangle.maxX && triangle.minY < (int32_t)endY && triangle.maxY >= (int32_t)beginY)
+            rasterizeTriangle(triangle, (int32_t)beginY, (int32_t)endY, width, depth);
+        }
+      }
+    }
+  );
+}
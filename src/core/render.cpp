@@ -14,6 +14,8 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string>
+#include <algorithm>
+#include <thread>
 
 using namespace bkk::core;
 using namespace bkk::core::render;
@@ -34,11 +36,25 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugReportFlagsEXT flags,
   return VK_FALSE;
 }
   
+static const VkDeviceSize DEFAULT_MEMORY_BLOCK_SIZE = 64u * 1024u * 1024u;
+static const VkDeviceSize UPLOAD_RING_ALIGNMENT = 16u;
+
 static VkDeviceSize getNextMultiple(VkDeviceSize from, VkDeviceSize multiple)
 {
   return ((from + multiple - 1) / multiple) * multiple;
 }
 
+//Images are allocated in whole pages of bufferImageGranularity so they never share a page with a buffer
+static gpu_memory_t imageMemoryAllocate(const context_t& context, VkImage image)
+{
+  VkMemoryRequirements requirements = {};
+  vkGetImageMemoryRequirements(context.device, image, &requirements);
+
+  VkDeviceSize granularity = context.memoryAllocator ? context.memoryAllocator->bufferImageGranularity : 1u;
+  VkDeviceSize alignment = requirements.alignment > granularity ? requirements.alignment : granularity;
+  return gpuMemoryAllocate(context, getNextMultiple(requirements.size, granularity), alignment, requirements.memoryTypeBits, DEVICE_LOCAL);
+}
+
 static int32_t getQueueIndex(const VkPhysicalDevice* physicalDevice, VkQueueFlagBits queueType)
 {
   //Get number of queue families
@@ -279,9 +295,7 @@ static void createDepthStencilBuffer(const context_t* context, uint32_t width, u
   vkCreateImage(context->device, &imageCreateInfo, nullptr, &depthStencilBuffer->image);
 
   //Allocate and bind memory for the image.
-  VkMemoryRequirements requirements = {};
-  vkGetImageMemoryRequirements(context->device, depthStencilBuffer->image, &requirements);
-  depthStencilBuffer->memory = gpuMemoryAllocate(*context, requirements.size, requirements.alignment, requirements.memoryTypeBits, DEVICE_LOCAL);
+  depthStencilBuffer->memory = imageMemoryAllocate(*context, depthStencilBuffer->image);
   vkBindImageMemory(context->device, depthStencilBuffer->image, depthStencilBuffer->memory.handle, depthStencilBuffer->memory.offset);
 
   //Create command buffer
@@ -408,17 +422,12 @@ static void createSwapChain(context_t* context,
   uint32_t width, uint32_t height,
   uint32_t imageCount)
 {
-  //Create semaphores
-  VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-  semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  vkCreateSemaphore(context->device, &semaphoreCreateInfo, nullptr, &context->swapChain.imageAcquired);
-  vkCreateSemaphore(context->device, &semaphoreCreateInfo, nullptr, &context->swapChain.renderingComplete);
-
   VkExtent2D swapChainSize = { width, height };
   context->swapChain.imageWidth = width;
   context->swapChain.imageHeight = height;
   context->swapChain.imageCount = imageCount;
   context->swapChain.currentImage = 0;
+  context->swapChain.imageAcquired = false;
 
   //Create the swapchain
   VkSwapchainCreateInfoKHR swapchainCreateInfo = {};
@@ -465,7 +474,7 @@ static void createSwapChain(context_t* context,
     vkCreateImageView(context->device, &imageViewCreateInfo, nullptr, &context->swapChain.imageView[i]);
 
     commandBufferCreate(*context, VK_COMMAND_BUFFER_LEVEL_PRIMARY, nullptr, nullptr, 0u,
-      &context->swapChain.renderingComplete, 1u, command_buffer_t::GRAPHICS, VK_NULL_HANDLE,
+      nullptr, 0u, command_buffer_t::GRAPHICS, VK_NULL_HANDLE,
       &context->swapChain.commandBuffer[i]);
 
   }
@@ -497,6 +506,43 @@ static void createSwapChain(context_t* context,
   }
 }
 
+static void createFrameSynchronization(context_t* context, uint32_t frameCount)
+{
+  context->swapChain.frameCount = frameCount;
+  context->swapChain.currentFrame = 0u;
+  context->swapChain.imageAvailable.resize(frameCount);
+  context->swapChain.renderingComplete.resize(frameCount);
+  context->swapChain.frameComplete.resize(frameCount);
+
+  VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+  semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  VkFenceCreateInfo fenceCreateInfo = {};
+  fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+  for (uint32_t i(0); i < frameCount; ++i)
+  {
+    vkCreateSemaphore(context->device, &semaphoreCreateInfo, nullptr, &context->swapChain.imageAvailable[i]);
+    vkCreateSemaphore(context->device, &semaphoreCreateInfo, nullptr, &context->swapChain.renderingComplete[i]);
+    vkCreateFence(context->device, &fenceCreateInfo, nullptr, &context->swapChain.frameComplete[i]);
+  }
+}
+
+static void destroyFrameSynchronization(context_t* context)
+{
+  for (uint32_t i(0); i < context->swapChain.frameCount; ++i)
+  {
+    vkDestroySemaphore(context->device, context->swapChain.imageAvailable[i], nullptr);
+    vkDestroySemaphore(context->device, context->swapChain.renderingComplete[i], nullptr);
+    vkDestroyFence(context->device, context->swapChain.frameComplete[i], nullptr);
+  }
+
+  context->swapChain.imageAvailable.clear();
+  context->swapChain.renderingComplete.clear();
+  context->swapChain.frameComplete.clear();
+}
+
 static VkCommandPool createCommandPool(VkDevice device, uint32_t queueIndex)
 {
   VkCommandPool pool;
@@ -536,6 +582,18 @@ void render::contextCreate(const char* applicationName,
   const window::window_t& window,
   uint32_t swapChainImageCount,
   context_t* context)
+{
+  //Two frames in flight, like renderer_t. Applications writing in place to resources the GPU reads every frame have
+  //to ask for a single frame in flight, or keep one copy of the resources per frame (see getFrameIndex)
+  contextCreate(applicationName, engineName, window, swapChainImageCount, 2u, context);
+}
+
+void render::contextCreate(const char* applicationName,
+  const char* engineName,
+  const window::window_t& window,
+  uint32_t swapChainImageCount,
+  uint32_t framesInFlight,
+  context_t* context)
 {
   context->instance = createInstance(applicationName, engineName);
   createDeviceAndQueues(context->instance, &context->physicalDevice, &context->device, &context->graphicsQueue, &context->computeQueue);
@@ -543,6 +601,10 @@ void render::contextCreate(const char* applicationName,
   //Get memory properties of the physical device
   vkGetPhysicalDeviceMemoryProperties(context->physicalDevice, &context->memoryProperties);
 
+  //Memory allocator used by default. Small resources (e.g uniform buffers) share blocks instead of getting their own device memory
+  context->memoryAllocator = new gpu_memory_allocator_t;
+  gpuAllocatorCreate(*context, DEFAULT_MEMORY_BLOCK_SIZE, 0xFFFFFFFF, 0u, context->memoryAllocator);
+
   context->commandPool = createCommandPool(context->device, context->graphicsQueue.queueIndex);
   
   importFunctions(context->instance, context->device, context);
@@ -557,12 +619,12 @@ void render::contextCreate(const char* applicationName,
 
   createSurface(context->instance, context->physicalDevice, window, *context, &context->surface);
   createSwapChain(context, window.width, window.height, swapChainImageCount);
+  createFrameSynchronization(context, framesInFlight > 0u ? framesInFlight : 1u);
 }
 
 void render::contextDestroy(context_t* context)
 {
-  vkDestroySemaphore(context->device, context->swapChain.imageAcquired, nullptr);
-  vkDestroySemaphore(context->device, context->swapChain.renderingComplete, nullptr);
+  destroyFrameSynchronization(context);
 
   for (uint32_t i = 0; i < context->swapChain.imageCount; ++i)
   {
@@ -585,6 +647,10 @@ void render::contextDestroy(context_t* context)
   context->vkDestroyDebugReportCallbackEXT(context->instance, context->debugCallback, nullptr);
 #endif
 
+  gpuAllocatorDestroy(*context, context->memoryAllocator);
+  delete context->memoryAllocator;
+  context->memoryAllocator = nullptr;
+
   vkDestroyDevice(context->device, nullptr);
   vkDestroyInstance(context->instance, nullptr);
 }
@@ -682,20 +748,45 @@ void render::endPresentationCommandBuffer(const context_t& context, uint32_t ind
   vkEndCommandBuffer(context.swapChain.commandBuffer[index].handle);
 }
 
+uint32_t render::acquireNextImage(context_t* context)
+{
+  if (!context->swapChain.imageAcquired)
+  {
+    context->vkAcquireNextImageKHR(context->device,
+      context->swapChain.handle,
+      UINT64_MAX, context->swapChain.imageAvailable[context->swapChain.currentFrame],
+      VK_NULL_HANDLE, &context->swapChain.currentImage);
+
+    context->swapChain.imageAcquired = true;
+  }
+
+  return context->swapChain.currentImage;
+}
+
+uint32_t render::getFrameIndex(const context_t& context)
+{
+  return context.swapChain.currentFrame;
+}
+
+uint32_t render::getFrameCount(const context_t& context)
+{
+  return context.swapChain.frameCount;
+}
+
 void render::presentFrame(context_t* context, VkSemaphore* waitSemaphore, uint32_t waitSemaphoreCount)
 {
-  //Aquire next image in the swapchain
-  context->vkAcquireNextImageKHR(context->device,
-    context->swapChain.handle,
-    UINT64_MAX, context->swapChain.imageAcquired,
-    VK_NULL_HANDLE, &context->swapChain.currentImage);
+  uint32_t currentImage = acquireNextImage(context);
+  uint32_t currentFrame = context->swapChain.currentFrame;
 
-  uint32_t currentImage = context->swapChain.currentImage;
+  //Command buffer of the image can still be executing if the image was presented less than frameCount frames ago
+  const command_buffer_t& commandBuffer = context->swapChain.commandBuffer[currentImage];
+  vkWaitForFences(context->device, 1u, &commandBuffer.fence, VK_TRUE, UINT64_MAX);
+  vkResetFences(context->device, 1u, &commandBuffer.fence);
 
   //Submit current command buffer  
   std::vector<VkSemaphore> waitSemaphoreList(1 + waitSemaphoreCount);
   std::vector<VkPipelineStageFlags> waitStageList(1 + waitSemaphoreCount);
-  waitSemaphoreList[0] = context->swapChain.imageAcquired;
+  waitSemaphoreList[0] = context->swapChain.imageAvailable[currentFrame];
   waitStageList[0] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
   for (uint32_t i(0); i < waitSemaphoreCount; ++i)
   {
@@ -708,26 +799,30 @@ void render::presentFrame(context_t* context, VkSemaphore* waitSemaphore, uint32
   submitInfo.waitSemaphoreCount = (uint32_t)waitSemaphoreList.size();
   submitInfo.pWaitSemaphores = waitSemaphoreList.data();	      //Wait until image is aquired
   submitInfo.signalSemaphoreCount = 1u;
-  submitInfo.pSignalSemaphores = &context->swapChain.renderingComplete;	//When command buffer has finished will signal renderingCompleteSemaphore
+  submitInfo.pSignalSemaphores = &context->swapChain.renderingComplete[currentFrame];	//When command buffer has finished will signal renderingCompleteSemaphore
   submitInfo.pWaitDstStageMask = waitStageList.data();
   submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &context->swapChain.commandBuffer[currentImage].handle;
-  vkQueueSubmit(context->graphicsQueue.handle, 1, &submitInfo, VK_NULL_HANDLE);
+  submitInfo.pCommandBuffers = &commandBuffer.handle;
+  vkQueueSubmit(context->graphicsQueue.handle, 1, &submitInfo, commandBuffer.fence);
   
   //Present the image
   VkPresentInfoKHR presentInfo = {};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
   presentInfo.waitSemaphoreCount = 1;
-  presentInfo.pWaitSemaphores = &context->swapChain.renderingComplete;	//Wait until rendering has finished
+  presentInfo.pWaitSemaphores = &context->swapChain.renderingComplete[currentFrame];	//Wait until rendering has finished
   presentInfo.swapchainCount = 1;
   presentInfo.pSwapchains = &context->swapChain.handle;
   presentInfo.pImageIndices = &currentImage;
   context->vkQueuePresentKHR(context->graphicsQueue.handle, &presentInfo);
 
-  //Submit presentation
-  vkResetFences(context->device, 1, &context->swapChain.commandBuffer[currentImage].fence);
-  vkQueueSubmit(context->graphicsQueue.handle, 0, nullptr, context->swapChain.commandBuffer[currentImage].fence);
-  vkWaitForFences(context->device, 1, &context->swapChain.commandBuffer[currentImage].fence, VK_TRUE, UINT64_MAX);
+  //Empty submission signals the fence of the frame once all the work submitted before is done
+  vkResetFences(context->device, 1, &context->swapChain.frameComplete[currentFrame]);
+  vkQueueSubmit(context->graphicsQueue.handle, 0, nullptr, context->swapChain.frameComplete[currentFrame]);
+
+  //Next frame reuses the semaphores and per-frame resources of the frame submitted frameCount frames ago
+  context->swapChain.imageAcquired = false;
+  context->swapChain.currentFrame = (currentFrame + 1u) % context->swapChain.frameCount;
+  vkWaitForFences(context->device, 1, &context->swapChain.frameComplete[context->swapChain.currentFrame], VK_TRUE, UINT64_MAX);
 }
 
 bool render::shaderCreateFromSPIRV(const context_t& context, shader_t::type_e type, const char* file, shader_t* shader)
@@ -838,47 +933,105 @@ void render::shaderDestroy(const context_t& context, shader_t* shader)
   vkDestroyShaderModule(context.device, shader->handle, nullptr);
 }
 
+static VkMemoryPropertyFlags getMemoryProperties(uint32_t flags)
+{
+  return (flags & HOST_VISIBLE ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT : 0) |
+    (flags & DEVICE_LOCAL ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : 0) |
+    (flags & HOST_COHERENT ? VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : 0);
+}
+
+//Allocates device memory of the given type. Host visible memory is mapped
+static bool deviceMemoryAllocate(const context_t& context, VkDeviceSize size, uint32_t memoryType, VkDeviceMemory* memory, void** mapping)
+{
+  VkMemoryAllocateInfo memoryAllocateInfo = {};
+  memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  memoryAllocateInfo.memoryTypeIndex = memoryType;
+  memoryAllocateInfo.allocationSize = size;
+  if (vkAllocateMemory(context.device, &memoryAllocateInfo, nullptr, memory) != VK_SUCCESS)
+    return false;
+
+  *mapping = nullptr;
+  if (context.memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    vkMapMemory(context.device, *memory, 0u, VK_WHOLE_SIZE, 0u, mapping);
+
+  return true;
+}
+
 gpu_memory_t render::gpuMemoryAllocate(const context_t& context,
   VkDeviceSize size, VkDeviceSize alignment,
   uint32_t memoryTypes, uint32_t flags,
   gpu_memory_allocator_t* allocator)
 {
-  gpu_memory_t result = { VK_NULL_HANDLE, 0u, 0u };
+  gpu_memory_t result = { VK_NULL_HANDLE, 0u, 0u, nullptr, tlsf_allocator_t::INVALID_ALLOCATION, nullptr };
 
   if (allocator == nullptr)
+    allocator = context.memoryAllocator;
+
+  //Allocations bigger than half a block get their own memory
+  bool dedicated = allocator == nullptr || size > allocator->blockSize / 2u;
+  if (allocator)
   {
-    VkMemoryPropertyFlags properties = (flags & HOST_VISIBLE ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT : 0) |
-      (flags & DEVICE_LOCAL ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : 0) |
-      (flags & HOST_COHERENT ? VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : 0);
+    memoryTypes &= allocator->memoryTypes;
+    flags |= allocator->flags;
+  }
+
+  VkMemoryPropertyFlags properties = getMemoryProperties(flags);
+  for (uint32_t i = 0; i < context.memoryProperties.memoryTypeCount; i++)
+  {
+    if (!CHECK_BIT(memoryTypes, i) || ((context.memoryProperties.memoryTypes[i].propertyFlags & properties) != properties))
+      continue;
 
-    for (uint32_t i = 0; i < context.memoryProperties.memoryTypeCount; i++)
+    if (dedicated)
     {
-      if ((CHECK_BIT(memoryTypes, i)) && ((context.memoryProperties.memoryTypes[i].propertyFlags & properties) == properties))
+      if (deviceMemoryAllocate(context, size, i, &result.handle, &result.mapping))
       {
-        //Try allocating the memory
-        VkMemoryAllocateInfo memoryAllocateInfo = {};
-        memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memoryAllocateInfo.memoryTypeIndex = i;
-        memoryAllocateInfo.allocationSize = size;
-        VkDeviceMemory memory;
-        if (vkAllocateMemory(context.device, &memoryAllocateInfo, nullptr, &memory) == VK_SUCCESS)
+        result.size = size;
+        result.allocator = allocator;
+        if (allocator)
         {
-          result.handle = memory;
-          result.size = size;
-          return result;
+          std::lock_guard<std::mutex> lock(allocator->mutex);
+          allocator->dedicatedAllocationCount++;
         }
+
+        return result;
       }
+
+      continue;
     }
-  }
-  else
-  {
-    VkDeviceSize offset = getNextMultiple(allocator->head, alignment);
-    if (size <= allocator->size - offset)
+
+    std::lock_guard<std::mutex> lock(allocator->mutex);
+
+    //Try the existing blocks of the memory type and allocate a new block if none of them has space
+    uint32_t blockCount = (uint32_t)allocator->block.size();
+    for (uint32_t j(0); j <= blockCount; ++j)
     {
-      result.handle = allocator->memory;
-      result.size = size;
-      result.offset = offset;
-      allocator->head = offset + size;
+      if (j == blockCount)
+      {
+        gpu_memory_allocator_t::block_t block;
+        if (!deviceMemoryAllocate(context, allocator->blockSize, i, &block.memory, &block.mapping))
+          break;
+
+        block.memoryType = i;
+        block.allocator.init(allocator->blockSize);
+        allocator->block.push_back(block);
+      }
+
+      gpu_memory_allocator_t::block_t& block = allocator->block[j];
+      if (block.memoryType != i)
+        continue;
+
+      uint64_t offset;
+      uint32_t allocation = block.allocator.allocate(size, alignment, &offset);
+      if (allocation != tlsf_allocator_t::INVALID_ALLOCATION)
+      {
+        result.handle = block.memory;
+        result.offset = offset;
+        result.size = size;
+        result.mapping = block.mapping ? (uint8_t*)block.mapping + offset : nullptr;
+        result.allocation = allocation;
+        result.allocator = allocator;
+        return result;
+      }
     }
   }
 
@@ -887,18 +1040,63 @@ gpu_memory_t render::gpuMemoryAllocate(const context_t& context,
 
 void render::gpuMemoryDeallocate(const context_t& context, gpu_memory_allocator_t* allocator, gpu_memory_t memory)
 {
-  if (allocator == nullptr)
+  if (memory.handle == VK_NULL_HANDLE)
+    return;
+
+  //Deallocating from a different allocator would leak sub-allocations and unbalance the count of dedicated allocations
+  assert(allocator == nullptr || allocator == memory.allocator);
+  allocator = memory.allocator;
+
+  if (memory.allocation == tlsf_allocator_t::INVALID_ALLOCATION)
   {
     vkFreeMemory(context.device, memory.handle, nullptr);
+    if (allocator)
+    {
+      std::lock_guard<std::mutex> lock(allocator->mutex);
+      allocator->dedicatedAllocationCount--;
+    }
+
+    return;
   }
-  else
+
+  if (allocator == nullptr)
+    return;
+
+  std::lock_guard<std::mutex> lock(allocator->mutex);
+  std::vector<gpu_memory_allocator_t::block_t>& blocks = allocator->block;
+  for (uint32_t i(0); i < blocks.size(); ++i)
   {
-    // TODO
+    if (blocks[i].memory != memory.handle)
+      continue;
+
+    blocks[i].allocator.deallocate(memory.allocation);
+
+    //Release the block once it is empty, unless it's the last one of its memory type
+    if (blocks[i].allocator.isEmpty())
+    {
+      for (uint32_t j(0); j < blocks.size(); ++j)
+      {
+        if (j != i && blocks[j].memoryType == blocks[i].memoryType)
+        {
+          vkFreeMemory(context.device, blocks[i].memory, nullptr);
+          blocks.erase(blocks.begin() + i);
+          break;
+        }
+      }
+    }
+
+    return;
   }
+
+  //Blocks are alive while they have sub-allocations, so the memory was not sub-allocated from this allocator
+  assert(false);
 }
 
 void* render::gpuMemoryMap(const context_t& context, gpu_memory_t memory)
 {
+  if (memory.mapping)
+    return memory.mapping;
+
   void* result = nullptr;
   vkMapMemory(context.device, memory.handle, memory.offset, memory.size, 0u, &result);
   return result;
@@ -906,6 +1104,9 @@ void* render::gpuMemoryMap(const context_t& context, gpu_memory_t memory)
 
 void* render::gpuMemoryMap(const context_t& context, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, gpu_memory_t memory)
 {
+  if (memory.mapping)
+    return (uint8_t*)memory.mapping + offset;
+
   if (size == VK_WHOLE_SIZE)
   {
     size = memory.size - offset;
@@ -919,23 +1120,70 @@ void* render::gpuMemoryMap(const context_t& context, VkDeviceSize offset, VkDevi
 
 void render::gpuMemoryUnmap(const context_t& context, gpu_memory_t memory)
 {
-  vkUnmapMemory(context.device, memory.handle);
+  //Memory mapped persistently stays mapped until it is released
+  if (memory.mapping == nullptr)
+    vkUnmapMemory(context.device, memory.handle);
 }
 
 
-void render::gpuAllocatorCreate(const context_t& context, size_t size,
+void render::gpuAllocatorCreate(const context_t& context, size_t blockSize,
   uint32_t memoryTypes, uint32_t flags,
   gpu_memory_allocator_t* allocator)
 {
-  gpu_memory_t memory = gpuMemoryAllocate(context, size, 0u, memoryTypes, flags);
-  allocator->memory = memory.handle;
-  allocator->size = size;
-  allocator->head = 0;
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(context.physicalDevice, &properties);
+
+  allocator->blockSize = blockSize;
+  allocator->memoryTypes = memoryTypes;
+  allocator->flags = flags;
+  allocator->bufferImageGranularity = properties.limits.bufferImageGranularity;
+  allocator->dedicatedAllocationCount = 0u;
+  allocator->block.clear();
 }
 
 void render::gpuAllocatorDestroy(const context_t& context, gpu_memory_allocator_t* allocator)
 {
-  vkFreeMemory(context.device, allocator->memory, nullptr);
+  for (uint32_t i(0); i < allocator->block.size(); ++i)
+    vkFreeMemory(context.device, allocator->block[i].memory, nullptr);
+
+  allocator->block.clear();
+}
+
+void render::gpuAllocatorGetStats(gpu_memory_allocator_t* allocator, gpu_memory_allocator_stats_t* stats)
+{
+  std::lock_guard<std::mutex> lock(allocator->mutex);
+
+  *stats = {};
+  stats->blockCount = (uint32_t)allocator->block.size();
+  stats->dedicatedAllocationCount = allocator->dedicatedAllocationCount;
+  for (uint32_t i(0); i < allocator->block.size(); ++i)
+  {
+    const tlsf_allocator_t& blockAllocator = allocator->block[i].allocator;
+    stats->allocationCount += blockAllocator.getAllocationCount();
+    stats->blockMemory += blockAllocator.getSize();
+    stats->usedMemory += blockAllocator.getUsedSize();
+    if (blockAllocator.getLargestFreeRange() > stats->largestFreeRange)
+      stats->largestFreeRange = blockAllocator.getLargestFreeRange();
+  }
+}
+
+void render::gpuAllocatorReleaseEmptyBlocks(const context_t& context, gpu_memory_allocator_t* allocator)
+{
+  std::lock_guard<std::mutex> lock(allocator->mutex);
+
+  std::vector<gpu_memory_allocator_t::block_t>& blocks = allocator->block;
+  for (uint32_t i(0); i < blocks.size();)
+  {
+    if (blocks[i].allocator.isEmpty())
+    {
+      vkFreeMemory(context.device, blocks[i].memory, nullptr);
+      blocks.erase(blocks.begin() + i);
+    }
+    else
+    {
+      ++i;
+    }
+  }
 }
 
 static VkFormat getImageFormat(const image::image2D_t& image)
@@ -992,9 +1240,7 @@ void render::texture2DCreate(const context_t& context, const image::image2D_t* i
 
   //Allocate and bind memory for the image.
   //note: Memory for the image is not host visible so we will need a host visible buffer to transfer the data
-  VkMemoryRequirements requirements = {};
-  vkGetImageMemoryRequirements(context.device, texture->image, &requirements);
-  texture->memory = gpuMemoryAllocate(context, requirements.size, requirements.alignment, requirements.memoryTypeBits, DEVICE_LOCAL);
+  texture->memory = imageMemoryAllocate(context, texture->image);
   vkBindImageMemory(context.device, texture->image, texture->memory.handle, texture->memory.offset);
 
   //Upload data to the texture using an staging buffer
@@ -1006,12 +1252,13 @@ void render::texture2DCreate(const context_t& context, const image::image2D_t* i
   VkBufferCreateInfo bufferCreateInfo = {};
   bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferCreateInfo.pNext = nullptr;
-  bufferCreateInfo.size = requirements.size;
+  bufferCreateInfo.size = texture->memory.size;
   bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
   bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   vkCreateBuffer(context.device, &bufferCreateInfo, nullptr, &stagingBuffer);
 
   //Allocate and bind memory to the buffer
+  VkMemoryRequirements requirements = {};
   vkGetBufferMemoryRequirements(context.device, stagingBuffer, &requirements);
   gpu_memory_t stagingBufferMemory;
   stagingBufferMemory = gpuMemoryAllocate(context, requirements.size, requirements.alignment, requirements.memoryTypeBits, HOST_VISIBLE);
@@ -1188,10 +1435,8 @@ void render::texture2DCreate(const context_t& context,
 
   //Allocate and bind memory for the image.
   //note: Memory for the image is not host visible so we will need a host visible buffer to transfer the data
-  VkMemoryRequirements requirements = {};
-  vkGetImageMemoryRequirements(context.device, texture->image, &requirements);
-  texture->memory = gpuMemoryAllocate(context, requirements.size, requirements.alignment, requirements.memoryTypeBits, DEVICE_LOCAL);
-  vkBindImageMemory(context.device, texture->image, texture->memory.handle, 0);
+  texture->memory = imageMemoryAllocate(context, texture->image);
+  vkBindImageMemory(context.device, texture->image, texture->memory.handle, texture->memory.offset);
 
   //Create imageview
   VkImageViewCreateInfo imageViewCreateInfo = {};
@@ -1261,9 +1506,7 @@ void render::textureCubemapCreate(const context_t& context, VkFormat format, uin
 
   //Allocate and bind memory for the image.
   //note: Memory for the image is not host visible so we will need a host visible buffer to transfer the data
-  VkMemoryRequirements requirements = {};
-  vkGetImageMemoryRequirements(context.device, texture->image, &requirements);
-  texture->memory = gpuMemoryAllocate(context, requirements.size, requirements.alignment, requirements.memoryTypeBits, DEVICE_LOCAL);
+  texture->memory = imageMemoryAllocate(context, texture->image);
   vkBindImageMemory(context.device, texture->image, texture->memory.handle, texture->memory.offset);
 
   //Create imageview
@@ -1672,7 +1915,7 @@ void render::gpuBufferCreate(const context_t& context,
   vkGetBufferMemoryRequirements(context.device, buffer->handle, &requirements);
 
   //Allocate memory for the buffer
-  buffer->memory = gpuMemoryAllocate(context, requirements.size, requirements.alignment, 0xFFFF, memoryType, allocator);
+  buffer->memory = gpuMemoryAllocate(context, requirements.size, requirements.alignment, requirements.memoryTypeBits, memoryType, allocator);
 
   //Bind memory to the buffer
   vkBindBufferMemory(context.device, buffer->handle, buffer->memory.handle, buffer->memory.offset);
@@ -1716,7 +1959,7 @@ void render::gpuBufferUpdate(const context_t& context, void* data, size_t offset
 
 void* render::gpuBufferMap(const context_t& context, const gpu_buffer_t& buffer)
 {
-  return gpuMemoryMap(context, buffer.memory.offset, buffer.memory.size, 0u, buffer.memory);
+  return gpuMemoryMap(context, 0u, buffer.memory.size, 0u, buffer.memory);
 }
 
 void render::gpuBufferUnmap(const context_t& context, const gpu_buffer_t& buffer)
@@ -1724,6 +1967,207 @@ void render::gpuBufferUnmap(const context_t& context, const gpu_buffer_t& buffer
   gpuMemoryUnmap(context, buffer.memory);
 }
 
+void render::uploadRingCreate(const context_t& context, size_t frameSize, uint32_t frameCount, uint32_t maxUploadCount, upload_ring_t* ring)
+{
+  frameSize = (size_t)getNextMultiple(frameSize, UPLOAD_RING_ALIGNMENT);
+  gpuBufferCreate(context, gpu_buffer_t::TRANSFER_SRC, HOST_VISIBLE_COHERENT, nullptr, frameSize * frameCount, nullptr, &ring->buffer);
+  ring->frameSize = frameSize;
+  ring->frameCount = frameCount;
+  ring->frame = 0u;
+  ring->head = 0u;
+  ring->uploadCount = 0u;
+  ring->recordedCount = 0u;
+  ring->activeWrites = 0u;
+  ring->upload.resize(maxUploadCount);
+  ring->order.reserve(maxUploadCount);
+  ring->written.reserve(maxUploadCount);
+  ring->copy.reserve(maxUploadCount);
+}
+
+void render::uploadRingDestroy(const context_t& context, upload_ring_t* ring)
+{
+  gpuBufferDestroy(context, nullptr, &ring->buffer);
+  ring->upload.clear();
+  ring->order.clear();
+  ring->written.clear();
+  ring->copy.clear();
+}
+
+bool render::uploadRingWrite(upload_ring_t* ring, const void* data, size_t offset, size_t size, const gpu_buffer_t& buffer)
+{
+  //Counted before taking the slot, so uploadRingRecordCopies can wait for every slot it is going to record to be filled
+  ring->activeWrites.fetch_add(1u);
+
+  VkDeviceSize start = ring->head.fetch_add(getNextMultiple(size, UPLOAD_RING_ALIGNMENT));
+  uint32_t index = ring->uploadCount.fetch_add(1u);
+  if (start + size > ring->frameSize || index >= ring->upload.size())
+  {
+    //Slot is left empty so the copy is not recorded
+    if (index < ring->upload.size())
+      ring->upload[index].buffer = VK_NULL_HANDLE;
+
+    ring->activeWrites.fetch_sub(1u);
+    return false;
+  }
+
+  VkDeviceSize srcOffset = ring->frame * ring->frameSize + start;
+  memcpy((uint8_t*)ring->buffer.memory.mapping + srcOffset, data, size);
+
+  upload_ring_t::upload_t& upload = ring->upload[index];
+  upload.buffer = buffer.handle;
+  upload.region.srcOffset = srcOffset;
+  upload.region.dstOffset = offset;
+  upload.region.size = size;
+  ring->activeWrites.fetch_sub(1u);
+  return true;
+}
+
+bool render::uploadRingHasPendingCopies(const upload_ring_t& ring)
+{
+  return ring.recordedCount < std::min(ring.uploadCount.load(), (uint32_t)ring.upload.size());
+}
+
+//Adds to ring->copy the parts of region not covered by the ranges in ring->written, then adds region to ring->written.
+//ring->written is kept sorted and without overlapping or touching ranges
+static void uploadRingAddUncoveredCopies(const VkBufferCopy& region, upload_ring_t* ring)
+{
+  typedef upload_ring_t::range_t range_t;
+  std::vector<range_t>& written = ring->written;
+  VkDeviceSize begin = region.dstOffset;
+  VkDeviceSize end = region.dstOffset + region.size;
+
+  //First range ending at or after the start of the region
+  std::vector<range_t>::iterator first = std::lower_bound(written.begin(), written.end(), begin,
+    [](const range_t& range, VkDeviceSize offset) { return range.end < offset; });
+
+  VkDeviceSize cursor = begin;
+  std::vector<range_t>::iterator last = first;
+  for (; last != written.end() && last->begin <= end; ++last)
+  {
+    if (last->begin > cursor)
+    {
+      VkBufferCopy copy = { region.srcOffset + (cursor - begin), cursor, last->begin - cursor };
+      ring->copy.push_back(copy);
+    }
+    cursor = std::max(cursor, last->end);
+  }
+
+  if (cursor < end)
+  {
+    VkBufferCopy copy = { region.srcOffset + (cursor - begin), cursor, end - cursor };
+    ring->copy.push_back(copy);
+  }
+
+  //Replace the ranges overlapping or touching the region with their union
+  range_t merged = { begin, end };
+  if (first != last)
+  {
+    merged.begin = std::min(begin, first->begin);
+    merged.end = std::max(end, (last - 1)->end);
+  }
+  first = written.erase(first, last);
+  written.insert(first, merged);
+}
+
+void render::uploadRingRecordCopies(const command_buffer_t& commandBuffer, upload_ring_t* ring)
+{
+  uint32_t begin = ring->recordedCount;
+  uint32_t end = std::min(ring->uploadCount.load(), (uint32_t)ring->upload.size());
+  if (begin >= end)
+    return;
+
+  //Writes that took one of the slots being recorded may still be filling it. Writes starting
+  //from now on take slots after end and are recorded by the next call
+  while (ring->activeWrites.load() != 0u)
+    std::this_thread::yield();
+
+  //Group the copies by buffer. Slots are compared by index inside each buffer to keep the order of the writes
+  ring->order.clear();
+  for (uint32_t i(begin); i < end; ++i)
+  {
+    if (ring->upload[i].buffer != VK_NULL_HANDLE)
+      ring->order.push_back(i);
+  }
+
+  const std::vector<upload_ring_t::upload_t>& upload = ring->upload;
+  std::sort(ring->order.begin(), ring->order.end(),
+    [&upload](uint32_t a, uint32_t b)
+    {
+      if (upload[a].buffer != upload[b].buffer) return (uint64_t)upload[a].buffer < (uint64_t)upload[b].buffer;
+      return a < b;
+    }
+  );
+
+  //Wait for the commands reading the buffers submitted before
+  vkCmdPipelineBarrier(commandBuffer.handle, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+  size_t i = 0u;
+  while (i < ring->order.size())
+  {
+    VkBuffer buffer = upload[ring->order[i]].buffer;
+    size_t groupEnd = i;
+    while (groupEnd < ring->order.size() && upload[ring->order[groupEnd]].buffer == buffer)
+      ++groupEnd;
+
+    //Later writes win. Walking the writes from the last one, each copies only the bytes no later write covers,
+    //so the regions of a buffer never overlap and the order they are copied in doesn't matter
+    ring->written.clear();
+    ring->copy.clear();
+    for (size_t j(groupEnd); j > i; --j)
+      uploadRingAddUncoveredCopies(upload[ring->order[j - 1]].region, ring);
+
+    //Merge regions contiguous both in the ring and in the buffer
+    std::sort(ring->copy.begin(), ring->copy.end(),
+      [](const VkBufferCopy& a, const VkBufferCopy& b) { return a.dstOffset < b.dstOffset; });
+
+    size_t copyCount = 0u;
+    for (size_t j(0); j < ring->copy.size(); ++j)
+    {
+      const VkBufferCopy& region = ring->copy[j];
+      if (copyCount > 0u)
+      {
+        VkBufferCopy& previous = ring->copy[copyCount - 1];
+        if (previous.dstOffset + previous.size == region.dstOffset && previous.srcOffset + previous.size == region.srcOffset)
+        {
+          previous.size += region.size;
+          continue;
+        }
+      }
+      ring->copy[copyCount++] = region;
+    }
+
+    vkCmdCopyBuffer(commandBuffer.handle, ring->buffer.handle, buffer, (uint32_t)copyCount, ring->copy.data());
+    i = groupEnd;
+  }
+
+  //Make the copies visible to the commands submitted after
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer.handle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+  ring->recordedCount = end;
+}
+
+void render::uploadRingDiscardCopies(upload_ring_t* ring, const gpu_buffer_t& buffer)
+{
+  uint32_t end = std::min(ring->uploadCount.load(), (uint32_t)ring->upload.size());
+  for (uint32_t i(ring->recordedCount); i < end; ++i)
+  {
+    if (ring->upload[i].buffer == buffer.handle)
+      ring->upload[i].buffer = VK_NULL_HANDLE;
+  }
+}
+
+void render::uploadRingNextFrame(upload_ring_t* ring)
+{
+  ring->frame = (ring->frame + 1u) % ring->frameCount;
+  ring->head = 0u;
+  ring->uploadCount = 0u;
+  ring->recordedCount = 0u;
+}
+
 descriptor_t render::getDescriptor(const gpu_buffer_t& buffer)
 {
   descriptor_t descriptor;
@@ -1840,10 +2284,20 @@ void render::descriptorPoolCreate(const context_t& context, uint32_t descriptorS
   combined_image_sampler_count combinedImageSamplers, uniform_buffer_count uniformBuffers,
   storage_buffer_count storageBuffers, storage_image_count storageImages,
   descriptor_pool_t* descriptorPool)
+{
+  descriptorPoolCreate(context, descriptorSetsCount, combinedImageSamplers, uniformBuffers,
+    uniform_buffer_dynamic_count(0u), storageBuffers, storageImages, descriptorPool);
+}
+
+void render::descriptorPoolCreate(const context_t& context, uint32_t descriptorSetsCount,
+  combined_image_sampler_count combinedImageSamplers, uniform_buffer_count uniformBuffers,
+  uniform_buffer_dynamic_count uniformBuffersDynamic, storage_buffer_count storageBuffers,
+  storage_image_count storageImages, descriptor_pool_t* descriptorPool)
 {
   descriptorPool->descriptorSets = descriptorSetsCount;
   descriptorPool->combinedImageSamplers = combinedImageSamplers.data;
   descriptorPool->uniformBuffers = uniformBuffers.data;
+  descriptorPool->uniformBuffersDynamic = uniformBuffersDynamic.data;
   descriptorPool->storageBuffers = storageBuffers.data;
   descriptorPool->storageImages = storageImages.data;
 
@@ -1855,6 +2309,9 @@ void render::descriptorPoolCreate(const context_t& context, uint32_t descriptorS
   if (descriptorPool->uniformBuffers > 0u)
     descriptorPoolSize.push_back({ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descriptorPool->uniformBuffers });
 
+  if (descriptorPool->uniformBuffersDynamic > 0u)
+    descriptorPoolSize.push_back({ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, descriptorPool->uniformBuffersDynamic });
+
   if (descriptorPool->storageBuffers > 0u)
     descriptorPoolSize.push_back({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorPool->storageBuffers });
 
@@ -1939,6 +2396,12 @@ void render::descriptorSetUpdate(const context_t& context, const descriptor_set_
 }
 
 void render::descriptorSetBind(command_buffer_t commandBuffer, const pipeline_layout_t& pipelineLayout, uint32_t firstSet, descriptor_set_t* descriptorSets, uint32_t descriptorSetCount)
+{
+  descriptorSetBind(commandBuffer, pipelineLayout, firstSet, descriptorSets, descriptorSetCount, nullptr, 0u);
+}
+
+void render::descriptorSetBind(command_buffer_t commandBuffer, const pipeline_layout_t& pipelineLayout, uint32_t firstSet, descriptor_set_t* descriptorSets, uint32_t descriptorSetCount,
+                               const uint32_t* dynamicOffsets, uint32_t dynamicOffsetCount)
 {
   VkPipelineBindPoint bindPoint = commandBuffer.type == command_buffer_t::GRAPHICS ? VK_PIPELINE_BIND_POINT_GRAPHICS :
                                                                                      VK_PIPELINE_BIND_POINT_COMPUTE;
@@ -1949,7 +2412,7 @@ void render::descriptorSetBind(command_buffer_t commandBuffer, const pipeline_la
     descriptorSetHandles[i] = descriptorSets[i].handle;
   }
   
-  vkCmdBindDescriptorSets(commandBuffer.handle, bindPoint, pipelineLayout.handle, firstSet, descriptorSetCount, descriptorSetHandles.data(), 0, 0);
+  vkCmdBindDescriptorSets(commandBuffer.handle, bindPoint, pipelineLayout.handle, firstSet, descriptorSetCount, descriptorSetHandles.data(), dynamicOffsetCount, dynamicOffsets);
 }
 
 void render::graphicsPipelineCreate(const context_t& context, VkRenderPass renderPass, uint32_t subpass, const render::vertex_format_t& vertexFormat, 
@@ -2261,6 +2724,62 @@ void render::depthStencilBufferDestroy(const context_t& context, depth_stencil_b
   gpuMemoryDeallocate(context, nullptr, depthStencilBuffer->memory);
 }
 
+void render::depthStencilBufferCopyDepth(const command_buffer_t& commandBuffer, const depth_stencil_buffer_t& depthStencilBuffer, uint32_t width, uint32_t height, gpu_buffer_t* buffer)
+{
+  VkImageMemoryBarrier imageMemoryBarrier = {};
+  imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imageMemoryBarrier.image = depthStencilBuffer.image;
+  imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  if (depthStencilBuffer.format != VK_FORMAT_D32_SFLOAT && depthStencilBuffer.format != VK_FORMAT_D16_UNORM)
+    imageMemoryBarrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+  imageMemoryBarrier.subresourceRange.levelCount = 1u;
+  imageMemoryBarrier.subresourceRange.layerCount = 1u;
+
+  //Wait for depth writes and transition to transfer source
+  imageMemoryBarrier.oldLayout = depthStencilBuffer.layout;
+  imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  imageMemoryBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer.handle, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+  VkBufferImageCopy region = {};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+  region.imageSubresource.layerCount = 1u;
+  region.imageExtent = { width, height, 1u };
+  vkCmdCopyImageToBuffer(commandBuffer.handle, depthStencilBuffer.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer->handle, 1u, &region);
+
+  //Back to the original layout
+  imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  imageMemoryBarrier.newLayout = depthStencilBuffer.layout;
+  imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  imageMemoryBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer.handle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+    0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+  //Make the copy visible to the host
+  VkBufferMemoryBarrier bufferMemoryBarrier = {};
+  bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferMemoryBarrier.buffer = buffer->handle;
+  bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(commandBuffer.handle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+    0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+}
+
+uint32_t render::depthStencilBufferDepthSize(const depth_stencil_buffer_t& depthStencilBuffer)
+{
+  if (depthStencilBuffer.format == VK_FORMAT_D16_UNORM || depthStencilBuffer.format == VK_FORMAT_D16_UNORM_S8_UINT)
+    return 2u;
+
+  return 4u;
+}
+
 void render::renderPassCreate(const context_t& context,
   render_pass_t::attachment_t* attachments, uint32_t attachmentCount,
   render_pass_t::subpass_t* subpasses, uint32_t subpassCount,
@@ -2446,6 +2965,11 @@ void render::commandPoolDestroy(const context_t& context, VkCommandPool commandP
   vkDestroyCommandPool(context.device, commandPool, nullptr);
 }
 
+void render::commandPoolReset(const context_t& context, VkCommandPool commandPool)
+{
+  vkResetCommandPool(context.device, commandPool, 0u);
+}
+
 void render::commandBufferCreate(const context_t& context, VkCommandBufferLevel level, 
                                  VkSemaphore* waitSemaphore, VkPipelineStageFlags* waitStages, uint32_t waitSemaphoreCount, 
                                  VkSemaphore* signalSemaphore, uint32_t signalSemaphoreCount, 
@@ -2455,26 +2979,10 @@ void render::commandBufferCreate(const context_t& context, VkCommandBufferLevel
   commandBuffer->waitSemaphore = nullptr;
   commandBuffer->signalSemaphore = nullptr;
   commandBuffer->waitStages = nullptr;
-
-  commandBuffer->waitSemaphoreCount = waitSemaphoreCount;  
+  commandBuffer->waitSemaphoreCapacity = 0u;
+  commandBuffer->signalSemaphoreCapacity = 0u;
   commandBuffer->commandPool = commandPool == VK_NULL_HANDLE ? context.commandPool : commandPool;
-
-  if(waitSemaphoreCount > 0)
-  {
-    commandBuffer->waitSemaphore = new VkSemaphore[waitSemaphoreCount];
-    memcpy(commandBuffer->waitSemaphore, waitSemaphore, sizeof(VkSemaphore)*waitSemaphoreCount );
-    commandBuffer->waitStages = new VkPipelineStageFlags[waitSemaphoreCount];
-    memcpy(commandBuffer->waitStages, waitStages, sizeof(VkPipelineStageFlags)*waitSemaphoreCount);
-  }
-  
-
-  commandBuffer->signalSemaphoreCount = signalSemaphoreCount;
-  if (signalSemaphoreCount > 0)
-  {
-    commandBuffer->signalSemaphore = new VkSemaphore[signalSemaphoreCount];
-    memcpy(commandBuffer->signalSemaphore, signalSemaphore, sizeof(VkSemaphore)*signalSemaphoreCount);
-
-  }
+  commandBufferSetSemaphores(waitSemaphore, waitStages, waitSemaphoreCount, signalSemaphore, signalSemaphoreCount, commandBuffer);
 
   VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
   commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -2489,6 +2997,37 @@ void render::commandBufferCreate(const context_t& context, VkCommandBufferLevel
   vkCreateFence(context.device, &fenceCreateInfo, nullptr, &commandBuffer->fence);
 }
 
+void render::commandBufferSetSemaphores(VkSemaphore* waitSemaphore, VkPipelineStageFlags* waitStages, uint32_t waitSemaphoreCount,
+                                        VkSemaphore* signalSemaphore, uint32_t signalSemaphoreCount, command_buffer_t* commandBuffer)
+{
+  if (waitSemaphoreCount > commandBuffer->waitSemaphoreCapacity)
+  {
+    delete[] commandBuffer->waitSemaphore;
+    delete[] commandBuffer->waitStages;
+    commandBuffer->waitSemaphore = new VkSemaphore[waitSemaphoreCount];
+    commandBuffer->waitStages = new VkPipelineStageFlags[waitSemaphoreCount];
+    commandBuffer->waitSemaphoreCapacity = waitSemaphoreCount;
+  }
+
+  commandBuffer->waitSemaphoreCount = waitSemaphoreCount;
+  if (waitSemaphoreCount > 0)
+  {
+    memcpy(commandBuffer->waitSemaphore, waitSemaphore, sizeof(VkSemaphore)*waitSemaphoreCount);
+    memcpy(commandBuffer->waitStages, waitStages, sizeof(VkPipelineStageFlags)*waitSemaphoreCount);
+  }
+
+  if (signalSemaphoreCount > commandBuffer->signalSemaphoreCapacity)
+  {
+    delete[] commandBuffer->signalSemaphore;
+    commandBuffer->signalSemaphore = new VkSemaphore[signalSemaphoreCount];
+    commandBuffer->signalSemaphoreCapacity = signalSemaphoreCount;
+  }
+
+  commandBuffer->signalSemaphoreCount = signalSemaphoreCount;
+  if (signalSemaphoreCount > 0)
+    memcpy(commandBuffer->signalSemaphore, signalSemaphore, sizeof(VkSemaphore)*signalSemaphoreCount);
+}
+
 void render::commandBufferDestroy(const context_t& context, command_buffer_t* commandBuffer )
 {
   delete[] commandBuffer->waitSemaphore;
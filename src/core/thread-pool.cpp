@@ -2,11 +2,82 @@
 
 using namespace bkk::core;
 
-thread_pool_t::worker_thread_t::worker_thread_t(thread_pool_t* pool)
-:exit_(false),
- pool_(pool)
+thread_local thread_pool_t::worker_thread_t* thread_pool_t::currentWorker_ = nullptr;
+
+thread_pool_t::task_deque_t::task_deque_t()
+:top_(0),
+ bottom_(0)
+{
+  for (int64_t i(0); i < CAPACITY; ++i)
+    task_[i].store(nullptr, std::memory_order_relaxed);
+}
+
+bool thread_pool_t::task_deque_t::push(task_t* task)
+{
+  int64_t bottom = bottom_.load(std::memory_order_relaxed);
+  int64_t top = top_.load(std::memory_order_acquire);
+  if (bottom - top >= CAPACITY)
+  {
+    //Queue is full
+    return false;
+  }
+
+  task_[bottom & (CAPACITY - 1)].store(task, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom_.store(bottom + 1, std::memory_order_relaxed);
+  return true;
+}
+
+thread_pool_t::task_t* thread_pool_t::task_deque_t::pop()
+{
+  int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(bottom, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t top = top_.load(std::memory_order_relaxed);
+
+  task_t* task = nullptr;
+  if (top <= bottom)
+  {
+    task = task_[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top == bottom)
+    {
+      //Last element in the queue. Compete with stealing threads for it
+      if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        task = nullptr;
+
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+  }
+  else
+  {
+    //Queue was empty
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+  }
+
+  return task;
+}
+
+thread_pool_t::task_t* thread_pool_t::task_deque_t::steal()
+{
+  int64_t top = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t bottom = bottom_.load(std::memory_order_acquire);
+
+  if (top < bottom)
+  {
+    task_t* task = task_[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      return task;
+  }
+
+  return nullptr;
+}
+
+thread_pool_t::worker_thread_t::worker_thread_t(thread_pool_t* pool, uint32_t index)
+:pool_(pool),
+ index_(index),
+ exit_(false)
 {
-  thread_ = std::thread(&worker_thread_t::run, this);
 }
 
 thread_pool_t::worker_thread_t::~worker_thread_t()
@@ -17,90 +88,145 @@ void* thread_pool_t::worker_thread_t::run(void* context)
 {
   worker_thread_t* workerThread = (worker_thread_t*)context;
   thread_pool_t* pool = workerThread->pool_;
+  currentWorker_ = workerThread;
 
   while (!workerThread->exit_)
   {
-    task_t* task = pool->getNextTask();
+    task_t* task = pool->getNextTask(workerThread);
     if (task)
-    {      
-      //Execute task
-      task->run();
-      pool->endTask(task);
-    }
+      pool->runTask(task);
   }
 
+  currentWorker_ = nullptr;
   return 0;
 }
 
 thread_pool_t::thread_pool_t(unsigned int numThreads)
- :pendingTasks_(0),
+ :readyTasks_(0),
+  sleepingWorkers_(0),
+  pendingTasks_(0),
   exit_(false)
-{  
+{
   workerThread_.resize(numThreads);
   for (unsigned int i(0); i < workerThread_.size(); ++i)
-    workerThread_[i] = new worker_thread_t(this);  
+    workerThread_[i] = new worker_thread_t(this, i);
+
+  //Start threads once all workers exist, as any of them can steal from the others
+  for (unsigned int i(0); i < workerThread_.size(); ++i)
+    workerThread_[i]->thread_ = std::thread(&worker_thread_t::run, workerThread_[i]);
 }
 
 thread_pool_t::~thread_pool_t()
 {
 }
 
-thread_pool_t::task_t* thread_pool_t::getNextTask()
+thread_pool_t::task_t* thread_pool_t::findTask(worker_thread_t* worker)
 {
-  std::unique_lock<std::mutex> lock(mutex_);
+  //1. Tasks in the worker own queue (worker is nullptr when called from a thread not owned by the pool)
+  task_t* task = worker ? worker->queue_.pop() : nullptr;
 
-  auto it = taskNotReady_.begin();
-  while( it != taskNotReady_.end() )
+  //2. Tasks added from outside the pool
+  if (!task)
   {
-    if ((*it)->hasDependenciesRemaining() == false)
+    std::unique_lock<std::mutex> lock(taskReadyMutex_);
+    if (!taskReady_.empty())
     {
-      taskReady_.push_back(*it);
-      it = taskNotReady_.erase(it);
-      conditionVar_.notify_one();
+      task = taskReady_.front();
+      taskReady_.pop_front();
     }
-    else
+  }
+
+  //3. Steal from other workers
+  if (!task)
+  {
+    uint32_t workerCount = (uint32_t)workerThread_.size();
+    uint32_t first = worker ? worker->index_ + 1 : 0u;
+    uint32_t count = worker ? workerCount - 1 : workerCount;
+    for (uint32_t i(0); i < count && !task; ++i)
     {
-      it++;
+      task = workerThread_[(first + i) % workerCount]->queue_.steal();
     }
   }
 
-  while (taskReady_.empty() && !exit_)
+  if (task)
+    readyTasks_--;
+
+  return task;
+}
+
+thread_pool_t::task_t* thread_pool_t::getNextTask(worker_thread_t* worker)
+{
+  while (!exit_)
   {
-    conditionVar_.wait(lock);
+    task_t* task = findTask(worker);
+    if (task)
+      return task;
+
+    //No work available. Sleep until a new task is scheduled
+    std::unique_lock<std::mutex> lock(mutex_);
+    sleepingWorkers_++;
+    conditionVar_.wait(lock, [this] { return readyTasks_ > 0 || exit_; });
+    sleepingWorkers_--;
   }
 
-  if (exit_ || taskReady_.empty())
+  return nullptr;
+}
+
+void thread_pool_t::scheduleTask(task_t* task)
+{
+  //Tasks scheduled from a worker thread go to its own queue
+  worker_thread_t* worker = currentWorker_;
+  if (worker == nullptr || worker->pool_ != this || !worker->queue_.push(task))
   {
-    return nullptr;
+    std::unique_lock<std::mutex> lock(taskReadyMutex_);
+    taskReady_.push_back(task);
   }
-  else
+
+  readyTasks_++;
+
+  //Wake up one worker if any of them is sleeping
+  if (sleepingWorkers_ > 0)
   {
-    task_t* task = taskReady_[0];
-    taskReady_.erase(taskReady_.begin());
-    return task;
+    std::unique_lock<std::mutex> lock(mutex_);
+    conditionVar_.notify_one();
   }
 }
 
-void thread_pool_t::endTask(task_t* task)
+void thread_pool_t::runTask(task_t* task)
 {
+  task->run();
+
+  task_group_t* group = task->group_;
+  task->submitted_ = false;
   task->end();
-  pendingTasks_--;
+
+  //Task and group can be destroyed by a waiting thread as soon as the counters reach zero
+  bool completed = (group && --group->pendingTasks_ == 0);
+  completed = (--pendingTasks_ == 0) || completed;
+
+  //Wake up threads waiting for completion
+  if (completed && sleepingWorkers_ > 0)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    conditionVar_.notify_all();
+  }
 }
 
-void thread_pool_t::addTask(task_t* task)
+void thread_pool_t::addTask(task_t* task, task_group_t* group)
 {
   task->begin();
-  std::unique_lock<std::mutex> lock(mutex_);
+  task->pool_ = this;
+  task->group_ = group;
+  task->scheduled_ = false;
+  if (group)
+    group->pendingTasks_++;
+
   pendingTasks_++;
-  if (task->hasDependenciesRemaining())
-  {
-    taskNotReady_.push_back(task);
-  }
-  else
-  {
-    taskReady_.push_back(task);
-    conditionVar_.notify_one();
-  }
+  task->submitted_ = true;
+
+  //If the task still has dependencies it will be scheduled when the last one finishes
+  if (!task->hasDependenciesRemaining() && task->acquireScheduling())
+    scheduleTask(task);
 }
 
 void thread_pool_t::exit()
@@ -110,28 +236,78 @@ void thread_pool_t::exit()
     workerThread_[i]->exit_ = true;
   }
 
-  exit_ = true;  
-  conditionVar_.notify_all();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    exit_ = true;
+    conditionVar_.notify_all();
+  }
 
   //Wait for all thread to finish and destroy them
   for (unsigned int i(0); i < workerThread_.size(); ++i)
     workerThread_[i]->thread_.join();
-    
+
   for (unsigned int i(0); i < workerThread_.size(); ++i)
     delete workerThread_[i];
 }
 
-void thread_pool_t::waitForCompletion()
+void thread_pool_t::wait(std::atomic<int>* pendingTasks)
 {
-  while (pendingTasks_ != 0)
+  worker_thread_t* worker = currentWorker_;
+  if (worker && worker->pool_ != this)
+    worker = nullptr;
+
+  while (*pendingTasks > 0 && !exit_)
   {
+    //Help executing tasks instead of spinning
+    task_t* task = findTask(worker);
+    if (task)
+    {
+      runTask(task);
+    }
+    else
+    {
+      //Nothing to run. Sleep until there are new tasks or the tasks we are waiting for have finished
+      std::unique_lock<std::mutex> lock(mutex_);
+      sleepingWorkers_++;
+      conditionVar_.wait(lock, [this, pendingTasks] { return readyTasks_ > 0 || *pendingTasks == 0 || exit_; });
+      sleepingWorkers_--;
+    }
   }
 }
 
+void thread_pool_t::waitForCompletion()
+{
+  wait(&pendingTasks_);
+}
+
+void thread_pool_t::waitForCompletion(task_group_t* group)
+{
+  wait(&group->pendingTasks_);
+}
+
+uint32_t thread_pool_t::getThreadIndex()
+{
+  worker_thread_t* worker = currentWorker_;
+  if (worker && worker->pool_ == this)
+    return worker->index_;
+
+  return getThreadCount();
+}
+
+thread_pool_t::task_group_t::task_group_t()
+:pendingTasks_(0)
+{
+}
+
 
 thread_pool_t::task_t::task_t()
 :dependenciesRemaining_(0),
- hasCompleted_(false)
+ dependencyCount_(0),
+ hasCompleted_(false),
+ pool_(nullptr),
+ group_(nullptr),
+ submitted_(false),
+ scheduled_(false)
 {
 }
 
@@ -146,8 +322,23 @@ bool thread_pool_t::task_t::hasDependenciesRemaining()
 
 void thread_pool_t::task_t::dependsOn(thread_pool_t::task_t* task)
 {
-  if( task->addDependency(this) )
+  if (task->addDependency(this))
+  {
     dependenciesRemaining_++;
+    dependencyCount_++;
+  }
+}
+
+void thread_pool_t::task_t::resetDependencies()
+{
+  dependenciesRemaining_ = dependencyCount_;
+}
+
+void thread_pool_t::task_t::clearDependencies()
+{
+  dependentTask_.clear();
+  dependencyCount_ = 0;
+  dependenciesRemaining_ = 0;
 }
 
 bool thread_pool_t::task_t::addDependency(thread_pool_t::task_t* dependentTask)
@@ -163,29 +354,80 @@ bool thread_pool_t::task_t::addDependency(thread_pool_t::task_t* dependentTask)
   return true;
 }
 
-void thread_pool_t::task_t::clearOneDependency()
+bool thread_pool_t::task_t::clearOneDependency()
+{
+  return --dependenciesRemaining_ == 0;
+}
+
+bool thread_pool_t::task_t::acquireScheduling()
 {
-  dependenciesRemaining_--;
+  bool expected = false;
+  return scheduled_.compare_exchange_strong(expected, true);
 }
 
 void thread_pool_t::task_t::begin()
-{ 
-  hasCompleted_ = false; 
+{
+  hasCompleted_ = false;
 }
 
 void thread_pool_t::task_t::end()
 {
-  //Signal dependent tasks
+  //Signal dependent tasks. Tasks already in the pool are pushed to a ready queue
+  //when its last dependency finishes
   size_t count(dependentTask_.size());
   for (size_t i(0); i < count; ++i)
   {
-    dependentTask_[i]->clearOneDependency();
+    task_t* task = dependentTask_[i];
+    if (task->clearOneDependency() && task->submitted_ && task->acquireScheduling())
+      task->pool_->scheduleTask(task);
   }
 
   hasCompleted_ = true;
 }
 
-uint32_t bkk::core::getCPUCoreCount() 
-{ 
-  return std::thread::hardware_concurrency(); 
+uint32_t bkk::core::getCPUCoreCount()
+{
+  return std::thread::hardware_concurrency();
+}
+
+parallel_range_t::parallel_range_t(uint32_t begin, uint32_t end, uint32_t grainSize, uint32_t threadCount)
+:next_(begin),
+ end_(end),
+ grainSize_(grainSize > 0u ? grainSize : 1u),
+ threadCount_(threadCount > 0u ? threadCount : 1u)
+{
+}
+
+bool parallel_range_t::nextChunk(uint32_t* chunkBegin, uint32_t* chunkEnd)
+{
+  uint32_t current = next_.load(std::memory_order_relaxed);
+  uint32_t size;
+  do
+  {
+    if (current >= end_)
+      return false;
+
+    //Take a fraction of what is left, so the last chunks are small enough to balance the load
+    uint32_t remaining = end_ - current;
+    size = remaining / (2u * threadCount_);
+    if (size < grainSize_) size = grainSize_;
+    if (size > remaining) size = remaining;
+
+  } while (!next_.compare_exchange_weak(current, current + size, std::memory_order_relaxed));
+
+  *chunkBegin = current;
+  *chunkEnd = current + size;
+  return true;
+}
+
+uint32_t bkk::core::parallelTaskCount(thread_pool_t* pool, uint32_t begin, uint32_t end, uint32_t grainSize)
+{
+  //Calling thread processes chunks too, so one task less is needed
+  grainSize = grainSize > 0u ? grainSize : 1u;
+  uint32_t chunkCount = (end - begin + grainSize - 1u) / grainSize;
+  uint32_t taskCount = chunkCount - 1u;
+  if (taskCount > pool->getThreadCount()) taskCount = pool->getThreadCount();
+  if (taskCount > PARALLEL_MAX_TASKS) taskCount = PARALLEL_MAX_TASKS;
+
+  return taskCount;
 }
\ No newline at end of file
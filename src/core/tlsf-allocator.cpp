@@ -0,0 +1,317 @@
+/*
+* Copyright(c) Ferran Sole (2017-2019)
+*
+* This file is part of brokkr framework
+* (see https://github.com/fsole/brokkr).
+* The use of this software is governed by the LICENSE file.
+*/
+
+#include "core/tlsf-allocator.h"
+#include <assert.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace bkk::core;
+
+const uint32_t tlsf_allocator_t::INVALID_ALLOCATION;
+const uint32_t tlsf_allocator_t::SECOND_LEVEL_LOG2;
+const uint32_t tlsf_allocator_t::SECOND_LEVEL_COUNT;
+const uint32_t tlsf_allocator_t::FIRST_LEVEL_COUNT;
+
+//Index of the lowest and highest bits set. value can't be 0
+static uint32_t findLowestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return (uint32_t)index;
+#else
+  return (uint32_t)__builtin_ctzll(value);
+#endif
+}
+
+static uint32_t findHighestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return (uint32_t)index;
+#else
+  return 63u - (uint32_t)__builtin_clzll(value);
+#endif
+}
+
+tlsf_allocator_t::tlsf_allocator_t()
+:unusedRange_(INVALID_ALLOCATION),
+ firstLevelBitmap_(0u),
+ size_(0u),
+ usedSize_(0u),
+ allocationCount_(0u)
+{
+}
+
+void tlsf_allocator_t::init(uint64_t size)
+{
+  range_.clear();
+  unusedRange_ = INVALID_ALLOCATION;
+  firstLevelBitmap_ = 0u;
+  for (uint32_t i(0); i < FIRST_LEVEL_COUNT; ++i)
+  {
+    secondLevelBitmap_[i] = 0u;
+    for (uint32_t j(0); j < SECOND_LEVEL_COUNT; ++j)
+      freeList_[i][j] = INVALID_ALLOCATION;
+  }
+
+  size_ = size;
+  usedSize_ = 0u;
+  allocationCount_ = 0u;
+
+  if (size > 0u)
+  {
+    uint32_t range = newRange();
+    range_[range].offset = 0u;
+    range_[range].size = size;
+    range_[range].prevPhysical = INVALID_ALLOCATION;
+    range_[range].nextPhysical = INVALID_ALLOCATION;
+    insertFreeRange(range);
+  }
+}
+
+uint32_t tlsf_allocator_t::allocate(uint64_t size, uint64_t alignment, uint64_t* offset)
+{
+  if (size == 0u)
+    size = 1u;
+
+  if (alignment == 0u)
+    alignment = 1u;
+
+  //Try first the smallest size class that fits the size. If the first range found can't be aligned,
+  //look for a range with space for any alignment padding
+  uint32_t range = findFreeRange(size);
+  if (range != INVALID_ALLOCATION)
+  {
+    uint64_t padding = ((range_[range].offset + alignment - 1u) & ~(alignment - 1u)) - range_[range].offset;
+    if (range_[range].size < size + padding)
+      range = INVALID_ALLOCATION;
+  }
+
+  if (range == INVALID_ALLOCATION && alignment > 1u)
+    range = findFreeRange(size + alignment - 1u);
+
+  if (range == INVALID_ALLOCATION)
+    return INVALID_ALLOCATION;
+
+  removeFreeRange(range);
+
+  //Padding before the aligned offset goes back to the free lists
+  uint64_t padding = ((range_[range].offset + alignment - 1u) & ~(alignment - 1u)) - range_[range].offset;
+  if (padding > 0u)
+  {
+    uint32_t head = range;
+    range = splitRange(head, padding);
+    insertFreeRange(head);
+  }
+
+  if (range_[range].size > size)
+  {
+    uint32_t tail = splitRange(range, size);
+    insertFreeRange(tail);
+  }
+
+  range_[range].free = false;
+  usedSize_ += size;
+  allocationCount_++;
+
+  *offset = range_[range].offset;
+  return range;
+}
+
+void tlsf_allocator_t::deallocate(uint32_t allocation)
+{
+  assert(allocation < range_.size() && !range_[allocation].free);
+
+  uint32_t range = allocation;
+  usedSize_ -= range_[range].size;
+  allocationCount_--;
+
+  //Merge with the free neighbours
+  uint32_t prev = range_[range].prevPhysical;
+  if (prev != INVALID_ALLOCATION && range_[prev].free)
+  {
+    removeFreeRange(prev);
+    range_[prev].size += range_[range].size;
+    range_[prev].nextPhysical = range_[range].nextPhysical;
+    if (range_[range].nextPhysical != INVALID_ALLOCATION)
+      range_[range_[range].nextPhysical].prevPhysical = prev;
+
+    releaseRange(range);
+    range = prev;
+  }
+
+  uint32_t next = range_[range].nextPhysical;
+  if (next != INVALID_ALLOCATION && range_[next].free)
+  {
+    removeFreeRange(next);
+    range_[range].size += range_[next].size;
+    range_[range].nextPhysical = range_[next].nextPhysical;
+    if (range_[next].nextPhysical != INVALID_ALLOCATION)
+      range_[range_[next].nextPhysical].prevPhysical = range;
+
+    releaseRange(next);
+  }
+
+  insertFreeRange(range);
+}
+
+uint64_t tlsf_allocator_t::getLargestFreeRange() const
+{
+  if (firstLevelBitmap_ == 0u)
+    return 0u;
+
+  //Ranges in the highest non-empty size class are the biggest ones, but they are not sorted
+  uint32_t firstLevel = findHighestBit(firstLevelBitmap_);
+  uint32_t secondLevel = findHighestBit(secondLevelBitmap_[firstLevel]);
+  uint64_t largest = 0u;
+  for (uint32_t range = freeList_[firstLevel][secondLevel]; range != INVALID_ALLOCATION; range = range_[range].nextFree)
+  {
+    if (range_[range].size > largest)
+      largest = range_[range].size;
+  }
+
+  return largest;
+}
+
+void tlsf_allocator_t::mapping(uint64_t size, uint32_t* firstLevel, uint32_t* secondLevel)
+{
+  if (size < SECOND_LEVEL_COUNT)
+  {
+    *firstLevel = 0u;
+    *secondLevel = (uint32_t)size;
+  }
+  else
+  {
+    uint32_t log2 = findHighestBit(size);
+    *firstLevel = log2 - SECOND_LEVEL_LOG2 + 1u;
+    *secondLevel = (uint32_t)(size >> (log2 - SECOND_LEVEL_LOG2)) - SECOND_LEVEL_COUNT;
+  }
+}
+
+uint32_t tlsf_allocator_t::findFreeRange(uint64_t size) const
+{
+  //Round the size up to the next size class, so any range in the class found is big enough
+  if (size >= SECOND_LEVEL_COUNT)
+  {
+    uint64_t roundUp = (1ull << (findHighestBit(size) - SECOND_LEVEL_LOG2)) - 1u;
+    if (size > ~0ull - roundUp)
+      return INVALID_ALLOCATION;
+
+    size += roundUp;
+  }
+
+  uint32_t firstLevel, secondLevel;
+  mapping(size, &firstLevel, &secondLevel);
+
+  uint32_t secondLevelMap = secondLevelBitmap_[firstLevel] & (~0u << secondLevel);
+  if (secondLevelMap == 0u)
+  {
+    //No ranges in the first level. Take the smallest class of the next non-empty first level
+    if (firstLevel + 1u >= FIRST_LEVEL_COUNT)
+      return INVALID_ALLOCATION;
+
+    uint64_t firstLevelMap = firstLevelBitmap_ & (~0ull << (firstLevel + 1u));
+    if (firstLevelMap == 0u)
+      return INVALID_ALLOCATION;
+
+    firstLevel = findLowestBit(firstLevelMap);
+    secondLevelMap = secondLevelBitmap_[firstLevel];
+  }
+
+  secondLevel = findLowestBit(secondLevelMap);
+  return freeList_[firstLevel][secondLevel];
+}
+
+void tlsf_allocator_t::insertFreeRange(uint32_t range)
+{
+  uint32_t firstLevel, secondLevel;
+  mapping(range_[range].size, &firstLevel, &secondLevel);
+
+  uint32_t head = freeList_[firstLevel][secondLevel];
+  range_[range].free = true;
+  range_[range].prevFree = INVALID_ALLOCATION;
+  range_[range].nextFree = head;
+  if (head != INVALID_ALLOCATION)
+    range_[head].prevFree = range;
+
+  freeList_[firstLevel][secondLevel] = range;
+  firstLevelBitmap_ |= 1ull << firstLevel;
+  secondLevelBitmap_[firstLevel] |= 1u << secondLevel;
+}
+
+void tlsf_allocator_t::removeFreeRange(uint32_t range)
+{
+  uint32_t firstLevel, secondLevel;
+  mapping(range_[range].size, &firstLevel, &secondLevel);
+
+  uint32_t prev = range_[range].prevFree;
+  uint32_t next = range_[range].nextFree;
+  if (prev != INVALID_ALLOCATION)
+    range_[prev].nextFree = next;
+  else
+    freeList_[firstLevel][secondLevel] = next;
+
+  if (next != INVALID_ALLOCATION)
+    range_[next].prevFree = prev;
+
+  if (freeList_[firstLevel][secondLevel] == INVALID_ALLOCATION)
+  {
+    secondLevelBitmap_[firstLevel] &= ~(1u << secondLevel);
+    if (secondLevelBitmap_[firstLevel] == 0u)
+      firstLevelBitmap_ &= ~(1ull << firstLevel);
+  }
+
+  range_[range].free = false;
+}
+
+uint32_t tlsf_allocator_t::splitRange(uint32_t range, uint64_t size)
+{
+  //range keeps the first size bytes. Returns a new range with the rest
+  uint32_t rest = newRange();
+  range_[rest].offset = range_[range].offset + size;
+  range_[rest].size = range_[range].size - size;
+  range_[rest].prevPhysical = range;
+  range_[rest].nextPhysical = range_[range].nextPhysical;
+  range_[rest].free = false;
+  if (range_[range].nextPhysical != INVALID_ALLOCATION)
+    range_[range_[range].nextPhysical].prevPhysical = rest;
+
+  range_[range].size = size;
+  range_[range].nextPhysical = rest;
+  return rest;
+}
+
+uint32_t tlsf_allocator_t::newRange()
+{
+  uint32_t range = unusedRange_;
+  if (range != INVALID_ALLOCATION)
+  {
+    unusedRange_ = range_[range].nextFree;
+  }
+  else
+  {
+    range = (uint32_t)range_.size();
+    range_.push_back(range_t());
+  }
+
+  range_[range].free = false;
+  range_[range].prevFree = range_[range].nextFree = INVALID_ALLOCATION;
+  return range;
+}
+
+void tlsf_allocator_t::releaseRange(uint32_t range)
+{
+  range_[range].free = false;
+  range_[range].nextFree = unusedRange_;
+  unusedRange_ = range;
+}
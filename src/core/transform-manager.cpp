@@ -11,18 +11,33 @@
 
 using namespace bkk::core;
 
+const uint32_t transform_manager_t::INVALID_INDEX;
+
+//Reorders v so that element i is the element that was in position order[i]
+template <typename T>
+static void reorder( const std::vector<u32>& order, std::vector<T>* v )
+{
+  std::vector<T> ordered( order.size() );
+  for( u32 i(0); i<order.size(); ++i )
+    ordered[i] = (*v)[order[i]];
+
+  v->swap( ordered );
+}
+
+transform_manager_t::transform_manager_t()
+:hierarchy_changed_(false)
+{
+}
+
 bkk_handle_t transform_manager_t::createTransform( const maths::mat4& transform )
 {
   bkk_handle_t id = transform_.add( transform );
-  if( id.index >= parent_.size() )
-  {
-    //Resize vectors
-    uint32_t newSize = (uint32_t)parent_.size() + 1u;
-    parent_.resize( newSize );
-    world_.resize( newSize );
-  }
-
-  parent_[id.index] = BKK_NULL_HANDLE;
+  parent_.push_back( BKK_NULL_HANDLE );
+  parentIndex_.push_back( INVALID_INDEX );
+  world_.push_back( transform );
+  dirty_.push_back( 0u );
+  localTRS_.push_back( INVALID_INDEX );
+  setDirty( transform_.getElementCount() - 1u );
   hierarchy_changed_ = true;
 
   return id;
@@ -30,25 +45,33 @@ bkk_handle_t transform_manager_t::createTransform( const maths::mat4& transform
 
 bool transform_manager_t::destroyTransform( bkk_handle_t id )
 {
-  hierarchy_changed_ = true;
-
   u32 index;
+  if( !transform_.getIndexFromId( id, &index ) )
+    return false;
+
+  if( localTRS_[index] != INVALID_INDEX )
+    removeTRS( index );
+
+  //Packed freelist moves the last transform to the gap. Do the same in the other arrays.
+  //dirtyIndex_ and composeIndex_ are not fixed, as the next update recomputes all the transforms anyway
   u32 lastTransform( transform_.getElementCount()-1 );
-  if( transform_.getIndexFromId( id, &index ) && index < lastTransform )
+  if( index < lastTransform )
   {
-    {
-      bkk_handle_t temp = parent_[index];
-      parent_[index] = parent_[lastTransform];
-      parent_[lastTransform] = temp;
-    }
-
-    {
-      maths::mat4 temp = world_[index];
-      world_[index] = world_[lastTransform];
-      world_[lastTransform] = temp;
-    }
+    parent_[index] = parent_[lastTransform];
+    world_[index] = world_[lastTransform];
+    dirty_[index] = dirty_[lastTransform];
+    localTRS_[index] = localTRS_[lastTransform];
+    if( localTRS_[index] != INVALID_INDEX )
+      trs_[localTRS_[index]].transform = index;
   }
 
+  parent_.pop_back();
+  parentIndex_.pop_back();
+  world_.pop_back();
+  dirty_.pop_back();
+  localTRS_.pop_back();
+  hierarchy_changed_ = true;
+
   return transform_.remove( id );
 }
 
@@ -59,10 +82,82 @@ maths::mat4* transform_manager_t::getTransform( bkk_handle_t id )
 
 bool transform_manager_t::setTransform( bkk_handle_t id, const maths::mat4& transform )
 {
-  maths::mat4* t = transform_.get(id);
-  if( t )
+  uint32_t index;
+  if( transform_.getIndexFromId( id, &index ) )
+  {
+    maths::mat4* t;
+    transform_.getData( &t );
+    t[index] = transform;
+    if( localTRS_[index] != INVALID_INDEX )
+      removeTRS( index );
+
+    setDirty( index );
+    return true;
+  }
+
+  return false;
+}
+
+bool transform_manager_t::setTransform( bkk_handle_t id, const maths::vec3& position, const maths::vec3& scale, const maths::quat& rotation )
+{
+  uint32_t index;
+  if( transform_.getIndexFromId( id, &index ) )
+  {
+    if( localTRS_[index] == INVALID_INDEX )
+    {
+      localTRS_[index] = (u32)trs_.size();
+      trs_.push_back( local_trs_t() );
+      trs_.back().transform = index;
+      trs_.back().modified = 0u;
+    }
+
+    local_trs_t& trs = trs_[localTRS_[index]];
+    trs.position = position;
+    trs.rotation = rotation;
+    trs.scale = scale;
+    setTRSModified( index );
+    return true;
+  }
+
+  return false;
+}
+
+bool transform_manager_t::setPosition( bkk_handle_t id, const maths::vec3& position )
+{
+  uint32_t index;
+  local_trs_t* trs = getTRS( id, &index );
+  if( trs )
+  {
+    trs->position = position;
+    setTRSModified( index );
+    return true;
+  }
+
+  return false;
+}
+
+bool transform_manager_t::setRotation( bkk_handle_t id, const maths::quat& rotation )
+{
+  uint32_t index;
+  local_trs_t* trs = getTRS( id, &index );
+  if( trs )
+  {
+    trs->rotation = rotation;
+    setTRSModified( index );
+    return true;
+  }
+
+  return false;
+}
+
+bool transform_manager_t::setScale( bkk_handle_t id, const maths::vec3& scale )
+{
+  uint32_t index;
+  local_trs_t* trs = getTRS( id, &index );
+  if( trs )
   {
-    *t = transform;
+    trs->scale = scale;
+    setTRSModified( index );
     return true;
   }
 
@@ -76,6 +171,7 @@ bool transform_manager_t::setParent( bkk_handle_t id, bkk_handle_t parentId )
   if( transform_.getIndexFromId( id, &index ) )
   {
     parent_[index] = parentId;
+    setDirty( index );
     return true;
   }
 
@@ -108,60 +204,278 @@ maths::mat4* transform_manager_t::getWorldMatrix( bkk_handle_t id )
 
 void transform_manager_t::sortTransforms()
 {
-  //1.Sort based on tree depth level to make sure we compute parent transform before its children
-  struct transform_handle_t
+  u32 count( transform_.getElementCount() );
+
+  //1. Group transforms by parent (counting sort by parent index)
+  std::vector<u32> parentIndex( count );
+  std::vector<u32> childOffset( count + 1u, 0u );
+  for( u32 i(0); i<count; ++i )
   {
-    bkk_handle_t id;
-    bkk_handle_t parent;
-    u32 level;
-    bool operator<(const transform_handle_t& item) const{ return level < item.level; }
-  };
+    u32 parent;
+    parentIndex[i] = transform_.getIndexFromId( parent_[i], &parent ) ? parent : INVALID_INDEX;
+    if( parentIndex[i] != INVALID_INDEX )
+      childOffset[parent + 1u]++;
+  }
 
-  u32 count( transform_.getElementCount() );
-  std::vector<transform_handle_t> orderedTransform(count);
+  for( u32 i(0); i<count; ++i )
+    childOffset[i + 1u] += childOffset[i];
+
+  std::vector<u32> children( childOffset[count] );
+  std::vector<u32> next( childOffset.begin(), childOffset.end() - 1 );
+  for( u32 i(0); i<count; ++i )
+  {
+    if( parentIndex[i] != INVALID_INDEX )
+      children[next[parentIndex[i]]++] = i;
+  }
+
+  //2. Breadth first traversal from the roots. Parents end up before their children, transforms are sorted by
+  //level and the children of each transform are contiguous
+  std::vector<u32> orderedIndex;
+  orderedIndex.reserve( count );
   for( u32 i(0); i<count; ++i )
   {
-    bkk_handle_t parentId = parent_[i];
-    orderedTransform[i] = {transform_.getIdFromIndex( i ), parentId, 0};
+    if( parentIndex[i] == INVALID_INDEX )
+      orderedIndex.push_back( i );
+  }
 
-    u32 parentIndex;
-    while( transform_.getIndexFromId( parentId, &parentIndex ) )
+  levelStart_.assign( 1u, 0u );
+  childStart_.resize( count + 1u );
+  u32 levelEnd = (u32)orderedIndex.size();
+  for( u32 position(0); position<orderedIndex.size(); ++position )
+  {
+    if( position == levelEnd )
     {
-      orderedTransform[i].level++;
-      parentId = parent_[parentIndex];
+      levelStart_.push_back( position );
+      levelEnd = (u32)orderedIndex.size();
     }
+
+    u32 i = orderedIndex[position];
+    childStart_[position] = (u32)orderedIndex.size();
+    orderedIndex.insert( orderedIndex.end(), children.begin() + childOffset[i], children.begin() + childOffset[i + 1u] );
   }
+  levelStart_.push_back( (u32)orderedIndex.size() );
+  childStart_[count] = (u32)orderedIndex.size();
 
-  std::sort(orderedTransform.begin(), orderedTransform.end());
+  //3. Reorder transforms using the ordered helper vectors
+  std::vector<bkk_handle_t> orderedId( count );
+  for( u32 i(0); i<count; ++i )
+    orderedId[i] = transform_.getIdFromIndex( orderedIndex[i] );
+
+  for( u32 i(0); i<count; ++i )
+    transform_.swap( transform_.getIdFromIndex(i), orderedId[i] );
+
+  reorder( orderedIndex, &parent_ );
+  reorder( orderedIndex, &localTRS_ );
 
-  //2. Reorder transforms using the ordered helper vector
   for( u32 i(0); i<count; ++i )
   {
-    transform_.swap( transform_.getIdFromIndex(i), orderedTransform[i].id );
-    parent_[i] = orderedTransform[i].parent;
+    u32 parent;
+    parentIndex_[i] = transform_.getIndexFromId( parent_[i], &parent ) ? parent : INVALID_INDEX;
+    if( localTRS_[i] != INVALID_INDEX )
+      trs_[localTRS_[i]].transform = i;
   }
 }
 
-void transform_manager_t::update()
+void transform_manager_t::setDirty( uint32_t index )
 {
-  //Reorder transforms if hierarchy has changed since last update
-  if( hierarchy_changed_ )
+  if( !dirty_[index] )
   {
-    sortTransforms();
-    hierarchy_changed_ = false;
+    dirty_[index] = 1u;
+    dirtyIndex_.push_back( index );
+  }
+}
+
+transform_manager_t::local_trs_t* transform_manager_t::getTRS( bkk_handle_t id, uint32_t* index )
+{
+  if( transform_.getIndexFromId( id, index ) && localTRS_[*index] != INVALID_INDEX )
+    return &trs_[localTRS_[*index]];
+
+  return nullptr;
+}
+
+void transform_manager_t::removeTRS( uint32_t index )
+{
+  u32 slot = localTRS_[index];
+  if( trs_[slot].modified )
+  {
+    std::vector<u32>::iterator it = std::find( composeIndex_.begin(), composeIndex_.end(), index );
+    if( it != composeIndex_.end() )
+    {
+      *it = composeIndex_.back();
+      composeIndex_.pop_back();
+    }
+  }
+
+  //Move the last TRS to the gap
+  u32 lastSlot = (u32)trs_.size() - 1u;
+  if( slot < lastSlot )
+  {
+    trs_[slot] = trs_[lastSlot];
+    localTRS_[trs_[slot].transform] = slot;
+  }
+
+  trs_.pop_back();
+  localTRS_[index] = INVALID_INDEX;
+}
+
+void transform_manager_t::setTRSModified( uint32_t index )
+{
+  local_trs_t& trs = trs_[localTRS_[index]];
+  if( !trs.modified )
+  {
+    trs.modified = 1u;
+    composeIndex_.push_back( index );
   }
 
-  //Update world transforms
-  u32 parentIndex;
+  setDirty( index );
+}
+
+void transform_manager_t::composeLocalMatrices( uint32_t begin, uint32_t end )
+{
+  maths::mat4* transforms;
+  transform_.getData(&transforms);
+  for( u32 i(begin); i<end; ++i )
+  {
+    u32 index = composeIndex_[i];
+    local_trs_t& trs = trs_[localTRS_[index]];
+    transforms[index] = maths::createTransform( trs.position, trs.scale, trs.rotation );
+    trs.modified = 0u;
+  }
+}
 
+void transform_manager_t::updateWorldMatrices( uint32_t begin, uint32_t end )
+{
   maths::mat4* transforms;
-  uint32_t transformCount = transform_.getData(&transforms);
-  for( u32 i(0); i<transformCount; ++i )
+  transform_.getData(&transforms);
+  for( u32 i(begin); i<end; ++i )
   {
-    world_[i] = transforms[i];
-    if( transform_.getIndexFromId( parent_[i], &parentIndex ) )
+    u32 parentIndex = parentIndex_[i];
+    if( parentIndex == INVALID_INDEX )
+      world_[i] = transforms[i];
+    else
+      world_[i] = transforms[i] * world_[parentIndex];
+  }
+}
+
+void transform_manager_t::updateSubtree( uint32_t root, std::vector<uint32_t>* stack, std::vector<uint32_t>* changed )
+{
+  maths::mat4* transforms;
+  transform_.getData(&transforms);
+
+  stack->push_back( root );
+  while( !stack->empty() )
+  {
+    u32 i = stack->back();
+    stack->pop_back();
+
+    u32 parentIndex = parentIndex_[i];
+    if( parentIndex == INVALID_INDEX )
+      world_[i] = transforms[i];
+    else
+      world_[i] = transforms[i] * world_[parentIndex];
+
+    changed->push_back( i );
+    for( u32 child(childStart_[i]); child<childStart_[i + 1u]; ++child )
+      stack->push_back( child );
+  }
+}
+
+const std::vector<uint32_t>& transform_manager_t::update( thread_pool_t* threadPool )
+{
+  changedIndex_.clear();
+  if( dirtyIndex_.empty() && !hierarchy_changed_ )
+    return changedIndex_;
+
+  //Compose local matrices of transforms modified with TRS setters. Destroyed transforms may have left
+  //composeIndex_ with wrong indices, so it is rebuilt from trs_ if the hierarchy has changed
+  if( hierarchy_changed_ )
+  {
+    composeIndex_.clear();
+    for( u32 i(0); i<trs_.size(); ++i )
     {
-      world_[i] = world_[i] * world_[parentIndex];
+      if( trs_[i].modified )
+        composeIndex_.push_back( trs_[i].transform );
     }
   }
-}
\ No newline at end of file
+
+  if( threadPool )
+  {
+    parallelFor( threadPool, 0u, (u32)composeIndex_.size(), 1024u,
+      [&]( uint32_t begin, uint32_t end ){ composeLocalMatrices( begin, end ); } );
+  }
+  else
+  {
+    composeLocalMatrices( 0u, (u32)composeIndex_.size() );
+  }
+  composeIndex_.clear();
+
+  //Reorder transforms if hierarchy has changed since last update. All the world matrices are recomputed,
+  //one level at a time, as removed transforms may have left children without parent
+  if( hierarchy_changed_ )
+  {
+    sortTransforms();
+    u32 levelCount = (u32)levelStart_.size() - 1u;
+    for( u32 level(0); level<levelCount; ++level )
+    {
+      if( threadPool )
+      {
+        parallelFor( threadPool, levelStart_[level], levelStart_[level + 1], 1024u,
+          [&]( uint32_t begin, uint32_t end ){ updateWorldMatrices( begin, end ); } );
+      }
+      else
+      {
+        updateWorldMatrices( levelStart_[level], levelStart_[level + 1] );
+      }
+    }
+
+    u32 count( transform_.getElementCount() );
+    changedIndex_.resize( count );
+    for( u32 i(0); i<count; ++i )
+      changedIndex_[i] = i;
+
+    std::fill( dirty_.begin(), dirty_.end(), (uint8_t)0u );
+    dirtyIndex_.clear();
+    hierarchy_changed_ = false;
+    return changedIndex_;
+  }
+
+  //Subtrees of dirty transforms with a dirty ancestor are updated as part of the ancestor's subtree
+  dirtyRoot_.clear();
+  for( u32 i(0); i<dirtyIndex_.size(); ++i )
+  {
+    u32 ancestor = parentIndex_[dirtyIndex_[i]];
+    while( ancestor != INVALID_INDEX && !dirty_[ancestor] )
+      ancestor = parentIndex_[ancestor];
+
+    if( ancestor == INVALID_INDEX )
+      dirtyRoot_.push_back( dirtyIndex_[i] );
+  }
+
+  for( u32 i(0); i<dirtyIndex_.size(); ++i )
+    dirty_[dirtyIndex_[i]] = 0u;
+  dirtyIndex_.clear();
+
+  //Subtrees don't overlap, so they can be updated in parallel. Each task collects the transforms it
+  //changes and appends them to changedIndex_ when it is done
+  if( threadPool )
+  {
+    parallelFor( threadPool, 0u, (u32)dirtyRoot_.size(), 64u,
+      [&]( uint32_t begin, uint32_t end )
+      {
+        std::vector<uint32_t> stack;
+        std::vector<uint32_t> changed;
+        for( u32 i(begin); i<end; ++i )
+          updateSubtree( dirtyRoot_[i], &stack, &changed );
+
+        std::lock_guard<std::mutex> lock( changedMutex_ );
+        changedIndex_.insert( changedIndex_.end(), changed.begin(), changed.end() );
+      } );
+  }
+  else
+  {
+    for( u32 i(0); i<dirtyRoot_.size(); ++i )
+      updateSubtree( dirtyRoot_[i], &updateStack_, &changedIndex_ );
+  }
+
+  return changedIndex_;
+}
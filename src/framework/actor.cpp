@@ -7,44 +7,16 @@
 */
 
 #include "framework/actor.h"
-#include "core/render.h"
-
-#include "framework/renderer.h"
 
 using namespace bkk::framework;
 using namespace bkk::core;
 
 actor_t::actor_t()
-  :name_(),
-  mesh_(core::BKK_NULL_HANDLE),
-  transform_(core::BKK_NULL_HANDLE),
-  material_(core::BKK_NULL_HANDLE)
-{
-}
-
-actor_t::actor_t(const char* name, mesh_handle_t mesh, transform_handle_t transform, material_handle_t material, uint32_t instanceCount, renderer_t* renderer)
-:name_(name), 
- mesh_(mesh), 
- transform_(transform), 
- material_(material),
- instanceCount_(instanceCount)
+  :name_()
 {
-  core::render::context_t& context = renderer->getContext();
-
-  core::render::gpuBufferCreate(context,
-    core::render::gpu_buffer_t::UNIFORM_BUFFER,
-    nullptr, sizeof(core::maths::mat4),
-    nullptr, &uniformBuffer_);
-
-  render::descriptor_t descriptor = render::getDescriptor(uniformBuffer_);
-  render::descriptorSetCreate(context, 
-                              renderer->getDescriptorPool(), renderer->getObjectDescriptorSetLayout(), 
-                              &descriptor, &descriptorSet_);
 }
 
-void actor_t::destroy(renderer_t* renderer)
+actor_t::actor_t(const char* name)
+:name_(name)
 {
-  render::context_t& context = renderer->getContext();
-  render::descriptorSetDestroy(context, &descriptorSet_);
-  render::gpuBufferDestroy(context, nullptr, &uniformBuffer_);
 }
\ No newline at end of file
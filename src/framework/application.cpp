@@ -60,7 +60,7 @@ private:
   float timeAccum_ = 0.0f;
 };
 
-application_t::application_t(const char* title, u32 width, u32 height, u32 imageCount)
+application_t::application_t(const char* title, u32 width, u32 height, u32 imageCount, u32 framesInFlight)
 :timeDelta_(0),
  mouseCurrentPos_(0.0f,0.0f),
  mousePrevPos_(0.0f,0.0f),
@@ -69,7 +69,7 @@ application_t::application_t(const char* title, u32 width, u32 height, u32 image
 {
   core::window::create(title, width, height, &window_);
 
-  renderer_.initialize(title, imageCount, window_);
+  renderer_.initialize(title, imageCount, window_, framesInFlight);
 
   frameCounter_ = new frame_counter_t();
   frameCounter_->init(&window_);
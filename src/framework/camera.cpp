@@ -11,6 +11,7 @@
 #include "core/mesh.h"
 #include "core/window.h"
 #include "core/thread-pool.h"
+#include "core/culling.h"
 
 #include "framework/camera.h"
 #include "framework/actor.h"
@@ -47,7 +48,7 @@ void camera_t::update(renderer_t* renderer)
   if (uniformBuffer_.handle == VK_NULL_HANDLE)
   {
     //Create buffer
-    render::gpuBufferCreate(context, render::gpu_buffer_t::UNIFORM_BUFFER,
+    render::gpuBufferCreate(context, (render::gpu_buffer_t::usage_e)(render::gpu_buffer_t::UNIFORM_BUFFER | render::gpu_buffer_t::TRANSFER_DST),
       (void*)&uniforms_, sizeof(uniforms_),
       nullptr, &uniformBuffer_);
 
@@ -56,97 +57,171 @@ void camera_t::update(renderer_t* renderer)
   }
   else
   {
-    render::gpuBufferUpdate(context, (void*)&uniforms_,
-      0u, sizeof(uniforms_),
-      &uniformBuffer_);
+    renderer->uploadBufferData(&uniforms_, 0u, sizeof(uniforms_), &uniformBuffer_);
   }
 }
 
-class cullTask : public thread_pool_t::task_t
+void camera_t::cull(renderer_t* renderer)
 {
-  public:
-  void init(renderer_t* renderer, actor_t* actors, uint32_t actorCount, maths::vec4* frustum, bool* results)
-  {
-    renderer_ = renderer;
-    actors_ = actors;
-    actorCount_ = actorCount;
-    frustum_ = frustum;
-    results_ = results;
-  }
+  maths::vec4 frustumWS[6];
+  getFrustumPlanes(frustumWS);
 
-  void run()
+  //Cull using the bounding volume hierarchy of the renderer
+  renderer->actorFrustumCull(frustumWS, &visibleIndex_);
+  if (occlusionCulling_ != OCCLUSION_CULLING_NONE)
   {
-    for (uint32_t i = 0; i < actorCount_; ++i)
-    {
-      mesh::mesh_t* mesh = renderer_->getMesh(actors_[i].getMeshHandle());
-      if (mesh)
-      {
-        //Transform aabb to world space
-        maths::aabb_t aabbWS = maths::aabbTransform(mesh->aabb, *renderer_->getTransform(actors_[i].getTransformHandle()));
-        results_[i] = aabbInFrustum(aabbWS, frustum_);
-      }
-    }
+    rasterizeOccluders(renderer);
+    renderer->actorOcclusionCull(depthPyramid_, &visibleIndex_);
   }
 
-  renderer_t* renderer_;
-  actor_t* actors_;
-  uint32_t actorCount_;
-  maths::vec4* frustum_;
+  setVisibleActors(renderer, &visibleIndex_);
+}
 
-  bool* results_;
-};
+void camera_t::getFrustumPlanes(maths::vec4* frustumPlanes)
+{
+  maths::frustumPlanesFromMatrix(uniforms_.worldToView * uniforms_.projection, frustumPlanes);
+}
 
-void camera_t::cull(renderer_t* renderer, actor_t* actors, uint32_t actorCount)
+void camera_t::setVisibleActors(renderer_t* renderer, std::vector<uint32_t>* actorIndex)
 {
-  //Extract frustum planes in world space
-  maths::vec4 frustumWS[6];
-  maths::frustumPlanesFromMatrix(uniforms_.worldToView * uniforms_.projection, &frustumWS[0]);
+  //Swapping hands the previous buffer back to the caller, so it can be reused the next time
+  if (actorIndex != &visibleIndex_)
+    visibleIndex_.swap(*actorIndex);
 
-  visibleActorsCount_ = 0u;
-  visibleActors_.resize(actorCount);
+  culled_ = true;
+}
 
-  uint32_t cullTaskCount = renderer->getThreadPool()->getThreadCount();
-  std::vector<cullTask> cullTasks(cullTaskCount);
-  uint32_t actorsPerCullTask = actorCount / cullTaskCount;
-  uint32_t currentActor = 0;
-  bool* cullingResults = new bool[actorCount];
-  for (uint32_t i(0); i < cullTaskCount; ++i)
+void camera_t::destroy(renderer_t* renderer)
+{
+  //Frames in flight may still be reading the uniforms and copying to the readback buffers
+  if (uniformBuffer_.handle != VK_NULL_HANDLE)
+  {
+    renderer->releaseBuffer(uniformBuffer_);
+    renderer->releaseDescriptorSet(descriptorSet_);
+  }
+
+  for (uint32_t i(0); i < depthReadback_.size(); ++i)
   {
-    uint32_t count = (i < cullTaskCount - 1) ? actorsPerCullTask :
-                                               actorCount - currentActor;
+    if (depthReadback_[i].buffer.handle != VK_NULL_HANDLE)
+      renderer->releaseBuffer(depthReadback_[i].buffer);
+  }
+  depthReadback_.clear();
+}
+
+void camera_t::setOcclusionCulling(occlusion_culling_e mode, frame_buffer_handle_t frameBuffer)
+{
+  occlusionCulling_ = mode;
+  occlusionFrameBuffer_ = frameBuffer;
+
+  //Depth pyramid is not valid until the depth rendered from the new frame buffer is read back
+  depthPyramid_.levelCount = 0u;
+  for (uint32_t i(0); i < depthReadback_.size(); ++i)
+    depthReadback_[i].pending = false;
 
-    cullTasks[i].init(renderer, actors+currentActor, count, frustumWS, cullingResults+currentActor);
-    currentActor += count;
+  culled_ = false;
+}
+
+bool camera_t::recordDepthReadback(renderer_t* renderer, uint32_t frame, const render::command_buffer_t& commandBuffer)
+{
+  if (occlusionCulling_ != OCCLUSION_CULLING_GPU_DEPTH)
+    return false;
 
-    renderer->getThreadPool()->addTask(&cullTasks[i]);
+  frame_buffer_t* frameBuffer = renderer->getFrameBuffer(occlusionFrameBuffer_ == BKK_NULL_HANDLE ? renderer->getBackBuffer() : occlusionFrameBuffer_);
+  if (!frameBuffer)
+    return false;
+
+  render_target_t* target = nullptr;
+  for (uint32_t i(0); i < frameBuffer->getTargetCount() && target == nullptr; ++i)
+  {
+    render_target_t* renderTarget = renderer->getRenderTarget(frameBuffer->getTarget(i));
+    if (renderTarget && renderTarget->hasDepthBuffer())
+      target = renderTarget;
   }
 
-  renderer->getThreadPool()->waitForCompletion();
+  if (!target)
+    return false;
 
-  for (uint32_t i(0); i < actorCount; ++i)
+  render::context_t& context = renderer->getContext();
+  if (depthReadback_.size() < render::getFrameCount(context))
+    depthReadback_.resize(render::getFrameCount(context));
+
+  //(Re)create the readback buffer if the size of the depth buffer has changed. The GPU is done with the
+  //last copy to the buffer of this frame, so it can be destroyed right away
+  depth_readback_t& readback = depthReadback_[frame];
+  const render::depth_stencil_buffer_t& depthBuffer = *target->getDepthStencilBuffer();
+  size_t size = target->getWidth() * target->getHeight() * render::depthStencilBufferDepthSize(depthBuffer);
+  if (readback.buffer.handle == VK_NULL_HANDLE || readback.buffer.memory.size < size)
   {
-    if (cullingResults[i])
-      visibleActors_[visibleActorsCount_++] = actors[i];
+    if (readback.buffer.handle != VK_NULL_HANDLE)
+      render::gpuBufferDestroy(context, nullptr, &readback.buffer);
+
+    render::gpuBufferCreate(context, render::gpu_buffer_t::TRANSFER_DST, render::gpu_memory_type_e::HOST_VISIBLE_COHERENT,
+      nullptr, size, nullptr, &readback.buffer);
   }
 
-  delete[] cullingResults;
-  visibleActors_.resize(visibleActorsCount_);
+  render::depthStencilBufferCopyDepth(commandBuffer, depthBuffer, target->getWidth(), target->getHeight(), &readback.buffer);
+  readback.width = target->getWidth();
+  readback.height = target->getHeight();
+  readback.format = depthBuffer.format;
+  readback.viewProjection = uniforms_.viewProjection;
+  readback.pending = true;
+  return true;
 }
 
-void camera_t::destroy(renderer_t* renderer)
+void camera_t::updateDepthPyramid(renderer_t* renderer, uint32_t frame)
 {
+  if (frame >= depthReadback_.size() || !depthReadback_[frame].pending)
+    return;
+
+  depth_readback_t& readback = depthReadback_[frame];
+  readback.pending = false;
+
   render::context_t& context = renderer->getContext();
-  if (uniformBuffer_.handle != VK_NULL_HANDLE)
+  const void* data = render::gpuBufferMap(context, readback.buffer);
+
+  //Convert normalized integer formats to float
+  uint32_t texelCount = readback.width * readback.height;
+  const f32* depth = (const f32*)data;
+  if (readback.format == VK_FORMAT_D16_UNORM || readback.format == VK_FORMAT_D16_UNORM_S8_UINT)
   {
-    render::gpuBufferDestroy(context, nullptr, &uniformBuffer_);
-    render::descriptorSetDestroy(context, &descriptorSet_);
+    depthData_.resize(texelCount);
+    for (uint32_t i(0); i < texelCount; ++i)
+      depthData_[i] = ((const uint16_t*)data)[i] / 65535.0f;
+
+    depth = depthData_.data();
+  }
+  else if (readback.format == VK_FORMAT_D24_UNORM_S8_UINT || readback.format == VK_FORMAT_X8_D24_UNORM_PACK32)
+  {
+    depthData_.resize(texelCount);
+    for (uint32_t i(0); i < texelCount; ++i)
+      depthData_[i] = (((const uint32_t*)data)[i] & 0x00FFFFFFu) / 16777215.0f;
+
+    depth = depthData_.data();
   }
+
+  culling::depthPyramidBuild(depth, readback.width, readback.height, readback.viewProjection, &depthPyramid_);
+  render::gpuBufferUnmap(context, readback.buffer);
+
+  //Visible actors have to be tested against the new depth
+  culled_ = false;
+}
+
+void camera_t::rasterizeOccluders(renderer_t* renderer)
+{
+  if (occlusionCulling_ != OCCLUSION_CULLING_SOFTWARE)
+    return;
+
+  const uint32_t width = culling::OCCLUSION_BUFFER_WIDTH;
+  const uint32_t height = culling::OCCLUSION_BUFFER_HEIGHT;
+  depthData_.resize(width * height);
+  renderer->rasterizeOccluders(uniforms_.viewProjection, width, height, &occlusionRasterizer_, depthData_.data());
+  culling::depthPyramidBuild(depthData_.data(), width, height, uniforms_.viewProjection, &depthPyramid_);
 }
 
-uint32_t camera_t::getVisibleActors(actor_t** actors)
+uint32_t camera_t::getVisibleActors(const uint32_t** actorIndex)
 {
-  *actors = visibleActors_.data();
-  return visibleActorsCount_;
+  *actorIndex = visibleIndex_.data();
+  return (uint32_t)visibleIndex_.size();
 }
 
 void camera_t::setViewToWorldMatrix(const maths::mat4& m)
@@ -155,6 +230,7 @@ void camera_t::setViewToWorldMatrix(const maths::mat4& m)
   maths::invertMatrix(m, &uniforms_.worldToView);
 
   uniforms_.viewProjection = uniforms_.worldToView * uniforms_.projection;
+  culled_ = false;
 }
 
 void camera_t::setWorldToViewMatrix(const maths::mat4& m)
@@ -163,6 +239,7 @@ void camera_t::setWorldToViewMatrix(const maths::mat4& m)
   maths::invertMatrix(m, &uniforms_.viewToWorld);
 
   uniforms_.viewProjection = uniforms_.worldToView * uniforms_.projection;
+  culled_ = false;
 
 }
 
@@ -173,6 +250,7 @@ void camera_t::setProjectionMatrix(const maths::mat4& m)
   maths::invertMatrix(m, &uniforms_.projectionInverse);
 
   uniforms_.viewProjection = uniforms_.worldToView * uniforms_.projection;
+  culled_ = false;
 }
 
 orbiting_camera_controller_t::orbiting_camera_controller_t()
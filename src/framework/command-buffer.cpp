@@ -9,6 +9,7 @@
 #include "core/mesh.h"
 #include "core/maths.h"
 #include "core/string-utils.h"
+#include "core/dynamic-array.h"
 
 #include "framework/command-buffer.h"
 #include "framework/frame-buffer.h"
@@ -24,35 +25,30 @@ using namespace bkk::framework;
 command_buffer_t::command_buffer_t()
   :renderer_(nullptr),
   frameBuffer_(BKK_NULL_HANDLE),
-  commandBuffer_(),
-  semaphore_(),
+  commandBuffer_(nullptr),
+  semaphore_(VK_NULL_HANDLE),
   clearColor_(0.0f, 0.0f, 0.0f, 0.0f),
   clear_(false),
-  released_(false),
   signalSemaphore_(VK_NULL_HANDLE)
 {}
 
-command_buffer_t::command_buffer_t(renderer_t* renderer, const char* name, VkSemaphore signalSemaphore, VkCommandPool pool)
+command_buffer_t::command_buffer_t(renderer_t* renderer, const char* name, VkSemaphore signalSemaphore)
 :renderer_(renderer), 
- commandBuffer_(),
- commandPool_(pool), 
- semaphore_(render::semaphoreCreate(renderer->getContext())),
+ commandBuffer_(nullptr),
+ semaphore_(VK_NULL_HANDLE),
  frameBuffer_(renderer->getBackBuffer()),
  clearColor_(0.0f, 0.0f, 0.0f, 0.0f),
  clear_(false),
- released_(false),
  signalSemaphore_(signalSemaphore)
 {
   name_ = name ? name : "";
 }
 
-void command_buffer_t::init(renderer_t* renderer, const char* name, VkSemaphore signalSemaphore, VkCommandPool pool)
+void command_buffer_t::init(renderer_t* renderer, const char* name, VkSemaphore signalSemaphore)
 {
   if (renderer_ == nullptr)
   {
     renderer_ = renderer;
-    semaphore_ = render::semaphoreCreate(renderer->getContext());
-    commandPool_ = pool;
     frameBuffer_ = renderer->getBackBuffer();
     signalSemaphore_ = signalSemaphore;
     name_ = name ? name : "";
@@ -83,9 +79,11 @@ void command_buffer_t::setDependencies(command_buffer_t* prevCommandBuffers, uin
 
 void command_buffer_t::createCommandBuffer(type_e type)
 {
-  if (commandBuffer_.handle != VK_NULL_HANDLE)
+  if (commandBuffer_ != nullptr)
     return;
 
+  //Command buffer, fence and semaphore come from the renderer and are reused in later frames
+  semaphore_ = renderer_->acquireSemaphore();
   std::vector<VkSemaphore> signalSemaphores(1);
   signalSemaphores[0] = semaphore_;
   if (signalSemaphore_ != VK_NULL_HANDLE )
@@ -94,14 +92,18 @@ void command_buffer_t::createCommandBuffer(type_e type)
     signalSemaphores.push_back( renderer_->getRenderCompleteSemaphore() );
   }
 
-  uint32_t dependencyCount = (uint32_t)dependencies_.size();
-  std::vector<VkSemaphore> waitSemaphores(dependencyCount);
-  std::vector<VkPipelineStageFlags> waitStage(dependencyCount);
-  for (uint32_t i(0); i < dependencyCount; ++i)
+  //Dependencies without commands have no semaphore
+  std::vector<VkSemaphore> waitSemaphores;
+  std::vector<VkPipelineStageFlags> waitStage;
+  for (uint32_t i(0); i < dependencies_.size(); ++i)
   {
-    waitSemaphores[i] = dependencies_[i].getSemaphore();
-    waitStage[i] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    if (dependencies_[i].getSemaphore() != VK_NULL_HANDLE)
+    {
+      waitSemaphores.push_back(dependencies_[i].getSemaphore());
+      waitStage.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    }
   }
+  uint32_t dependencyCount = (uint32_t)waitSemaphores.size();
   
   core::render::command_buffer_t::type_e commandType = type == GRAPHICS ?
     core::render::command_buffer_t::GRAPHICS :
@@ -109,8 +111,8 @@ void command_buffer_t::createCommandBuffer(type_e type)
   VkSemaphore* waitSemaphorePtr = dependencyCount == 0 ? nullptr : &waitSemaphores[0];
   VkPipelineStageFlags* waitStagePtr = dependencyCount == 0 ? nullptr : &waitStage[0];
 
-  render::commandBufferCreate(renderer_->getContext(), VK_COMMAND_BUFFER_LEVEL_PRIMARY, waitSemaphorePtr, waitStagePtr, 
-    dependencyCount, signalSemaphores.data(), (uint32_t)signalSemaphores.size(), commandType, commandPool_, &commandBuffer_);
+  commandBuffer_ = renderer_->acquireCommandBuffer(commandType, waitSemaphorePtr, waitStagePtr, dependencyCount,
+    signalSemaphores.data(), (uint32_t)signalSemaphores.size());
 }
 
 void command_buffer_t::clearRenderTargets(const core::maths::vec4& color)
@@ -123,13 +125,13 @@ void command_buffer_t::beginCommandBuffer()
 {  
   createCommandBuffer(GRAPHICS);
 
-  if (commandBuffer_.handle == VK_NULL_HANDLE)
+  if (commandBuffer_ == nullptr)
     return;
 
   render::context_t& context = renderer_->getContext();
 
   frame_buffer_t* frameBuffer = renderer_->getFrameBuffer(frameBuffer_);
-  render::commandBufferBegin(context, commandBuffer_);
+  render::commandBufferBegin(context, *commandBuffer_);
 
   VkClearValue* clearValues = nullptr;
   uint32_t clearValuesCount = 0u;
@@ -143,10 +145,10 @@ void command_buffer_t::beginCommandBuffer()
     clearValues[clearValuesCount - 1].depthStencil = { 1.0f,0 };
   }
 
-  render::commandBufferRenderPassBegin(context, &frameBuffer->getFrameBuffer(), &clearValues[0], clearValuesCount, commandBuffer_);
+  render::commandBufferRenderPassBegin(context, &frameBuffer->getFrameBuffer(), &clearValues[0], clearValuesCount, *commandBuffer_);
 
   if (!name_.empty())
-    render::commandBufferDebugMarkerBegin(renderer_->getContext(), commandBuffer_, name_.c_str());
+    render::commandBufferDebugMarkerBegin(renderer_->getContext(), *commandBuffer_, name_.c_str());
 
   if (clearValues)
     delete[] clearValues;
@@ -155,12 +157,12 @@ void command_buffer_t::beginCommandBuffer()
 void command_buffer_t::endCommandBuffer()
 {
   if (!name_.empty())
-    render::commandBufferDebugMarkerEnd(renderer_->getContext(), commandBuffer_);
+    render::commandBufferDebugMarkerEnd(renderer_->getContext(), *commandBuffer_);
 
-  render::commandBufferEnd(commandBuffer_);
+  render::commandBufferEnd(*commandBuffer_);
 }
 
-void command_buffer_t::render(actor_t* actors, uint32_t actorCount, const char* passName)
+void command_buffer_t::render(const uint32_t* actorIndex, uint32_t actorCount, const char* passName)
 {
   if (!renderer_) return;
 
@@ -168,49 +170,100 @@ void command_buffer_t::render(actor_t* actors, uint32_t actorCount, const char*
 
   beginCommandBuffer();
   
-  if (commandBuffer_.handle == VK_NULL_HANDLE)
+  if (commandBuffer_ == nullptr)
     return;
 
+  actor_columns_t columns;
+  getActorColumns(&columns);
+
+  //Draws are sorted by material (high bits of the key) so state is bound once per material. Command buffers
+  //are recorded from several threads, so each thread keeps its own keys to avoid allocations every frame
+  static thread_local dynamic_array_t<uint64_t> drawKey;
+  drawKey.resize(actorCount);
+  for (uint32_t i = 0; i < actorCount; ++i)
+    drawKey[i] = ((uint64_t)columns.material[actorIndex[i]].index << 32u) | actorIndex[i];
+
+  drawKey.radixSort();
+
+  material_t* boundMaterial = nullptr;
+  for (uint32_t i = 0; i < actorCount; ++i)
+    renderActor(columns, (uint32_t)drawKey[i], camera, passName, &boundMaterial);
+  
+  render::commandBufferRenderPassEnd(*commandBuffer_);
+  endCommandBuffer();
+}
+
+void command_buffer_t::render(const actor_handle_t* actors, uint32_t actorCount, const char* passName)
+{
+  if (!renderer_) return;
+
+  camera_t* camera = renderer_->getActiveCamera();
+
+  beginCommandBuffer();
+
+  if (commandBuffer_ == nullptr)
+    return;
+
+  actor_columns_t columns;
+  getActorColumns(&columns);
+
+  material_t* boundMaterial = nullptr;
   for (uint32_t i = 0; i < actorCount; ++i)
   {
-    material_t* material = renderer_->getMaterial(actors[i].getMaterialHandle());
-    core::mesh::mesh_t* mesh = renderer_->getMesh(actors[i].getMeshHandle());
+    uint32_t actorIndex;
+    if (renderer_->getActorIndex(actors[i], &actorIndex))
+      renderActor(columns, actorIndex, camera, passName, &boundMaterial);
+  }
+
+  render::commandBufferRenderPassEnd(*commandBuffer_);
+  endCommandBuffer();
+}
+
+void command_buffer_t::getActorColumns(actor_columns_t* columns)
+{
+  renderer_->getAllActorMeshes(&columns->mesh);
+  renderer_->getAllActorTransforms(&columns->transform);
+  renderer_->getAllActorMaterials(&columns->material);
+  renderer_->getAllActorInstanceCounts(&columns->instanceCount);
+}
 
-    if (material && mesh )
+void command_buffer_t::renderActor(const actor_columns_t& columns, uint32_t actorIndex, camera_t* camera, const char* passName, material_t** boundMaterial)
+{
+  material_t* material = renderer_->getMaterial(columns.material[actorIndex]);
+  core::mesh::mesh_t* mesh = renderer_->getMesh(columns.mesh[actorIndex]);
+
+  uint32_t objectUniformOffset;
+  if (material && mesh && renderer_->getObjectUniformOffset(columns.transform[actorIndex], &objectUniformOffset))
+  {
+    core::render::graphics_pipeline_t pipeline = material->getPipeline(passName, frameBuffer_, renderer_);
+    if (pipeline.handle != VK_NULL_HANDLE)
     {
-      core::render::graphics_pipeline_t pipeline = material->getPipeline(passName, frameBuffer_, renderer_);
-      if (pipeline.handle != VK_NULL_HANDLE)
+      //Pipeline, camera uniform buffer and material descriptor set are the same for consecutive actors sharing the material
+      if (material != *boundMaterial)
       {
-        //TODO: Order objects by material and bind pipeline and camera ubo only once for all objects
-        //sharing the same material
-        render::graphicsPipelineBind(commandBuffer_, pipeline );
+        render::graphicsPipelineBind(*commandBuffer_, pipeline);
+        render::descriptorSetBind(*commandBuffer_, pipeline.layout, 0, &camera->getDescriptorSet(), 1u);
 
-        //Camera uniform buffer
-        render::descriptorSetBind(commandBuffer_, pipeline.layout, 0, &camera->getDescriptorSet(), 1u);
-      
-        //Object uniform buffer
-        render::descriptorSetBind(commandBuffer_, pipeline.layout, 1, &actors[i].getDescriptorSet(), 1u);
-
-        //Material descriptor set
         render::descriptor_set_t materialDescriptorSet = material->getDescriptorSet(passName);
-        render::descriptorSetBind(commandBuffer_, pipeline.layout, 2, &materialDescriptorSet, 1u);
-
-        //Draw call
-        uint32_t instanceCount = actors[i].getInstanceCount();
-        if (instanceCount == 1)
-        {
-          core::mesh::draw(commandBuffer_, *mesh);
-        }
-        else
-        {
-          core::mesh::drawInstanced(commandBuffer_, instanceCount, nullptr, 0u, *mesh);
-        }
+        render::descriptorSetBind(*commandBuffer_, pipeline.layout, 2, &materialDescriptorSet, 1u);
+        *boundMaterial = material;
+      }
+
+      //Object uniforms
+      render::descriptorSetBind(*commandBuffer_, pipeline.layout, 1, renderer_->getObjectDescriptorSet(), 1u, &objectUniformOffset, 1u);
+
+      //Draw call
+      uint32_t instanceCount = columns.instanceCount[actorIndex];
+      if (instanceCount == 1)
+      {
+        core::mesh::draw(*commandBuffer_, *mesh);
+      }
+      else
+      {
+        core::mesh::drawInstanced(*commandBuffer_, instanceCount, nullptr, 0u, *mesh);
       }
     }
   }
-  
-  render::commandBufferRenderPassEnd(commandBuffer_);
-  endCommandBuffer();
 }
 
 void command_buffer_t::blit(render_target_handle_t renderTarget, material_handle_t materialHandle, const char* pass)
@@ -257,8 +310,13 @@ void command_buffer_t::blit(const bkk::core::render::texture_t& texture, materia
   material->updateDescriptorSet(passName);
 
   camera_t* camera = renderer_->getActiveCamera();
-  actor_t* actor = renderer_->getActor(renderer_->getRootActor());
-  mesh::mesh_t* mesh = renderer_->getMesh(actor->getMeshHandle());
+  uint32_t rootActor = 0u;
+  renderer_->getActorIndex(renderer_->getRootActor(), &rootActor);
+  actor_columns_t columns;
+  getActorColumns(&columns);
+  mesh::mesh_t* mesh = renderer_->getMesh(columns.mesh[rootActor]);
+  uint32_t objectUniformOffset = 0u;
+  renderer_->getObjectUniformOffset(columns.transform[rootActor], &objectUniformOffset);
 
   
 
@@ -267,14 +325,14 @@ void command_buffer_t::blit(const bkk::core::render::texture_t& texture, materia
 
   beginCommandBuffer();
 
-  render::graphicsPipelineBind(commandBuffer_, pipeline);
-  render::descriptorSetBind(commandBuffer_, pipeline.layout, 0, &camera->getDescriptorSet(), 1u);
-  render::descriptorSetBind(commandBuffer_, pipeline.layout, 1, &actor->getDescriptorSet(), 1u);
-  render::descriptorSetBind(commandBuffer_, pipeline.layout, 2, &materialDescriptorSet, 1u);
+  render::graphicsPipelineBind(*commandBuffer_, pipeline);
+  render::descriptorSetBind(*commandBuffer_, pipeline.layout, 0, &camera->getDescriptorSet(), 1u);
+  render::descriptorSetBind(*commandBuffer_, pipeline.layout, 1, renderer_->getObjectDescriptorSet(), 1u, &objectUniformOffset, 1u);
+  render::descriptorSetBind(*commandBuffer_, pipeline.layout, 2, &materialDescriptorSet, 1u);
 
-  core::mesh::draw(commandBuffer_, *mesh);
+  core::mesh::draw(*commandBuffer_, *mesh);
 
-  render::commandBufferRenderPassEnd(commandBuffer_);
+  render::commandBufferRenderPassEnd(*commandBuffer_);
   endCommandBuffer();
 }
 
@@ -295,11 +353,11 @@ void command_buffer_t::changeLayout(const layout_transition_t* transitions, uint
     return;
   
   createCommandBuffer(GRAPHICS);
-  if (commandBuffer_.handle == VK_NULL_HANDLE)
+  if (commandBuffer_ == nullptr)
     return;
 
   render::context_t& context = renderer_->getContext();
-  render::commandBufferBegin(context, commandBuffer_);
+  render::commandBufferBegin(context, *commandBuffer_);
 
   for (uint32_t i(0); i < count; ++i)
   {
@@ -318,10 +376,10 @@ void command_buffer_t::changeLayout(const layout_transition_t* transitions, uint
       subresourceRange.layerCount = 1u;
       subresourceRange.aspectMask = texture->aspectFlags;
 
-      render::textureChangeLayout(commandBuffer_, transitions[i].layout, transitions[i].srcStageMask, transitions[i].dstStageMask, texture);
+      render::textureChangeLayout(*commandBuffer_, transitions[i].layout, transitions[i].srcStageMask, transitions[i].dstStageMask, texture);
     }
   }
-  render::commandBufferEnd(commandBuffer_);
+  render::commandBufferEnd(*commandBuffer_);
 }
 
 void command_buffer_t::dispatchCompute(compute_material_handle_t computeMaterial, uint32_t pass, uint32_t groupSizeX, uint32_t groupSizeY, uint32_t groupSizeZ)
@@ -333,7 +391,7 @@ void command_buffer_t::dispatchCompute(compute_material_handle_t computeMaterial
     return;
 
   createCommandBuffer(COMPUTE);
-  computeMaterialPtr->dispatch(commandBuffer_, pass, groupSizeX, groupSizeY, groupSizeZ);
+  computeMaterialPtr->dispatch(*commandBuffer_, pass, groupSizeX, groupSizeY, groupSizeZ);
   endCommandBuffer();
 }
 
@@ -346,49 +404,25 @@ void command_buffer_t::dispatchCompute(compute_material_handle_t computeMaterial
     return;
 
   createCommandBuffer(COMPUTE);
-  computeMaterialPtr->dispatch(commandBuffer_, pass, groupSizeX, groupSizeY, groupSizeZ);
+  computeMaterialPtr->dispatch(*commandBuffer_, pass, groupSizeX, groupSizeY, groupSizeZ);
   endCommandBuffer();
 }
 
 void command_buffer_t::submit()
 {
-  if (renderer_ && commandBuffer_.handle != VK_NULL_HANDLE)
-  {
-    render::context_t& context = renderer_->getContext();
-    render::commandBufferSubmit(context, commandBuffer_);
-  }
+  if (renderer_ && commandBuffer_ != nullptr)
+    renderer_->submitCommandBuffer(*commandBuffer_);
 }
 
 void command_buffer_t::release()
 {
-  if (renderer_ && !released_)
-  {    
-    renderer_->releaseCommandBuffer(this);
-    released_ = true;
-  }
+  //Vulkan objects are recycled by the renderer once the GPU is done with the frame
 }
 
 void command_buffer_t::submitAndRelease()
 {
-  if (renderer_ && commandBuffer_.handle != VK_NULL_HANDLE)
-  {   
-    render::context_t& context = renderer_->getContext();
-    render::commandBufferSubmit(context, commandBuffer_);
-    renderer_->releaseCommandBuffer(this);
-    released_ = true;
-  }
-}
-
-void command_buffer_t::cleanup()
-{
-  if (renderer_ && commandBuffer_.handle != VK_NULL_HANDLE)
-  {
-    render::context_t& context = renderer_->getContext();
-    core::render::commandBufferDestroy(context, &commandBuffer_);
-    commandBuffer_ = {};
-    render::semaphoreDestroy(context, semaphore_);
-    released_ = true;
-  }
+  submit();
+  release();
 }
 
 VkSemaphore command_buffer_t::getSemaphore() 
@@ -396,73 +430,11 @@ VkSemaphore command_buffer_t::getSemaphore()
   return semaphore_; 
 }
 
-class render_task_t : public bkk::core::thread_pool_t::task_t
-{
-  public:
-    
-    render_task_t() {}
-    void init(renderer_t* renderer, const std::string& name, frame_buffer_handle_t framebuffer,
-      actor_t* actors, uint32_t actorCount, const char* passName,
-      const core::maths::vec4* clearColor,
-      VkCommandPool commandPool, VkSemaphore signalSemaphore, 
-      command_buffer_t* prevCommandBuffers, uint32_t prevCommandBuffersCount,
-      layout_transition_t* layoutTransitions, uint32_t layoutTransitionsCount,
-      command_buffer_t* commandBuffer )
-    {
-      renderer_ = renderer;
-      name_ = name;
-      framebuffer_ = framebuffer;
-      actors_ = actors;
-      actorCount_ = actorCount;
-      passName_ = passName;
-      clearColor_ = clearColor;
-      commandPool_ = commandPool;
-      signalSemaphore_ = signalSemaphore;
-      prevCommandBuffers_ = prevCommandBuffers;
-      prevCommandBuffersCount_ = prevCommandBuffersCount;
-      layoutTransitions_ = layoutTransitions;
-      layoutTransitionsCount_ = layoutTransitionsCount;
-      commandBuffer_ = commandBuffer;
-    }
-
-    void run()
-    {
-      commandBuffer_->init(renderer_, name_.c_str(), signalSemaphore_, commandPool_);
-      commandBuffer_->setFrameBuffer(framebuffer_);
-      commandBuffer_->setDependencies(prevCommandBuffers_, prevCommandBuffersCount_);
-      commandBuffer_->changeLayout(layoutTransitions_, layoutTransitionsCount_);
-      if (clearColor_)
-        commandBuffer_->clearRenderTargets(*clearColor_);
-
-      commandBuffer_->render(actors_, actorCount_, passName_);
-    }
-  
-  private:
-    renderer_t* renderer_;
-    std::string name_;
-    frame_buffer_handle_t framebuffer_;
-    actor_t* actors_;
-    uint32_t actorCount_;
-    const char* passName_;
-    const core::maths::vec4* clearColor_;
-    VkCommandPool commandPool_;
-    VkSemaphore signalSemaphore_;
-
-    command_buffer_t* prevCommandBuffers_;
-    uint32_t prevCommandBuffersCount_;
-
-    layout_transition_t* layoutTransitions_; 
-    uint32_t layoutTransitionsCount_;
-
-    command_buffer_t* commandBuffer_;
-
-};
-
 void bkk::framework::generateCommandBuffersParallel(renderer_t* renderer,
   const char* name,
   frame_buffer_handle_t framebuffer,
   const maths::vec4* clearColor,
-  actor_t* actors, uint32_t actorCount,
+  const uint32_t* actorIndex, uint32_t actorCount,
   const char* passName,
   VkSemaphore signalSemaphore,
   command_buffer_t* prevCommandBuffers, uint32_t prevCommandBufferCount,
@@ -473,48 +445,39 @@ void bkk::framework::generateCommandBuffersParallel(renderer_t* renderer,
   framebuffer = (framebuffer != BKK_NULL_HANDLE) ? framebuffer : renderer->getBackBuffer();
   renderer->prepareShaders(passName, framebuffer);
 
-  uint32_t actorsPerCommand = actorCount / commandBufferCount;
-  uint32_t currentActor = 0u;
-  uint32_t commandPoolCount = renderer->getCommandPoolCount();
-
-  //Configure tasks
-  std::vector<render_task_t> renderTask(commandBufferCount);
-  for (uint32_t i(0); i < commandBufferCount; ++i)
-  {
-    commandBuffers[i] = {};
-
-    uint32_t count = (i < commandBufferCount - 1) ? actorsPerCommand :
-                                                    actorCount - currentActor;
-
-    std::string cmdBufferName = (name ? name : "ParallelRenderCmdBuffer") + intToString(i);
+  std::string baseName = name ? name : "ParallelRenderCmdBuffer";
+  thread_pool_t* threadPool = renderer->getThreadPool();
 
-    //Last command buffer is responsible for signaling the signalSempaphore (in case there is one)
-    VkSemaphore signal = (i == commandBufferCount - 1) ? signalSemaphore : VK_NULL_HANDLE;
-
-    //First command buffer is responsible for clearing the framebuffer (in case clearing is requested)
-    const maths::vec4* clear = (i == 0u) ? clearColor : nullptr;
-
-    VkCommandPool commandPool = renderer->getCommandPool(i % commandPoolCount);    
+  //Command buffers are handed out to threads on demand
+  parallelFor(threadPool, 0u, commandBufferCount, 1u,
+    [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t i = begin; i < end; ++i)
+      {
+        //Recording an actor costs the same whatever its mesh (pipelines are created by prepareShaders, then three
+        //descriptor set binds and a draw), so splitting by count splits by cost. Sizes differ by one actor at most
+        uint32_t firstActor = (uint32_t)((uint64_t)i * actorCount / commandBufferCount);
+        uint32_t count = (uint32_t)((uint64_t)(i + 1) * actorCount / commandBufferCount) - firstActor;
 
-    renderTask[i].init(renderer, cmdBufferName, framebuffer, actors + currentActor, count, passName,
-      clear, commandPool, signal, 
-      prevCommandBuffers, (i == 0u) ? prevCommandBufferCount : 0u,
-      layoutTransitions, (i == 0u)  ? layoutTransitionsCount : 0u,
-      &commandBuffers[i]);
+        std::string cmdBufferName = baseName + intToString(i);
 
-    //Ensure command pools are not used from two different threads at the same time
-    //making tasks dependent on previous task using that same pool
-    if (i >= commandPoolCount)
-      renderTask[i].dependsOn(&renderTask[i - commandPoolCount]);
+        //Last command buffer is responsible for signaling the signalSempaphore (in case there is one)
+        VkSemaphore signal = (i == commandBufferCount - 1) ? signalSemaphore : VK_NULL_HANDLE;
 
-    currentActor += count;
-  }
+        command_buffer_t& commandBuffer = commandBuffers[i];
+        commandBuffer = {};
+        commandBuffer.init(renderer, cmdBufferName.c_str(), signal);
+        commandBuffer.setFrameBuffer(framebuffer);
 
-  //Enqueue tasks for execution. 
-  //Back to front to make sure dependent tasks are enqeued before its dependees
-  for (int32_t i(commandBufferCount - 1); i >= 0; --i)
-    renderer->getThreadPool()->addTask(&renderTask[i]);
-
-  renderer->getThreadPool()->waitForCompletion();
-}
+        //First command buffer waits for previous command buffers, transitions layouts
+        //and clears the framebuffer (in case clearing is requested)
+        commandBuffer.setDependencies(prevCommandBuffers, (i == 0u) ? prevCommandBufferCount : 0u);
+        commandBuffer.changeLayout(layoutTransitions, (i == 0u) ? layoutTransitionsCount : 0u);
+        if (clearColor && i == 0u)
+          commandBuffer.clearRenderTargets(*clearColor);
 
+        commandBuffer.render(actorIndex + firstActor, count, passName);
+      }
+    }
+  );
+}
\ No newline at end of file
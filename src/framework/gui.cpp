@@ -27,8 +27,8 @@ struct gui_context_t
   render::shader_t vertexShader;
   render::shader_t fragmentShader;
   render::vertex_format_t vertexFormat;
-  render::gpu_buffer_t vertexBuffer = {};
-  render::gpu_buffer_t indexBuffer = {};
+  std::vector<render::gpu_buffer_t> vertexBuffer;   //One per frame in flight
+  std::vector<render::gpu_buffer_t> indexBuffer;
   maths::vec4 scaleAndOffset;
 };
 
@@ -167,8 +167,14 @@ void gui::destroy(const render::context_t& context)
     render::shaderDestroy(context, &gGuiContext.vertexShader);
     render::shaderDestroy(context, &gGuiContext.fragmentShader);
     render::vertexFormatDestroy(&gGuiContext.vertexFormat);
-    render::gpuBufferDestroy(context, nullptr, &gGuiContext.vertexBuffer);
-    render::gpuBufferDestroy(context, nullptr, &gGuiContext.indexBuffer);
+    for (uint32_t i(0); i < gGuiContext.vertexBuffer.size(); ++i)
+    {
+      if (gGuiContext.vertexBuffer[i].handle != VK_NULL_HANDLE)
+        render::gpuBufferDestroy(context, nullptr, &gGuiContext.vertexBuffer[i]);
+
+      if (gGuiContext.indexBuffer[i].handle != VK_NULL_HANDLE)
+        render::gpuBufferDestroy(context, nullptr, &gGuiContext.indexBuffer[i]);
+    }
     render::descriptorPoolDestroy(context, &gGuiContext.descriptorPool);
     
     ImGui::DestroyContext();
@@ -200,26 +206,37 @@ void gui::draw(const render::context_t& context, render::command_buffer_t comman
   {
     render::commandBufferDebugMarkerBegin(context, commandBuffer, "gui::draw");
 
-    if (gGuiContext.vertexBuffer.memory.size < vertex_size)
+    //Previous frames may still be reading the buffers of the other frames in flight
+    uint32_t frame = render::getFrameIndex(context);
+    if (frame >= gGuiContext.vertexBuffer.size())
+    {
+      gGuiContext.vertexBuffer.resize(render::getFrameCount(context), render::gpu_buffer_t());
+      gGuiContext.indexBuffer.resize(render::getFrameCount(context), render::gpu_buffer_t());
+    }
+
+    render::gpu_buffer_t& vertexBuffer = gGuiContext.vertexBuffer[frame];
+    render::gpu_buffer_t& indexBuffer = gGuiContext.indexBuffer[frame];
+
+    if (vertexBuffer.memory.size < vertex_size)
     {
       render::contextFlush(context);
-      if (gGuiContext.vertexBuffer.handle != VK_NULL_HANDLE)
-        render::gpuBufferDestroy(context, nullptr, &gGuiContext.vertexBuffer);
+      if (vertexBuffer.handle != VK_NULL_HANDLE)
+        render::gpuBufferDestroy(context, nullptr, &vertexBuffer);
 
-      render::gpuBufferCreate(context, render::gpu_buffer_t::VERTEX_BUFFER, nullptr, vertex_size, nullptr, &gGuiContext.vertexBuffer);
+      render::gpuBufferCreate(context, render::gpu_buffer_t::VERTEX_BUFFER, nullptr, vertex_size, nullptr, &vertexBuffer);
     }
 
-    if (gGuiContext.indexBuffer.memory.size < index_size)
+    if (indexBuffer.memory.size < index_size)
     {
       render::contextFlush(context);
-      if (gGuiContext.indexBuffer.handle != VK_NULL_HANDLE)
-        render::gpuBufferDestroy(context, nullptr, &gGuiContext.indexBuffer);
+      if (indexBuffer.handle != VK_NULL_HANDLE)
+        render::gpuBufferDestroy(context, nullptr, &indexBuffer);
 
-      render::gpuBufferCreate(context, render::gpu_buffer_t::INDEX_BUFFER, nullptr, index_size, nullptr, &gGuiContext.indexBuffer);
+      render::gpuBufferCreate(context, render::gpu_buffer_t::INDEX_BUFFER, nullptr, index_size, nullptr, &indexBuffer);
     }
 
-    ImDrawVert* vertexData = (ImDrawVert*)render::gpuBufferMap(context, gGuiContext.vertexBuffer);
-    ImDrawIdx* indexData = (ImDrawIdx*)render::gpuBufferMap(context, gGuiContext.indexBuffer);
+    ImDrawVert* vertexData = (ImDrawVert*)render::gpuBufferMap(context, vertexBuffer);
+    ImDrawIdx* indexData = (ImDrawIdx*)render::gpuBufferMap(context, indexBuffer);
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
       const ImDrawList* cmd_list = draw_data->CmdLists[n];
@@ -232,19 +249,19 @@ void gui::draw(const render::context_t& context, render::command_buffer_t comman
     //Flush buffers
     VkMappedMemoryRange range[2] = {};
     range[0].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    range[0].memory = gGuiContext.vertexBuffer.memory.handle;
+    range[0].memory = vertexBuffer.memory.handle;
     range[0].size = VK_WHOLE_SIZE;
     range[1].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    range[1].memory = gGuiContext.indexBuffer.memory.handle;
+    range[1].memory = indexBuffer.memory.handle;
     range[1].size = VK_WHOLE_SIZE;
     vkFlushMappedMemoryRanges(context.device, 2u, range);
-    render::gpuBufferUnmap(context, gGuiContext.vertexBuffer);
-    render::gpuBufferUnmap(context, gGuiContext.indexBuffer);
+    render::gpuBufferUnmap(context, vertexBuffer);
+    render::gpuBufferUnmap(context, indexBuffer);
 
-    VkBuffer vertex_buffers[3] = { gGuiContext.vertexBuffer.handle,gGuiContext.vertexBuffer.handle,gGuiContext.vertexBuffer.handle };
+    VkBuffer vertex_buffers[3] = { vertexBuffer.handle,vertexBuffer.handle,vertexBuffer.handle };
     VkDeviceSize vertex_offsets[3] = {};
     vkCmdBindVertexBuffers(commandBuffer.handle, 0, 3, vertex_buffers, vertex_offsets);
-    vkCmdBindIndexBuffer(commandBuffer.handle, gGuiContext.indexBuffer.handle, 0, VK_INDEX_TYPE_UINT16);
+    vkCmdBindIndexBuffer(commandBuffer.handle, indexBuffer.handle, 0, VK_INDEX_TYPE_UINT16);
 
     gGuiContext.scaleAndOffset.x = 2.0f / draw_data->DisplaySize.x;
     gGuiContext.scaleAndOffset.y = 2.0f / draw_data->DisplaySize.y;
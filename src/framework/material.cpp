@@ -59,6 +59,7 @@ material_t::material_t(shader_handle_t shaderHandle, renderer_t* renderer)
         render::gpu_buffer_t::usage_e usage = ( bufferDesc[i].type == buffer_desc_t::UNIFORM_BUFFER ) ? 
           render::gpu_buffer_t::UNIFORM_BUFFER :
           render::gpu_buffer_t::STORAGE_BUFFER;
+        usage = (render::gpu_buffer_t::usage_e)(usage | render::gpu_buffer_t::TRANSFER_DST);
 
         render::gpu_buffer_t buffer = {};
         render::gpuBufferCreate(context,
@@ -189,6 +190,21 @@ bool material_t::setProperty(const char* property, void* value)
   return false;
 }
 
+//Setting the same resource again doesn't need a new descriptor set
+static bool isSameBuffer(const render::descriptor_t& a, const render::descriptor_t& b)
+{
+  return a.bufferDescriptor.buffer == b.bufferDescriptor.buffer &&
+         a.bufferDescriptor.offset == b.bufferDescriptor.offset &&
+         a.bufferDescriptor.range == b.bufferDescriptor.range;
+}
+
+static bool isSameTexture(const render::descriptor_t& a, const render::descriptor_t& b)
+{
+  return a.imageDescriptor.imageView == b.imageDescriptor.imageView &&
+         a.imageDescriptor.sampler == b.imageDescriptor.sampler &&
+         a.imageDescriptor.imageLayout == b.imageDescriptor.imageLayout;
+}
+
 bool material_t::setBuffer(const char* property, render::gpu_buffer_t buffer)
 {
   shader_t* shader = renderer_->getShader(shader_);
@@ -209,7 +225,7 @@ bool material_t::setBuffer(const char* property, render::gpu_buffer_t buffer)
 
   for (int i = 0; i < descriptorSet_.size(); ++i)
   {
-    if (descriptorSet_[i].handle != VK_NULL_HANDLE)
+    if (descriptorSet_[i].handle != VK_NULL_HANDLE && !isSameBuffer(descriptorSet_[i].descriptors[bindPoint], descriptors_[bindPoint]))
     {
       descriptorSet_[i].descriptors[bindPoint] = render::getDescriptor(buffer);
       updateDescriptorSet_[i] = true;
@@ -252,7 +268,7 @@ bool material_t::setTexture(const char* property, render::texture_t texture)
   descriptors_[bindPoint] = render::getDescriptor(texture);
   for (int i = 0; i < descriptorSet_.size(); ++i)
   {
-    if (descriptorSet_[i].handle != VK_NULL_HANDLE)
+    if (descriptorSet_[i].handle != VK_NULL_HANDLE && !isSameTexture(descriptorSet_[i].descriptors[bindPoint], descriptors_[bindPoint]))
     {
       descriptorSet_[i].descriptors[bindPoint] = render::getDescriptor(texture);
       updateDescriptorSet_[i] = true;
@@ -264,8 +280,6 @@ bool material_t::setTexture(const char* property, render::texture_t texture)
 
 void material_t::updateDescriptorSets()
 {
-  render::context_t& context = renderer_->getContext();
-
   shader_t* shader = renderer_->getShader(shader_);
   if (!shader)
     return;
@@ -275,7 +289,7 @@ void material_t::updateDescriptorSets()
   {
     if (bufferUpdate_[i])
     {
-      render::gpuBufferUpdate(context, bufferData_[i], 0u, bufferDataSize_[i], &buffers_[i]);
+      renderer_->uploadBufferData(bufferData_[i], 0u, bufferDataSize_[i], &buffers_[i]);
       bufferUpdate_[i] = false;
     }
   }
@@ -302,7 +316,11 @@ void material_t::updateDescriptorSet(uint32_t pass)
     }
     else
     {
-      render::descriptorSetUpdate(context, shader->getDescriptorSetLayout(), &descriptorSet_[pass]);
+      //The set may still be in use by the frames in flight, so it is replaced instead of updated
+      render::descriptor_set_t descriptorSet;
+      render::descriptorSetCreate(context, renderer_->getDescriptorPool(), shader->getDescriptorSetLayout(), descriptorSet_[pass].descriptors, &descriptorSet);
+      renderer_->releaseDescriptorSet(descriptorSet_[pass]);
+      descriptorSet_[pass] = descriptorSet;
     }
 
     updateDescriptorSet_[pass] = false;
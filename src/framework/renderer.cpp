@@ -16,9 +16,18 @@
 #include "framework/gui.h"
 #include "framework/command-buffer.h"
 
+#include <algorithm>
+
 using namespace bkk::core;
 using namespace bkk::framework;
 
+//Initial number of actors in the per-object uniform buffer
+static const uint32_t OBJECT_UNIFORMS_INITIAL_CAPACITY = 1024u;
+
+//Initial size of the upload ring. It grows if a frame uploads more than this
+static const VkDeviceSize UPLOAD_RING_FRAME_SIZE = 1024u * 1024u;
+static const uint32_t UPLOAD_RING_MAX_UPLOADS = 16384u;
+
 static const char* gTextureBlitVertexShaderSource = R"(
   #version 440 core
 
@@ -47,23 +56,49 @@ static const char* gTextureBlitFragmentShaderSource = R"(
   }
 )";
 
+class renderer_t::frame_job_t : public thread_pool_t::task_t
+{
+public:
+  frame_job_t(renderer_t* renderer, void (renderer_t::*function)())
+  :renderer_(renderer),
+   function_(function)
+  {}
+
+  void run()
+  {
+    (renderer_->*function_)();
+  }
+
+private:
+  renderer_t* renderer_;
+  void (renderer_t::*function_)();
+};
+
 renderer_t::renderer_t()
 :context_(),
  backBuffer_(BKK_NULL_HANDLE),
- activeCamera_(BKK_NULL_HANDLE)
+ activeCamera_(BKK_NULL_HANDLE),
+ objectUniformStride_(0u),
+ objectCapacity_(0u),
+ uploadCommandBufferCount_(0u),
+ computeSubmitted_(false),
+ computeWaitSemaphore_(VK_NULL_HANDLE),
+ transformUpdateJob_(nullptr),
+ materialUpdateJob_(nullptr),
+ cullJob_(nullptr),
+ frameGraphChanged_(true)
 {}
 
 renderer_t::~renderer_t()
 {
+  destroyFrameGraph();
+
   if (context_.instance != VK_NULL_HANDLE)
   {
-    actor_t* actors;
-    uint32_t count = actors_.getData(&actors);
-    for (uint32_t i = 0; i < count; ++i)
-      actors[i].destroy(this);
+    render::contextFlush(context_);
 
     camera_t* cameras;
-    count = cameras_.getData(&cameras);
+    uint32_t count = cameras_.getData(&cameras);
     for (uint32_t i = 0; i < count; ++i)
       cameras[i].destroy(this);
 
@@ -97,8 +132,24 @@ renderer_t::~renderer_t()
     for (uint32_t i = 0; i < count; ++i)
       shaders[i].destroy(this);
 
-    for (uint32_t i(0); i < releasedCommandBuffers_.size(); ++i)
-      releasedCommandBuffers_[i].cleanup();
+    for (uint32_t i(0); i < releasedDescriptorSets_.size(); ++i)
+    {
+      for (uint32_t j(0); j < releasedDescriptorSets_[i].size(); ++j)
+        render::descriptorSetDestroy(context_, &releasedDescriptorSets_[i][j]);
+    }
+
+    for (uint32_t i(0); i < releasedBuffers_.size(); ++i)
+    {
+      for (uint32_t j(0); j < releasedBuffers_[i].size(); ++j)
+        render::gpuBufferDestroy(context_, nullptr, &releasedBuffers_[i][j]);
+    }
+
+    for (uint32_t i(0); i < uploadCommandBuffers_.size(); ++i)
+    {
+      for (uint32_t j(0); j < uploadCommandBuffers_[i].size(); ++j)
+        render::commandBufferDestroy(context_, &uploadCommandBuffers_[i][j]);
+    }
+    render::uploadRingDestroy(context_, &uploadRing_);
 
     if (backBuffer_ != BKK_NULL_HANDLE )
     {
@@ -114,37 +165,76 @@ renderer_t::~renderer_t()
     render::textureDestroy(context_, &defaultTexture_);
     render::textureDestroy(context_, &defaultNormalTexture_);
     render::descriptorSetLayoutDestroy(context_, &globalsDescriptorSetLayout_);
+    render::descriptorSetDestroy(context_, &objectDescriptorSet_);
+    render::gpuBufferDestroy(context_, nullptr, &objectUniformBuffer_);
     render::descriptorSetLayoutDestroy(context_, &objectDescriptorSetLayout_);
     render::descriptorPoolDestroy(context_, &globalDescriptorPool_);
 
-    for (uint32_t i(0); i < commandPool_.size(); ++i)
-      render::commandPoolDestroy(context_, commandPool_[i]);
+    for (uint32_t i(0); i < commandBufferPool_.size(); ++i)
+    {
+      for (uint32_t j(0); j < commandBufferPool_[i].size(); ++j)
+      {
+        command_buffer_pool_t& pool = commandBufferPool_[i][j];
+        for (uint32_t k(0); k < pool.commandBuffer.size(); ++k)
+          render::commandBufferDestroy(context_, &pool.commandBuffer[k]);
+
+        for (uint32_t k(0); k < pool.semaphore.size(); ++k)
+          render::semaphoreDestroy(context_, pool.semaphore[k]);
+
+        render::commandPoolDestroy(context_, pool.commandPool);
+      }
+    }
 
     render::contextDestroy(&context_);
   }
 }
 
-void renderer_t::initialize(const char* title, uint32_t imageCount, const window::window_t& window)
+void renderer_t::initialize(const char* title, uint32_t imageCount, const window::window_t& window, uint32_t framesInFlight)
 {
-  render::contextCreate(title, "", window, imageCount, &context_);
+  render::contextCreate(title, "", window, imageCount, framesInFlight, &context_);
+  uint32_t frameCount = render::getFrameCount(context_);
+  releasedDescriptorSets_.resize(frameCount);
+  releasedBuffers_.resize(frameCount);
 
   render::descriptor_binding_t binding = { render::descriptor_t::type_e::UNIFORM_BUFFER, 0, render::descriptor_t::stage_e::VERTEX | render::descriptor_t::stage_e::FRAGMENT };
   render::descriptorSetLayoutCreate(context_, &binding, 1u, &globalsDescriptorSetLayout_);
+
+  binding.type = render::descriptor_t::type_e::UNIFORM_BUFFER_DYNAMIC;
   render::descriptorSetLayoutCreate(context_, &binding, 1u, &objectDescriptorSetLayout_);
 
   render::descriptorPoolCreate(context_, 10000u,
     render::combined_image_sampler_count(10000u),
     render::uniform_buffer_count(10000u),
+    render::uniform_buffer_dynamic_count(16u),
     render::storage_buffer_count(10000u),
     render::storage_image_count(10000u),
     &globalDescriptorPool_);
 
+  //Uniforms of each object start at a multiple of the alignment required for dynamic offsets
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(context_.physicalDevice, &properties);
+  VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+  objectUniformStride_ = (uint32_t)((sizeof(maths::mat4) + alignment - 1) / alignment * alignment);
+  reserveObjectUniforms();
+
+  render::uploadRingCreate(context_, UPLOAD_RING_FRAME_SIZE, frameCount, UPLOAD_RING_MAX_UPLOADS, &uploadRing_);
+  uploadCommandBuffers_.resize(frameCount);
+
   uint32_t coreCount = getCPUCoreCount();
   threadPool_ = new thread_pool_t(coreCount);
 
-  commandPool_.resize(coreCount);
-  for (uint32_t i(0); i < coreCount; ++i)
-    commandPool_[i] = render::commandPoolCreate(context_);
+  //One command pool per frame in flight and thread in the pool, plus one for threads not owned by the pool
+  commandBufferPool_.resize(frameCount);
+  for (uint32_t i(0); i < frameCount; ++i)
+  {
+    commandBufferPool_[i].resize(coreCount + 1);
+    for (uint32_t j(0); j < commandBufferPool_[i].size(); ++j)
+    {
+      commandBufferPool_[i][j].commandPool = render::commandPoolCreate(context_);
+      commandBufferPool_[i][j].usedCommandBuffers = 0u;
+      commandBufferPool_[i][j].usedSemaphores = 0u;
+    }
+  }
   
   image::image2D_t image = {};
   image.width = image.height = 1u;
@@ -318,31 +408,60 @@ actor_handle_t renderer_t::actorCreate(const char* name, mesh_handle_t mesh, mat
 {
   bkk::core::bkk_handle_t transformHandle = transformManager_.createTransform(transform);
 
-  return actors_.add(
-    actor_t(name, mesh, transformHandle, material, instanceCount, this) );
+  //Bounds are computed in the next update, when the new transform is processed
+  actor_handle_t handle = actors_.add(
+    actor_t(name),
+    mesh, transformHandle, material,
+    0.0f, 0.0f, 0.0f, culling::EMPTY_EXTENT, culling::EMPTY_EXTENT, culling::EMPTY_EXTENT, 0.0f, bvh_t::INVALID_NODE,
+    instanceCount );
+
+  if (transformHandle.index >= transformActor_.size())
+    transformActor_.resize(transformHandle.index + 1, BKK_NULL_HANDLE);
+
+  transformActor_[transformHandle.index] = handle;
+  invalidateCameraVisibility();
+  return handle;
 }
 
 void renderer_t::actorDestroy(actor_handle_t handle)
 {
-  actor_t* actor = actors_.get(handle);
-  if (actor != nullptr)
+  transform_handle_t* transformPtr = actors_.get<ACTOR_COLUMN_TRANSFORM>(handle);
+  if (transformPtr != nullptr)
   {
-    actor->destroy(this);
+    transform_handle_t transform = *transformPtr;
+    transformManager_.destroyTransform(transform);
+    transformActor_[transform.index] = BKK_NULL_HANDLE;
+    if (transform.index < objectUploaded_.size())
+      objectUploaded_[transform.index] = 0u;
+
+    uint32_t bvhLeaf = *actors_.get<ACTOR_COLUMN_BVH_LEAF>(handle);
+    if (bvhLeaf != bvh_t::INVALID_NODE)
+      actorBvh_.remove(bvhLeaf);
+
+    occluders_.remove(handle);
     actors_.remove(handle);
+
+    //Indices of the visible actors are not valid after removing an actor
+    invalidateCameraVisibility();
   }
 }
 
 actor_t* renderer_t::getActor(actor_handle_t handle)
 {
-  return actors_.get(handle);
+  return actors_.get<ACTOR_COLUMN_OBJECT>(handle);
+}
+
+bool renderer_t::getActorIndex(actor_handle_t handle, uint32_t* index)
+{
+  return actors_.getIndexFromId(handle, index);
 }
 
 material_t* renderer_t::getActorMaterial(actor_handle_t handle)
 {
-  actor_t* actor = actors_.get(handle);
-  if (actor)
+  material_handle_t* material = actors_.get<ACTOR_COLUMN_MATERIAL>(handle);
+  if (material)
   {
-    return getMaterial(actor->getMaterialHandle());
+    return getMaterial(*material);
   }
 
   return nullptr;
@@ -350,36 +469,36 @@ material_t* renderer_t::getActorMaterial(actor_handle_t handle)
 
 void renderer_t::actorSetParent(actor_handle_t actor, actor_handle_t parent)
 {
-  transformManager_.setParent(actors_.get(actor)->getTransformHandle(), actors_.get(parent)->getTransformHandle());
+  transformManager_.setParent(*actors_.get<ACTOR_COLUMN_TRANSFORM>(actor), *actors_.get<ACTOR_COLUMN_TRANSFORM>(parent));
 }
 
 void renderer_t::actorSetTransform(actor_handle_t handle, const maths::mat4& newTransform)
 {
-  actor_t* actor = getActor(handle);
-  if (actor)
-    transformManager_.setTransform(actor->getTransformHandle(), newTransform);
+  transform_handle_t* transform = actors_.get<ACTOR_COLUMN_TRANSFORM>(handle);
+  if (transform)
+    transformManager_.setTransform(*transform, newTransform);
 }
 
 maths::mat4* renderer_t::actorGetTransform(actor_handle_t handle)
 {
-  actor_t* actor = getActor(handle);
-  if (actor)
-    return transformManager_.getTransform(actor->getTransformHandle());
+  transform_handle_t* transform = actors_.get<ACTOR_COLUMN_TRANSFORM>(handle);
+  if (transform)
+    return transformManager_.getTransform(*transform);
 
   return nullptr;
 }
 
-actor_t* renderer_t::findActor(const char* name)
+actor_handle_t renderer_t::findActor(const char* name)
 {
   actor_t* actors;
-  uint32_t actorCount = actors_.getData(&actors);
+  uint32_t actorCount = actors_.getData<ACTOR_COLUMN_OBJECT>(&actors);
   for (uint32_t i(0); i < actorCount; ++i)
   {
     if (strcmp(name, actors[i].getName()) == 0)
-      return &actors[i];
+      return actors_.getIdFromIndex(i);
   }
 
-  return nullptr;
+  return BKK_NULL_HANDLE;
 }
 
 maths::mat4* renderer_t::getTransform(transform_handle_t transform) 
@@ -425,64 +544,759 @@ bool renderer_t::setupCamera(camera_handle_t handle)
 
   camera->update(this);
 
-  ////Culling
-  actor_t* allActors;
-  uint32_t actorCount = actors_.getData(&allActors);
-  camera->cull(this, allActors, actorCount);
+  //Cameras are culled in update(). Cull again only if the camera has changed since then, or if actors have been
+  //created or destroyed (actorCreate and actorDestroy invalidate the visible actors of all the cameras)
+  if (!camera->isCulled())
+    camera->cull(this);
 
   activeCamera_ = handle;
 
   return true;
 }
 
-int renderer_t::getVisibleActors(camera_handle_t cameraHandle, actor_t** actors)
+uint32_t renderer_t::getVisibleActors(camera_handle_t cameraHandle, const uint32_t** actorIndex)
 {
   camera_t* camera = cameras_.get(cameraHandle);
   if (!camera)
     return 0;
 
-  return camera->getVisibleActors(actors);
+  return camera->getVisibleActors(actorIndex);
 }
 
 void renderer_t::presentFrame()
 {
-  vkQueueWaitIdle(context_.computeQueue.handle);
+  recordOcclusionDepthReadback();
+  flushUploads();
+
+  presentationWaitSemaphores_.clear();
+  presentationWaitSemaphores_.push_back(renderComplete_);
+  for (uint32_t i(0); i < signaledSemaphores_.size(); ++i)
+  {
+    if (std::find(waitedSemaphores_.begin(), waitedSemaphores_.end(), signaledSemaphores_[i]) == waitedSemaphores_.end())
+      presentationWaitSemaphores_.push_back(signaledSemaphores_[i]);
+  }
+  signaledSemaphores_.clear();
+  waitedSemaphores_.clear();
+
+  render::presentFrame(&context_, presentationWaitSemaphores_.data(), (uint32_t)presentationWaitSemaphores_.size());
+  render::uploadRingNextFrame(&uploadRing_);
+
+  //presentFrame has waited for the GPU to finish the last frame that used this frame index
+  uint32_t frame = render::getFrameIndex(context_);
+  for (uint32_t i(0); i < releasedDescriptorSets_[frame].size(); ++i)
+    render::descriptorSetDestroy(context_, &releasedDescriptorSets_[frame][i]);
+
+  releasedDescriptorSets_[frame].clear();
+
+  for (uint32_t i(0); i < releasedBuffers_[frame].size(); ++i)
+    render::gpuBufferDestroy(context_, nullptr, &releasedBuffers_[frame][i]);
+
+  releasedBuffers_[frame].clear();
+
+  for (uint32_t i(0); i < commandBufferPool_[frame].size(); ++i)
+  {
+    //The fence of the frame only covers the graphics queue
+    command_buffer_pool_t& pool = commandBufferPool_[frame][i];
+    for (uint32_t j(0); j < pool.usedCommandBuffers; ++j)
+    {
+      if (pool.commandBuffer[j].type == render::command_buffer_t::COMPUTE)
+        vkWaitForFences(context_.device, 1u, &pool.commandBuffer[j].fence, VK_TRUE, UINT64_MAX);
+    }
+
+    if (pool.usedCommandBuffers > 0u)
+      render::commandPoolReset(context_, pool.commandPool);
+
+    pool.usedCommandBuffers = 0u;
+    pool.usedSemaphores = 0u;
+  }
+
+  //Signaled once the graphics work submitted so far is done. If no compute command buffer waits on it the presentation does
+  if (computeSubmitted_)
+  {
+    computeWaitSemaphore_ = acquireSemaphore();
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.signalSemaphoreCount = 1u;
+    submitInfo.pSignalSemaphores = &computeWaitSemaphore_;
+    vkQueueSubmit(context_.graphicsQueue.handle, 1u, &submitInfo, VK_NULL_HANDLE);
+    signaledSemaphores_.push_back(computeWaitSemaphore_);
+    computeSubmitted_ = false;
+  }
+
+  updateOcclusionDepth();
+}
+
+void renderer_t::recordOcclusionDepthReadback()
+{
+  camera_t* cameras;
+  uint32_t count = cameras_.getData(&cameras);
+
+  bool readback = false;
+  for (uint32_t i(0); i < count && !readback; ++i)
+    readback = cameras[i].getOcclusionCulling() == camera_t::OCCLUSION_CULLING_GPU_DEPTH;
+
+  if (!readback)
+    return;
+
+  //Copy the depth buffers of all the cameras with occlusion culling in a single submission. It is submitted
+  //before presenting, so the fence of the frame signals once the copies are done
+  uint32_t frame = render::getFrameIndex(context_);
+  render::command_buffer_t* commandBuffer = acquireCommandBuffer(render::command_buffer_t::GRAPHICS, nullptr, nullptr, 0u, nullptr, 0u);
+  render::commandBufferBegin(context_, *commandBuffer);
+  for (uint32_t i(0); i < count; ++i)
+    cameras[i].recordDepthReadback(this, frame, *commandBuffer);
+  render::commandBufferEnd(*commandBuffer);
+  submitCommandBuffer(*commandBuffer);
+}
+
+void renderer_t::updateOcclusionDepth()
+{
+  //presentFrame has waited for the GPU to finish the last frame that used this frame index, so its copies are done
+  uint32_t frame = render::getFrameIndex(context_);
+  camera_t* cameras;
+  uint32_t count = cameras_.getData(&cameras);
+  parallelFor(threadPool_, 0u, count, 1u,
+    [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t i(begin); i < end; ++i)
+        cameras[i].updateDepthPyramid(this, frame);
+    }
+  );
+}
 
-  render::presentFrame(&context_, &renderComplete_, 1u);
+void renderer_t::beginUploadFrame()
+{
+  //Wait until the copies from the region of the ring used in this frame are done
+  std::vector<render::command_buffer_t>& commandBuffers = uploadCommandBuffers_[uploadRing_.frame];
+  for (uint32_t i(0); i < commandBuffers.size(); ++i)
+    vkWaitForFences(context_.device, 1u, &commandBuffers[i].fence, VK_TRUE, UINT64_MAX);
 
-  for (uint32_t i(0); i < releasedCommandBuffers_.size(); ++i)
-    releasedCommandBuffers_[i].cleanup();
+  uploadCommandBufferCount_ = 0u;
+}
 
-  releasedCommandBuffers_.clear();
+void renderer_t::uploadBufferData(const void* data, size_t offset, size_t size, render::gpu_buffer_t* buffer)
+{
+  //The buffer can't be written directly, as previous frames may still be reading it. Once the ring is full all
+  //the writes until the next flush fail, so the pending uploads are always the last ones
+  if (!render::uploadRingWrite(&uploadRing_, data, offset, size, *buffer))
+  {
+    std::lock_guard<std::mutex> lock(pendingUploadsMutex_);
+    pending_upload_t upload;
+    upload.buffer = *buffer;
+    upload.offset = offset;
+    upload.data.assign((const uint8_t*)data, (const uint8_t*)data + size);
+    pendingUploads_.push_back(upload);
+  }
+}
+
+void renderer_t::flushUploads()
+{
+  if (!pendingUploads_.empty())
+  {
+    //Copies already in the ring go first, so writes to the same range are copied in order
+    submitUploads();
+    growUploadRing();
+    for (uint32_t i(0); i < pendingUploads_.size(); ++i)
+    {
+      const pending_upload_t& upload = pendingUploads_[i];
+      render::uploadRingWrite(&uploadRing_, upload.data.data(), upload.offset, upload.data.size(), upload.buffer);
+    }
+
+    pendingUploads_.clear();
+  }
+
+  submitUploads();
+}
+
+void renderer_t::growUploadRing()
+{
+  //Make room in a single region for the pending uploads
+  VkDeviceSize requiredSize = 0u;
+  for (uint32_t i(0); i < pendingUploads_.size(); ++i)
+    requiredSize += (pendingUploads_[i].data.size() + 15u) & ~(VkDeviceSize)15u;
+
+  VkDeviceSize frameSize = uploadRing_.frameSize * 2u;
+  while (frameSize < requiredSize)
+    frameSize *= 2u;
+
+  uint32_t maxUploadCount = (uint32_t)uploadRing_.upload.size() * 2u;
+  while (maxUploadCount < pendingUploads_.size())
+    maxUploadCount *= 2u;
+
+  //Upload command buffers submitted this frame may still be copying from the old ring. Its buffer is destroyed once
+  //the frame is done, and the new ring keeps using the region of the current frame
+  uint32_t frameCount = uploadRing_.frameCount;
+  uint32_t frame = uploadRing_.frame;
+  releaseBuffer(uploadRing_.buffer);
+  render::uploadRingCreate(context_, (size_t)frameSize, frameCount, maxUploadCount, &uploadRing_);
+  uploadRing_.frame = frame;
+}
+
+void renderer_t::submitUploads()
+{
+  //First submission of the frame is always done. Its barrier orders the work of the frame after the work of
+  //the previous one, which may still be executing and reading the render targets this frame writes to
+  bool firstSubmission = uploadCommandBufferCount_ == 0u;
+  if (!firstSubmission && !render::uploadRingHasPendingCopies(uploadRing_))
+    return;
+
+  std::vector<render::command_buffer_t>& commandBuffers = uploadCommandBuffers_[uploadRing_.frame];
+  if (uploadCommandBufferCount_ == commandBuffers.size())
+  {
+    render::command_buffer_t commandBuffer;
+    render::commandBufferCreate(context_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, nullptr, nullptr, 0u, nullptr, 0u,
+      render::command_buffer_t::GRAPHICS, VK_NULL_HANDLE, &commandBuffer);
+    commandBuffers.push_back(commandBuffer);
+  }
+
+  render::command_buffer_t& commandBuffer = commandBuffers[uploadCommandBufferCount_++];
+  render::commandBufferBegin(context_, commandBuffer);
+  if (firstSubmission)
+  {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer.handle, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+  render::uploadRingRecordCopies(commandBuffer, &uploadRing_);
+  render::commandBufferEnd(commandBuffer);
+  render::commandBufferSubmit(context_, commandBuffer);
 }
 
 void renderer_t::update()
 {
-  //Update transform manager and uniform buffer
-  transformManager_.update();
+  beginUploadFrame();
+  reserveObjectUniforms();
 
-  actor_t* actors;
-  uint32_t actorCount = actors_.getData(&actors);
-  for (u32 i(0); i < actorCount; ++i)
+  if (frameGraphChanged_)
+    buildFrameGraph();
+
+  //Update transforms and materials and cull all the cameras in parallel
+  frameGraph_.run(threadPool_);
+
+  buildPresentationCommandBuffers();
+}
+
+void renderer_t::updateTransforms()
+{
+  //Update transform manager. Then update uniform buffers and bounds of the actors whose world matrix has changed
+  const std::vector<uint32_t>& changedTransforms = transformManager_.update(threadPool_);
+
+  parallelFor(threadPool_, 0u, (uint32_t)changedTransforms.size(), 256u,
+    [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t i(begin); i < end; ++i)
+      {
+        transform_handle_t transform = transformManager_.getIdFromIndex(changedTransforms[i]);
+        if (transform.index >= transformActor_.size())
+          continue;
+
+        actor_handle_t actorHandle = transformActor_[transform.index];
+        if (actors_.get<ACTOR_COLUMN_OBJECT>(actorHandle))
+        {
+          maths::mat4* worldMatrix = transformManager_.getWorldMatrix(transform);
+          memcpy(&objectData_[transform.index * objectUniformStride_], worldMatrix, sizeof(maths::mat4));
+          updateActorBounds(actorHandle, *worldMatrix);
+        }
+      }
+    }
+  );
+
+  //Bounding volume hierarchy is not thread safe. Update it after all the bounds have been computed. When most of
+  //the actors move, refitting the hierarchy once is cheaper than reinserting every leaf that leaves its box
+  bool refitBvh = changedTransforms.size() * 2u > actors_.getElementCount();
+  std::vector<uint32_t>& changedObjects = objectChanged_;
+  changedObjects.clear();
+  for (uint32_t i(0); i < changedTransforms.size(); ++i)
+  {
+    transform_handle_t transform = transformManager_.getIdFromIndex(changedTransforms[i]);
+    if (transform.index < transformActor_.size() && actors_.get<ACTOR_COLUMN_OBJECT>(transformActor_[transform.index]))
+    {
+      updateActorBvh(transformActor_[transform.index], refitBvh);
+      objectUploaded_[transform.index] = 1u;
+      changedObjects.push_back(transform.index);
+    }
+  }
+
+  if (refitBvh)
+    actorBvh_.refit();
+
+  if (changedObjects.empty())
+    return;
+
+  //Upload each run of contiguous slots with a single copy, so the size of the uploads depends only on what has changed
+  std::sort(changedObjects.begin(), changedObjects.end());
+  uint32_t runBegin = 0u;
+  for (uint32_t i(1); i <= changedObjects.size(); ++i)
+  {
+    if (i == changedObjects.size() || changedObjects[i] > changedObjects[i - 1] + 1u)
+    {
+      size_t offset = changedObjects[runBegin] * objectUniformStride_;
+      size_t size = (changedObjects[i - 1] - changedObjects[runBegin] + 1u) * objectUniformStride_;
+      uploadBufferData(&objectData_[offset], offset, size, &objectUniformBuffer_);
+      runBegin = i;
+    }
+  }
+
+  //Bounds of the actors have changed
+  invalidateCameraVisibility();
+}
+
+void renderer_t::reserveObjectUniforms()
+{
+  uint32_t capacity = maths::maxValue(objectCapacity_, OBJECT_UNIFORMS_INITIAL_CAPACITY);
+  while (capacity < transformActor_.size())
+    capacity *= 2u;
+
+  if (capacity == objectCapacity_)
+    return;
+
+  //Buffer is replaced before recording any command buffer in the frame. It starts with all the uniforms in objectData_
+  objectData_.resize(capacity * objectUniformStride_, 0u);
+  objectUploaded_.resize(capacity, 0u);
+  render::gpu_buffer_t buffer = {};
+  render::gpuBufferCreate(context_,
+    (render::gpu_buffer_t::usage_e)(render::gpu_buffer_t::UNIFORM_BUFFER | render::gpu_buffer_t::TRANSFER_DST),
+    objectData_.data(), objectData_.size(), nullptr, &buffer);
+
+  //Dynamic offsets are added to the offset of the descriptor, so its range covers the uniforms of one object only
+  render::descriptor_t descriptor = render::getDescriptor(buffer);
+  descriptor.bufferDescriptor.range = sizeof(maths::mat4);
+
+  if (objectCapacity_ != 0u)
+  {
+    //Copies to the old buffer are already in the new one
+    render::uploadRingDiscardCopies(&uploadRing_, objectUniformBuffer_);
+    {
+      std::lock_guard<std::mutex> lock(pendingUploadsMutex_);
+      VkBuffer oldBuffer = objectUniformBuffer_.handle;
+      pendingUploads_.erase(std::remove_if(pendingUploads_.begin(), pendingUploads_.end(),
+        [oldBuffer](const pending_upload_t& upload) { return upload.buffer.handle == oldBuffer; }),
+        pendingUploads_.end());
+    }
+
+    //Frames in flight may still be reading the old buffer through the old descriptor set
+    releaseBuffer(objectUniformBuffer_);
+    releaseDescriptorSet(objectDescriptorSet_);
+  }
+
+  render::descriptorSetCreate(context_, globalDescriptorPool_, objectDescriptorSetLayout_, &descriptor, &objectDescriptorSet_);
+  objectUniformBuffer_ = buffer;
+  objectCapacity_ = capacity;
+}
+
+void renderer_t::updateActorBounds(actor_handle_t actor, const maths::mat4& worldMatrix)
+{
+  maths::vec3 center(0.0f, 0.0f, 0.0f);
+  maths::vec3 extent(culling::EMPTY_EXTENT, culling::EMPTY_EXTENT, culling::EMPTY_EXTENT);  //Actors without mesh are never visible
+  f32 radius = 0.0f;
+
+  mesh::mesh_t* mesh = getMesh(*actors_.get<ACTOR_COLUMN_MESH>(actor));
+  if (mesh)
+  {
+    culling::aabbToCenterExtent(maths::aabbTransform(mesh->aabb, worldMatrix), &center, &extent);
+
+    //Sphere centered in the box, with the radius of the local box scaled by the largest scale of the transform
+    f32 scale = maths::maxValue(maths::length(worldMatrix.row(0).xyz()),
+                maths::maxValue(maths::length(worldMatrix.row(1).xyz()), maths::length(worldMatrix.row(2).xyz())));
+    radius = maths::length(mesh->aabb.max - mesh->aabb.min) * 0.5f * scale;
+  }
+
+  *actors_.get<ACTOR_COLUMN_CENTER_X>(actor) = center.x;
+  *actors_.get<ACTOR_COLUMN_CENTER_Y>(actor) = center.y;
+  *actors_.get<ACTOR_COLUMN_CENTER_Z>(actor) = center.z;
+  *actors_.get<ACTOR_COLUMN_EXTENT_X>(actor) = extent.x;
+  *actors_.get<ACTOR_COLUMN_EXTENT_Y>(actor) = extent.y;
+  *actors_.get<ACTOR_COLUMN_EXTENT_Z>(actor) = extent.z;
+  *actors_.get<ACTOR_COLUMN_RADIUS>(actor) = radius;
+}
+
+void renderer_t::updateActorBvh(actor_handle_t actor, bool refit)
+{
+  uint32_t* bvhLeaf = actors_.get<ACTOR_COLUMN_BVH_LEAF>(actor);
+  if (!bvhLeaf)
+    return;
+
+  f32 extentX = *actors_.get<ACTOR_COLUMN_EXTENT_X>(actor);
+  if (extentX == culling::EMPTY_EXTENT)
+  {
+    if (*bvhLeaf != bvh_t::INVALID_NODE)
+    {
+      actorBvh_.remove(*bvhLeaf);
+      *bvhLeaf = bvh_t::INVALID_NODE;
+    }
+    return;
+  }
+
+  maths::vec3 center(*actors_.get<ACTOR_COLUMN_CENTER_X>(actor), *actors_.get<ACTOR_COLUMN_CENTER_Y>(actor), *actors_.get<ACTOR_COLUMN_CENTER_Z>(actor));
+  maths::vec3 extent(extentX, *actors_.get<ACTOR_COLUMN_EXTENT_Y>(actor), *actors_.get<ACTOR_COLUMN_EXTENT_Z>(actor));
+  maths::aabb_t aabb = { center - extent, center + extent };
+
+  if (*bvhLeaf == bvh_t::INVALID_NODE)
+    *bvhLeaf = actorBvh_.insert(aabb, actors_.get<ACTOR_COLUMN_TRANSFORM>(actor)->index);
+  else if (refit)
+    actorBvh_.setLeafAabb(*bvhLeaf, aabb);
+  else
+    actorBvh_.update(*bvhLeaf, aabb);
+}
+
+uint32_t renderer_t::frustumCullCandidates(const maths::vec4* frustumPlanes, const std::vector<uint32_t>& candidate)
+{
+  if (candidate.empty())
+    return 0u;
+
+  //Bounds of the candidates are gathered in contiguous arrays so they can be tested in batches by the SIMD kernel
+  culling::aabb_soa_t bounds;
+  getAllActorBounds(&bounds);
+
+  uint32_t count = (uint32_t)candidate.size();
+  cullCandidateBounds_.resize(6u * count);
+  f32* data = cullCandidateBounds_.data();
+  for (uint32_t i(0); i < count; ++i)
+  {
+    uint32_t index = candidate[i];
+    data[i] = bounds.centerX[index];
+    data[count + i] = bounds.centerY[index];
+    data[2u * count + i] = bounds.centerZ[index];
+    data[3u * count + i] = bounds.extentX[index];
+    data[4u * count + i] = bounds.extentY[index];
+    data[5u * count + i] = bounds.extentZ[index];
+  }
+
+  culling::aabb_soa_t candidateBounds = { data, data + count, data + 2u * count, data + 3u * count, data + 4u * count, data + 5u * count };
+  cullCandidateVisible_.resize(count);
+  return culling::frustumCull(frustumPlanes, candidateBounds, 0u, count, cullCandidateVisible_.data());
+}
+
+void renderer_t::actorFrustumCull(const maths::vec4* frustumPlanes, std::vector<uint32_t>* actorIndex)
+{
+  //The hierarchy discards the leaves under nodes outside the frustum. Leaves under nodes inside it are visible,
+  //the rest are tested with culling::frustumCull
+  std::vector<uint32_t>& candidate = cullCandidate_;
+  actorIndex->clear();
+  candidate.clear();
+  actorBvh_.queryFrustumLeaves(frustumPlanes,
+    [&](uint32_t transformIndex, bool inside)
+    {
+      uint32_t index;
+      if (actors_.getIndexFromId(transformActor_[transformIndex], &index))
+        (inside ? actorIndex : &candidate)->push_back(index);
+    }
+  );
+
+  uint32_t visibleCount = frustumCullCandidates(frustumPlanes, candidate);
+  for (uint32_t i(0); i < visibleCount; ++i)
+    actorIndex->push_back(candidate[cullCandidateVisible_[i]]);
+
+  //Keep visible actors in the same order they are stored
+  std::sort(actorIndex->begin(), actorIndex->end());
+}
+
+void renderer_t::actorFrustumCull(const maths::vec4* frustumPlanes, uint32_t frustumCount, std::vector<uint32_t>* actorIndex, std::vector<uint32_t>* frustumMask)
+{
+  std::vector<cull_leaf_t>& visible = cullVisible_;
+  visible.clear();
+  actorBvh_.queryFrustumsLeaves(frustumPlanes, frustumCount,
+    [&](uint32_t transformIndex, uint32_t mask, uint32_t insideMask)
+    {
+      cull_leaf_t leaf;
+      if (actors_.getIndexFromId(transformActor_[transformIndex], &leaf.actor))
+      {
+        leaf.frustumMask = mask;
+        leaf.insideMask = insideMask;
+        visible.push_back(leaf);
+      }
+    }
+  );
+
+  std::sort(visible.begin(), visible.end(), [](const cull_leaf_t& a, const cull_leaf_t& b) { return a.actor < b.actor; });
+
+  //Leaves not known to be inside a frustum are tested against it in batches
+  std::vector<uint32_t>& candidate = cullCandidate_;
+  std::vector<uint32_t>& candidateSlot = cullCandidateSlot_;
+  for (uint32_t f(0); f < frustumCount; ++f)
+  {
+    uint32_t bit = 1u << f;
+    candidate.clear();
+    candidateSlot.clear();
+    for (uint32_t i(0); i < visible.size(); ++i)
+    {
+      if ((visible[i].frustumMask & bit) && !(visible[i].insideMask & bit))
+      {
+        candidate.push_back(visible[i].actor);
+        candidateSlot.push_back(i);
+        visible[i].frustumMask &= ~bit;
+      }
+    }
+
+    uint32_t visibleCount = frustumCullCandidates(frustumPlanes + 6u * f, candidate);
+    for (uint32_t i(0); i < visibleCount; ++i)
+      visible[candidateSlot[cullCandidateVisible_[i]]].frustumMask |= bit;
+  }
+
+  actorIndex->clear();
+  frustumMask->clear();
+  for (uint32_t i(0); i < visible.size(); ++i)
+  {
+    if (visible[i].frustumMask != 0u)
+    {
+      actorIndex->push_back(visible[i].actor);
+      frustumMask->push_back(visible[i].frustumMask);
+    }
+  }
+}
+
+void renderer_t::actorOcclusionCull(const culling::depth_pyramid_t& depthPyramid, std::vector<uint32_t>* actorIndex)
+{
+  if (depthPyramid.levelCount == 0u || actorIndex->empty())
+    return;
+
+  culling::aabb_soa_t bounds;
+  getAllActorBounds(&bounds);
+
+  //Blocks are culled in place in parallel and then compacted
+  static const uint32_t BLOCK_SIZE = 256u;
+  uint32_t* index = actorIndex->data();
+  uint32_t count = (uint32_t)actorIndex->size();
+  uint32_t blockCount = (count + BLOCK_SIZE - 1u) / BLOCK_SIZE;
+  std::vector<uint32_t>& blockVisible = occlusionBlockVisible_;
+  blockVisible.resize(blockCount);
+  parallelFor(threadPool_, 0u, blockCount, 1u,
+    [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t block(begin); block < end; ++block)
+      {
+        uint32_t first = block * BLOCK_SIZE;
+        uint32_t blockSize = maths::minValue(BLOCK_SIZE, count - first);
+        blockVisible[block] = culling::occlusionCull(depthPyramid, bounds, index + first, blockSize, index + first);
+      }
+    }
+  );
+
+  uint32_t visibleCount = 0u;
+  for (uint32_t block(0); block < blockCount; ++block)
   {
-    render::gpuBufferUpdate(context_, transformManager_.getWorldMatrix(actors[i].getTransformHandle()),
-                                  0, sizeof(maths::mat4), &actors[i].getUniformBuffer());
+    memmove(index + visibleCount, index + block * BLOCK_SIZE, blockVisible[block] * sizeof(uint32_t));
+    visibleCount += blockVisible[block];
   }
 
-  //TODO: Do the update in parallel
-  //Update materials
+  actorIndex->resize(visibleCount);
+}
+
+void renderer_t::actorSetOccluder(actor_handle_t handle, const maths::vec3* vertex, uint32_t vertexCount, const uint32_t* index, uint32_t triangleCount)
+{
+  if (actors_.get<ACTOR_COLUMN_OBJECT>(handle) == nullptr)
+    return;
+
+  occluder_geometry_t occluder;
+  occluder.actor = handle;
+  occluder.vertex.assign(vertex, vertex + vertexCount);
+  occluder.index.assign(index, index + triangleCount * 3u);
+  occluders_.add(handle, occluder);
+  invalidateCameraVisibility();
+}
+
+void renderer_t::actorRemoveOccluder(actor_handle_t handle)
+{
+  if (occluders_.remove(handle))
+    invalidateCameraVisibility();
+}
+
+void renderer_t::rasterizeOccluders(const maths::mat4& viewProjection, uint32_t width, uint32_t height,
+                                    culling::occlusion_rasterizer_t* rasterizer, f32* depth)
+{
+  std::vector<occluder_geometry_t>& geometry = occluders_.data();
+  std::vector<culling::occluder_t>& occluder = occluderList_;
+  occluder.resize(geometry.size());
+  for (uint32_t i(0); i < geometry.size(); ++i)
+  {
+    occluder[i].vertex = geometry[i].vertex.data();
+    occluder[i].vertexCount = (uint32_t)geometry[i].vertex.size();
+    occluder[i].index = geometry[i].index.data();
+    occluder[i].triangleCount = (uint32_t)geometry[i].index.size() / 3u;
+    occluder[i].transform = *transformManager_.getWorldMatrix(*actors_.get<ACTOR_COLUMN_TRANSFORM>(geometry[i].actor));
+  }
+
+  culling::rasterizeOccluders(occluder.data(), (uint32_t)occluder.size(), viewProjection, width, height, threadPool_, rasterizer, depth);
+}
+
+void renderer_t::cullCameras(const camera_handle_t* cameras, uint32_t cameraCount)
+{
+  maths::vec4 frustumPlanes[6 * bvh_t::MAX_FRUSTUMS];
+  camera_t* camera[bvh_t::MAX_FRUSTUMS];
+  std::vector<uint32_t>* visibleIndex = cullCameraIndex_;
+  std::vector<uint32_t>& actorIndex = cullActorIndex_;
+  std::vector<uint32_t>& frustumMask = cullFrustumMask_;
+
+  //Cameras are culled in batches of up to bvh_t::MAX_FRUSTUMS with one traversal of the hierarchy each
+  uint32_t begin = 0u;
+  while (begin < cameraCount)
+  {
+    uint32_t frustumCount = 0u;
+    for (; begin < cameraCount && frustumCount < bvh_t::MAX_FRUSTUMS; ++begin)
+    {
+      camera[frustumCount] = cameras_.get(cameras[begin]);
+      if (camera[frustumCount])
+      {
+        camera[frustumCount]->getFrustumPlanes(&frustumPlanes[6 * frustumCount]);
+        frustumCount++;
+      }
+    }
+
+    actorFrustumCull(frustumPlanes, frustumCount, &actorIndex, &frustumMask);
+
+    //Split the visible actors in one sorted list per camera
+    for (uint32_t i(0); i < frustumCount; ++i)
+      visibleIndex[i].clear();
+
+    for (uint32_t i(0); i < actorIndex.size(); ++i)
+    {
+      uint32_t mask = frustumMask[i];
+      for (uint32_t j(0); mask != 0u; ++j, mask >>= 1u)
+      {
+        if (mask & 1u)
+          visibleIndex[j].push_back(actorIndex[i]);
+      }
+    }
+
+    for (uint32_t i(0); i < frustumCount; ++i)
+    {
+      if (camera[i]->getOcclusionCulling() != camera_t::OCCLUSION_CULLING_NONE)
+      {
+        camera[i]->rasterizeOccluders(this);
+        actorOcclusionCull(camera[i]->getDepthPyramid(), &visibleIndex[i]);
+      }
+
+      camera[i]->setVisibleActors(this, &visibleIndex[i]);
+    }
+  }
+}
+
+void renderer_t::cullAllCameras()
+{
+  //Cameras whose visible actors are still valid are skipped. If a camera changes after this, setupCamera culls it again
+  camera_t* cameras;
+  uint32_t cameraCount = cameras_.getData(&cameras);
+  camera_handle_t handle[bvh_t::MAX_FRUSTUMS];
+  uint32_t count = 0u;
+  for (uint32_t i(0); i < cameraCount; ++i)
+  {
+    if (cameras[i].isCulled())
+      continue;
+
+    handle[count++] = cameras_.getIdFromIndex(i);
+    if (count == bvh_t::MAX_FRUSTUMS)
+    {
+      cullCameras(handle, count);
+      count = 0u;
+    }
+  }
+
+  if (count > 0u)
+    cullCameras(handle, count);
+}
+
+void renderer_t::invalidateCameraVisibility()
+{
+  camera_t* cameras;
+  uint32_t count = cameras_.getData(&cameras);
+  for (uint32_t i(0); i < count; ++i)
+    cameras[i].invalidateVisibility();
+}
+
+actor_handle_t renderer_t::actorRayCast(const maths::vec3& origin, const maths::vec3& direction, f32 maxDistance, f32* distance)
+{
+  uint32_t transformIndex;
+  f32 hitDistance;
+  if (actorBvh_.rayCast(origin, direction, maxDistance, &transformIndex, &hitDistance))
+  {
+    if (distance)
+      *distance = hitDistance;
+
+    return transformActor_[transformIndex];
+  }
+
+  return BKK_NULL_HANDLE;
+}
+
+uint32_t renderer_t::actorQueryAabb(const maths::aabb_t& aabb, std::vector<actor_handle_t>* actors)
+{
+  actors->clear();
+  actorBvh_.queryAabb(aabb, [&](uint32_t transformIndex) { actors->push_back(transformActor_[transformIndex]); });
+  return (uint32_t)actors->size();
+}
+
+uint32_t renderer_t::actorQuerySphere(const maths::vec3& center, f32 radius, std::vector<actor_handle_t>* actors)
+{
+  actors->clear();
+  actorBvh_.querySphere(center, radius, [&](uint32_t transformIndex) { actors->push_back(transformActor_[transformIndex]); });
+  return (uint32_t)actors->size();
+}
+
+uint32_t renderer_t::getAllActorBounds(culling::aabb_soa_t* bounds)
+{
+  f32* data;
+  uint32_t count = actors_.getData<ACTOR_COLUMN_CENTER_X>(&data);
+  bounds->centerX = data;
+  actors_.getData<ACTOR_COLUMN_CENTER_Y>(&data);
+  bounds->centerY = data;
+  actors_.getData<ACTOR_COLUMN_CENTER_Z>(&data);
+  bounds->centerZ = data;
+  actors_.getData<ACTOR_COLUMN_EXTENT_X>(&data);
+  bounds->extentX = data;
+  actors_.getData<ACTOR_COLUMN_EXTENT_Y>(&data);
+  bounds->extentY = data;
+  actors_.getData<ACTOR_COLUMN_EXTENT_Z>(&data);
+  bounds->extentZ = data;
+  return count;
+}
+
+void renderer_t::updateMaterials()
+{
+  //Materials and compute materials are updated in the same job as both allocate
+  //descriptor sets from the global descriptor pool
   material_t* materials;
   uint32_t count = materials_.getData(&materials);
   for (uint32_t i = 0; i < count; ++i)
     materials[i].updateDescriptorSets();
-  
+
   compute_material_t* computeMaterials;
   count = computeMaterials_.getData(&computeMaterials);
   for (uint32_t i = 0; i < count; ++i)
     computeMaterials[i].updateDescriptorSets();
+}
+
+void renderer_t::buildFrameGraph()
+{
+  destroyFrameGraph();
 
+  transformUpdateJob_ = new frame_job_t(this, &renderer_t::updateTransforms);
+  materialUpdateJob_ = new frame_job_t(this, &renderer_t::updateMaterials);
+  frameGraph_.addJob(transformUpdateJob_);
+  frameGraph_.addJob(materialUpdateJob_);
 
-  buildPresentationCommandBuffers();
+  //Culling needs up to date transforms. All the cameras are culled in a single job
+  cullJob_ = new frame_job_t(this, &renderer_t::cullAllCameras);
+  frameGraph_.addDependency(cullJob_, transformUpdateJob_);
+
+  frameGraphChanged_ = false;
+}
+
+void renderer_t::destroyFrameGraph()
+{
+  frameGraph_.clear();
+
+  delete transformUpdateJob_;
+  transformUpdateJob_ = nullptr;
+
+  delete materialUpdateJob_;
+  materialUpdateJob_ = nullptr;
+
+  delete cullJob_;
+  cullJob_ = nullptr;
+
+  frameGraphChanged_ = true;
 }
 
 void renderer_t::createTextureBlitResources()
@@ -524,19 +1338,19 @@ void renderer_t::buildPresentationCommandBuffers()
     createTextureBlitResources();
   }
 
-  const render::command_buffer_t* commandBuffers;
-  uint32_t count = render::getPresentationCommandBuffers(context_, &commandBuffers);
-  for (uint32_t i(0); i<count; ++i)
-  {
-    render::beginPresentationCommandBuffer(context_, i, nullptr);
-    render::commandBufferDebugMarkerBegin(context_, commandBuffers[i], "Presentation");
-    render::graphicsPipelineBind(commandBuffers[i], presentationPipeline_);
-    render::descriptorSetBind(commandBuffers[i], textureBlitPipelineLayout_, 0, &presentationDescriptorSet_, 1u);
-    mesh::draw(commandBuffers[i], fullScreenQuad_);
-    framework::gui::draw(context_, commandBuffers[i]);
-    render::commandBufferDebugMarkerEnd(context_, commandBuffers[i]);
-    render::endPresentationCommandBuffer(context_, i);
-  }
+  //Only the command buffer of the image presented this frame is recorded. The others may still be in use by previous frames
+  render::acquireNextImage(&context_);
+  render::command_buffer_t* commandBuffer;
+  uint32_t image = render::getPresentationCommandBuffer(context_, &commandBuffer);
+
+  render::beginPresentationCommandBuffer(context_, image, nullptr);
+  render::commandBufferDebugMarkerBegin(context_, *commandBuffer, "Presentation");
+  render::graphicsPipelineBind(*commandBuffer, presentationPipeline_);
+  render::descriptorSetBind(*commandBuffer, textureBlitPipelineLayout_, 0, &presentationDescriptorSet_, 1u);
+  mesh::draw(*commandBuffer, fullScreenQuad_);
+  framework::gui::draw(context_, *commandBuffer);
+  render::commandBufferDebugMarkerEnd(context_, *commandBuffer);
+  render::endPresentationCommandBuffer(context_, image);
 }
 
 frame_buffer_handle_t renderer_t::getBackBuffer()
@@ -559,13 +1373,98 @@ render::descriptor_set_layout_t renderer_t::getObjectDescriptorSetLayout()
   return objectDescriptorSetLayout_;
 }
 
+bool renderer_t::getObjectUniformOffset(transform_handle_t transform, uint32_t* offset)
+{
+  //Actors created after the last update have no uniforms in the buffer yet
+  uint32_t index = transform.index;
+  if (index >= objectCapacity_ || !objectUploaded_[index])
+    return false;
+
+  *offset = index * objectUniformStride_;
+  return true;
+}
+
 render::descriptor_pool_t renderer_t::getDescriptorPool() {
   return globalDescriptorPool_;
 }
 
-void renderer_t::releaseCommandBuffer(const command_buffer_t* cmdBuffer)
+render::command_buffer_t* renderer_t::acquireCommandBuffer(render::command_buffer_t::type_e type,
+                                                           VkSemaphore* waitSemaphore, VkPipelineStageFlags* waitStages, uint32_t waitSemaphoreCount,
+                                                           VkSemaphore* signalSemaphore, uint32_t signalSemaphoreCount)
+{
+  //Each thread uses its own pool, so pools are never accessed from two threads at the same time
+  command_buffer_pool_t& pool = commandBufferPool_[render::getFrameIndex(context_)][threadPool_->getThreadIndex()];
+  if (pool.usedCommandBuffers == pool.commandBuffer.size())
+  {
+    render::command_buffer_t newCommandBuffer = {};
+    render::commandBufferCreate(context_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, nullptr, nullptr, 0u, nullptr, 0u, type, pool.commandPool, &newCommandBuffer);
+    pool.commandBuffer.push_back(newCommandBuffer);
+  }
+
+  //Fences of the recycled command buffers are signaled, as the GPU is done with the frame
+  render::command_buffer_t* commandBuffer = &pool.commandBuffer[pool.usedCommandBuffers++];
+  commandBuffer->type = type;
+  render::commandBufferSetSemaphores(waitSemaphore, waitStages, waitSemaphoreCount, signalSemaphore, signalSemaphoreCount, commandBuffer);
+  return commandBuffer;
+}
+
+VkSemaphore renderer_t::acquireSemaphore()
+{
+  command_buffer_pool_t& pool = commandBufferPool_[render::getFrameIndex(context_)][threadPool_->getThreadIndex()];
+  if (pool.usedSemaphores == pool.semaphore.size())
+    pool.semaphore.push_back(render::semaphoreCreate(context_));
+
+  return pool.semaphore[pool.usedSemaphores++];
+}
+
+void renderer_t::submitCommandBuffer(const render::command_buffer_t& commandBuffer)
+{
+  //Copies of the buffers updated this frame go before any command buffer using them
+  flushUploads();
+
+  for (uint32_t i(0); i < commandBuffer.waitSemaphoreCount; ++i)
+    waitedSemaphores_.push_back(commandBuffer.waitSemaphore[i]);
+
+  for (uint32_t i(0); i < commandBuffer.signalSemaphoreCount; ++i)
+  {
+    if (commandBuffer.signalSemaphore[i] != renderComplete_)
+      signaledSemaphores_.push_back(commandBuffer.signalSemaphore[i]);
+  }
+
+  if (commandBuffer.type == render::command_buffer_t::COMPUTE)
+  {
+    computeSubmitted_ = true;
+    if (computeWaitSemaphore_ != VK_NULL_HANDLE)
+    {
+      //Submitted with the semaphores of the command buffer plus the one signaled after the graphics work of the previous frame
+      computeWaitSemaphores_.assign(commandBuffer.waitSemaphore, commandBuffer.waitSemaphore + commandBuffer.waitSemaphoreCount);
+      computeWaitStages_.assign(commandBuffer.waitStages, commandBuffer.waitStages + commandBuffer.waitSemaphoreCount);
+      computeWaitSemaphores_.push_back(computeWaitSemaphore_);
+      computeWaitStages_.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+      waitedSemaphores_.push_back(computeWaitSemaphore_);
+      computeWaitSemaphore_ = VK_NULL_HANDLE;
+
+      //Copy doesn't own the arrays and is only used for the submission
+      render::command_buffer_t waitingCommandBuffer = commandBuffer;
+      waitingCommandBuffer.waitSemaphore = computeWaitSemaphores_.data();
+      waitingCommandBuffer.waitStages = computeWaitStages_.data();
+      waitingCommandBuffer.waitSemaphoreCount = (uint32_t)computeWaitSemaphores_.size();
+      render::commandBufferSubmit(context_, waitingCommandBuffer);
+      return;
+    }
+  }
+
+  render::commandBufferSubmit(context_, commandBuffer);
+}
+
+void renderer_t::releaseDescriptorSet(const render::descriptor_set_t& descriptorSet)
+{
+  releasedDescriptorSets_[render::getFrameIndex(context_)].push_back(descriptorSet);
+}
+
+void renderer_t::releaseBuffer(const render::gpu_buffer_t& buffer)
 {
-  releasedCommandBuffers_.push_back(*cmdBuffer);
+  releasedBuffers_[render::getFrameIndex(context_)].push_back(buffer);
 }
 
 void renderer_t::prepareShaders(const char* passName, frame_buffer_handle_t fb)